@@ -1,48 +1,175 @@
 #pragma once
-#include <QImage>
+#include <QByteArray>
+#include <QMutex>
+#include <QSharedPointer>
+#include <QThreadPool>
 #include <QVector>
+#include <atomic>
+#include <functional>
+#include "tiledimage.h"
 
+class QTemporaryFile;
+
+// Histórico baseado em blocos: cada passo guarda só os tiles que mudaram
+// entre dois estados, e não uma cópia inteira do canvas. Como os tiles do
+// TiledImage são compartilhados, detectar a mudança é comparar ponteiros, e
+// o estado atual divide os tiles com o canvas em vez de ser uma cópia.
+//
+// Passos distantes do cursor são comprimidos numa thread de fundo e, se o
+// orçamento de memória estourar, gravados num arquivo temporário. Os passos
+// vizinhos ao cursor são trazidos de volta antecipadamente, para que o
+// undo normalmente não precise esperar pelo disco.
+//
+// Passos de comando (traços à mão livre) não guardam tiles: guardam a
+// receita que leva de um estado ao seguinte. Redo reaplica a receita;
+// undo parte do quadro-chave mais próximo (o estado inteiro, com tiles
+// compartilhados) e reaplica os comandos depois dele. Um quadro-chave é
+// tirado no começo de cada sequência de comandos e a cada KeyframeInterval
+// comandos ou KeyframeCost de replay acumulado, o que limita a espera do undo.
+// Os tiles que só um quadro-chave segura contam no orçamento; quando ele
+// estoura, quadros-chave do meio de uma sequência são descartados (o undo
+// refaz a partir do anterior) e os do começo vão comprimidos para o disco.
+//
+// O histórico é uma árvore: desenhar depois de um undo abre um ramo novo em
+// vez de descartar o redo. O nó 0 é o primeiro estado e o passo n - 1 é a
+// aresta que chega ao nó n, então um histórico linear continua sendo a mesma
+// lista de passos. Um ramo guarda só os tiles que mudou; os demais continuam
+// compartilhados com o resto da árvore.
 class UndoStack {
 public:
-    void clear() {
-        stack.clear();
-        index = -1;
-    }
-
-    void push(const QImage& img) {
-        // Remove qualquer estado futuro se o usuário desenhar após um undo
-        while (stack.size() > index + 1)
-            stack.removeLast();
-
-        stack.append(img);
-        index = stack.size() - 1;
-    }
-
-    bool canUndo() const {
-        return index > 0;
-    }
-
-    bool canRedo() const {
-        return index >= 0 && index < stack.size() - 1;
-    }
-
-    QImage undo() {
-        if (canUndo())
-            --index;
-        return current();
-    }
-
-    QImage redo() {
-        if (canRedo())
-            ++index;
-        return current();
-    }
-
-    QImage current() const {
-        return (index >= 0 && index < stack.size()) ? stack[index] : QImage();
-    }
+    static const int ResidentSteps = 3;  // passos mantidos sem compressão em volta do cursor
+    static const int KeyframeInterval = 16;
+    static const qint64 KeyframeCost = 100 * 1000 * 1000;  // ns de replay
+
+    // Refaz um comando sobre um estado e devolve o estado seguinte
+    using Replay = std::function<TiledImage(const TiledImage &state, const QByteArray &command)>;
+
+    UndoStack();
+    ~UndoStack();
+
+    void clear();
+    // extra acompanha o estado (dados de quem usa a pilha, como as
+    // propriedades das camadas); mudar só extra também cria um passo
+    void push(const TiledImage& img, const QByteArray &extra = QByteArray());
+    // img é o resultado de aplicar command ao estado atual; cost é o tempo
+    // que ele levou ao vivo (ns). Sem replay configurado vira um push comum.
+    void pushCommand(const TiledImage &img, const QByteArray &extra, const QByteArray &command, qint64 cost);
+    void setReplay(const Replay &replay);
+
+    bool canUndo() const;
+    bool canRedo() const;
+
+    // Um passo que não volta do arquivo de troca recusa a operação (com um
+    // aviso) e o estado atual fica como está
+    TiledImage undo();
+    TiledImage redo();  // segue o último ramo visitado a partir do nó atual
+
+    // Árvore do histórico (nós 0..nodeCount() - 1)
+    int currentNode() const;
+    int nodeCount() const;
+    int parentNode(int node) const;  // -1 para a raiz
+    QVector<int> childNodes(int node) const;
+    // Desfaz até o ancestral comum e refaz até node: só os tiles dos passos
+    // no caminho são trocados
+    TiledImage jumpTo(int node);
+    TiledImage current() const;
+    QByteArray currentExtra() const;
+
+    // Histórico inteiro serializado (para o arquivo de projeto); restore()
+    // usa current como estado atual e deixa os passos comprimidos até o uso
+    QByteArray save();
+    // O mesmo que save(), mas aqui só guarda referências aos passos: a função
+    // devolvida comprime e lê o disco depois, em qualquer thread
+    std::function<QByteArray()> saveSnapshot();
+    bool restore(const QByteArray &data, const TiledImage &current, const QByteArray &currentExtra = QByteArray());
+
+    // Orçamento para o histórico (o estado atual não entra na conta)
+    void setMemoryBudget(qint64 bytes);
+    qint64 memoryBudget() const;
+
+    // Bytes ocupados em RAM pelos passos guardados
+    qint64 memoryUsage() const;
 
 private:
-    QVector<QImage> stack;
-    int index = -1;
+    struct Change {
+        int index;              // posição do tile na grade
+        TiledImage::Tile tile;  // conteúdo do tile "do outro lado" do passo
+    };
+
+    enum class Storage { Raw, Compressed, Spilled };
+
+    // Passo entre o nó parent e o nó seguinte ao passo. Undo e redo trocam o
+    // conteúdo dos tiles com o estado atual, então o mesmo passo serve
+    // para os dois sentidos sem duplicar memória.
+    struct Step {
+        QMutex mutex;
+        QVector<Change> tiles;
+        TiledImage fullImage;  // usado quando tamanho ou formato mudam
+        QByteArray extra;      // extra "do outro lado"; pequeno, nunca comprimido
+        QByteArray command;    // passo de comando: a receita no lugar dos tiles
+        TiledImage keyframe;   // estado antes do comando, nos quadros-chave
+        bool hasKeyframe = false;  // em RAM, comprimido em packed ou no disco
+        qint64 held = 0;           // bytes de tiles que só o quadro-chave segura
+        std::atomic<bool> heldValid{false};  // held em dia com o estado atual
+        qint64 cost = 0;       // custo estimado de refazer o comando (ns)
+        int parent = 0;        // nó de onde o passo parte
+
+        Storage storage = Storage::Raw;
+        QByteArray packed;       // tiles comprimidos
+        qint64 fileOffset = -1;  // posição no arquivo de troca
+        int fileSize = 0;
+        std::atomic<qint64> bytes{0};  // memória ocupada no estado atual
+        int generation = 0;      // muda a cada troca com o estado
+        bool pending = false;    // já existe um job na fila para este passo
+    };
+    using StepPtr = QSharedPointer<Step>;
+
+    // Arquivo de troca compartilhado com os jobs em andamento
+    struct SpillFile {
+        QMutex mutex;
+        QSharedPointer<QTemporaryFile> file;
+        qint64 write(const QByteArray &data);
+        QByteArray read(qint64 offset, int size);
+    };
+
+    static bool tileDiffers(const TiledImage::Tile &a, const TiledImage::Tile &b);
+    static qint64 rawBytes(const Step &step);
+    static QByteArray pack(const Step &step);
+    static bool unpack(Step &step, const QByteArray &data);  // false: bloco corrompido, passo intacto
+    // Traz o passo para a RAM; se a leitura do disco ou a descompressão
+    // falharem, devolve false e o passo continua como estava
+    static bool makeResident(Step &step, SpillFile &spill);
+    static QByteArray write(const QVector<StepPtr> &steps, const TiledImage &state, int cursor,
+                            const QVector<int> &redoChild, SpillFile &spill);
+    static void compactJob(StepPtr step, QSharedPointer<SpillFile> spill, bool toDisk);
+    static void prefetchJob(StepPtr step, QSharedPointer<SpillFile> spill);
+
+    // Passo que chega ao nó (node >= 1)
+    Step &stepInto(int node) const;
+    qint64 heldBytes(const TiledImage &keyframe) const;  // tiles que só o quadro-chave segura
+    // Troca o estado atual e ajusta held dos quadros-chave só nos tiles trocados
+    void setState(const TiledImage &next);
+    void trackHeld(const QVector<Change> &replaced);  // replaced: tiles que o estado tinha antes
+    void invalidateHeld();
+    bool startsCommandRun(int node) const;  // o passo que chega a node é o primeiro comando da sequência
+    QVector<int> distancesFromCursor() const;
+    // Os três devolvem false, sem mexer no estado, se o passo não pôde ser lido
+    bool swapStep(Step &step);
+    bool stepUp();
+    bool stepDown(int child);
+    bool ensureResident(int node) const;  // o que desfazer o passo que chega a node vai ler
+    bool settle(int &stale, int stateNode);  // jumpTo: refaz o estado de uma subida por comandos
+    QVector<int> commandChain(int node) const;  // node e os comandos até o quadro-chave
+    TiledImage commandSource(int node) const;  // estado antes do passo de comando que chega a node; nulo se ilegível
+    void scheduleMaintenance();
+
+    QVector<StepPtr> steps;
+    TiledImage state;
+    QByteArray stateExtra;
+    Replay replay;
+    QVector<int> redoChild;  // por nó: filho seguido pelo redo (-1 = nenhum)
+    int cursor = -1;         // nó atual
+    qint64 budget = 1024ll * 1024 * 1024;
+    QSharedPointer<SpillFile> spill;
+    QThreadPool workers;  // último membro: é destruído primeiro e espera os jobs
 };
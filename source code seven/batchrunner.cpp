@@ -0,0 +1,312 @@
+#include "batchrunner.h"
+#include "imageexporter.h"
+#include "projectfile.h"
+#include <QAtomicInt>
+#include <QCommandLineParser>
+#include <QDebug>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QImageReader>
+#include <QTextStream>
+#include <QThread>
+#include <QThreadPool>
+
+namespace {
+
+const QHash<QString, ToolType> &toolNames() {
+    static const QHash<QString, ToolType> names = {
+        {"pencil", ToolType::Pencil},     {"brush", ToolType::Brush},
+        {"line", ToolType::Line},         {"rectangle", ToolType::Rectangle},
+        {"ellipse", ToolType::Ellipse},   {"triangle", ToolType::Triangle},
+        {"curve", ToolType::Curve},       {"bucket", ToolType::Bucket},
+        {"spray", ToolType::Spray},       {"eyedropper", ToolType::Eyedropper},
+        {"text", ToolType::Text},         {"select", ToolType::Select},
+        {"eraser", ToolType::Eraser},
+    };
+    return names;
+}
+
+bool toInt(const QString &text, int &value) {
+    bool ok = false;
+    value = text.toInt(&ok);
+    return ok;
+}
+
+bool toColor(const QString &text, QColor &color) {
+    color = QColor(text);
+    return color.isValid();
+}
+
+// Lê count inteiros de args a partir de first
+bool toInts(const QStringList &args, int first, int count, QVector<int> &values) {
+    if (args.size() != first + count)
+        return false;
+    values.resize(count);
+    for (int i = 0; i < count; ++i) {
+        if (!toInt(args[first + i], values[i]))
+            return false;
+    }
+    return true;
+}
+
+} // namespace
+
+int BatchRunner::exec(const QStringList &arguments) {
+    QCommandLineParser parser;
+    parser.setApplicationDescription("LittlePaint batch renderer");
+    parser.addHelpOption();
+    parser.addOption({"headless", "Run without a window."});
+    parser.addOption({{"s", "script"}, "Command script to run.", "file"});
+    parser.addOption({{"o", "output"}, "Directory used for {output}.", "dir", "."});
+    parser.addOption({{"j", "jobs"}, "Images processed at once (default: one per core).", "n"});
+    parser.addPositionalArgument("inputs", "Images or directories of images.", "[inputs...]");
+    parser.process(arguments);
+
+    QFile file(parser.value("script"));
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        qCritical() << "❌ Roteiro não encontrado:" << parser.value("script");
+        return 1;
+    }
+    const QStringList script = QTextStream(&file).readAll().split('\n');
+
+    const QString output = QDir(parser.value("output")).absolutePath();
+    QDir().mkpath(output);
+
+    const QStringList inputs = collectInputs(parser.positionalArguments());
+    if (inputs.isEmpty() && !parser.positionalArguments().isEmpty()) {
+        qCritical() << "❌ Nenhuma imagem nas entradas.";
+        return 1;
+    }
+
+    // Sem entradas: o roteiro roda uma vez e cria o próprio documento
+    if (inputs.isEmpty()) {
+        Document doc;
+        QString error;
+        QElapsedTimer timer;
+        timer.start();
+        if (!run(script, doc, {{"output", output}}, &error)) {
+            qCritical() << "❌" << error;
+            return 1;
+        }
+        qInfo() << "✅ roteiro concluído em" << timer.elapsed() << "ms";
+        return 0;
+    }
+
+    // Um documento por imagem, cada um numa thread. Pool próprio: o
+    // PngWriter usa o pool global para as faixas e espera por elas.
+    QThreadPool pool;
+    const int jobs = parser.value("jobs").toInt();
+    pool.setMaxThreadCount(jobs > 0 ? jobs : QThread::idealThreadCount());
+
+    QAtomicInt failures;
+    QElapsedTimer total;
+    total.start();
+    for (const QString &input : inputs) {
+        pool.start([&script, &failures, input, output] {
+            const QHash<QString, QString> variables = {
+                {"input", input},
+                {"name", QFileInfo(input).completeBaseName()},
+                {"output", output},
+            };
+
+            QElapsedTimer timer;
+            timer.start();
+            Document doc;
+            QString error;
+            if (!doc.open(input, &error) || !run(script, doc, variables, &error)) {
+                qCritical() << "❌" << input << error;
+                failures.fetchAndAddRelaxed(1);
+                return;
+            }
+            qInfo() << "✅" << input << timer.elapsed() << "ms";
+        });
+    }
+    pool.waitForDone();
+
+    qInfo() << "🏁" << inputs.size() << "imagens em" << total.elapsed() << "ms,"
+            << failures.loadAcquire() << "falhas";
+    return failures.loadAcquire() == 0 ? 0 : 1;
+}
+
+bool BatchRunner::run(const QStringList &script, Document &doc,
+                      const QHash<QString, QString> &variables, QString *error) {
+    Tool tool;
+    for (int i = 0; i < script.size(); ++i) {
+        QStringList args = tokenize(script[i]);
+        if (args.isEmpty())
+            continue;
+
+        for (QString &arg : args) {
+            for (auto it = variables.constBegin(); it != variables.constEnd(); ++it)
+                arg.replace("{" + it.key() + "}", it.value());
+        }
+
+        QString message;
+        if (!runCommand(args, doc, tool, &message)) {
+            if (error)
+                *error = QString("line %1: %2").arg(i + 1).arg(message);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool BatchRunner::runCommand(const QStringList &args, Document &doc, Tool &tool, QString *error) {
+    const QString command = args.first().toLower();
+    QVector<int> n;
+    QColor color;
+    BlendMode mode;
+    const QString sub = args.value(1).toLower();
+
+    if (command == "new" && toInts(args, 1, 2, n)) {
+        doc.setImage(TiledImage(QSize(n[0], n[1]), TiledImage::LayerFormat, Qt::transparent), true);
+    } else if (command == "open" && args.size() == 2) {
+        return doc.open(args[1], error);
+    } else if (command == "export" && args.size() == 2) {
+        const QByteArray format = QFileInfo(args[1]).suffix().toLower().toUtf8();
+        if (!ImageExporter::write(doc.exportSnapshot(format), args[1], format)) {
+            *error = "could not write " + args[1];
+            return false;
+        }
+    } else if (command == "save" && args.size() == 2) {
+        if (!ProjectFile::save(doc.contents(true), args[1])) {
+            *error = "could not write " + args[1];
+            return false;
+        }
+    } else if (command == "resize" && toInts(args, 1, 2, n)) {
+        doc.resize(n[0], n[1]);
+    } else if (command == "clear" && args.size() == 1) {
+        doc.clear();
+    } else if (command == "tool" && args.size() == 2 && toolNames().contains(args[1].toLower())) {
+        tool.setType(toolNames().value(args[1].toLower()));
+    } else if (command == "color" && args.size() == 2 && toColor(args[1], color)) {
+        tool.setOutlineColor(color);
+    } else if (command == "fill-color" && args.size() == 2 && toColor(args[1], color)) {
+        tool.setFillColor(color);
+    } else if (command == "fill" && args.size() == 2 && (args[1] == "on" || args[1] == "off")) {
+        tool.setFillEnabled(args[1] == "on");
+    } else if (command == "thickness" && toInts(args, 1, 1, n)) {
+        tool.setThickness(n[0]);
+    } else if (command == "opacity" && args.size() == 2) {
+        tool.setOpacity(args[1].toFloat());
+    } else if (command == "tolerance" && toInts(args, 1, 1, n)) {
+        tool.setTolerance(n[0]);
+    } else if (command == "font" && toInts(args, 2, 1, n)) {
+        tool.setFont(QFont(args[1], n[0]));
+    } else if (command == "background" && args.size() == 2 && toColor(args[1], color)) {
+        doc.setBackgroundColor(color);
+    } else if (command == "stroke" && args.size() >= 3 && args.size() % 2 == 1
+               && toInts(args, 1, args.size() - 1, n)) {
+        QVector<QPoint> points;
+        for (int i = 0; i + 1 < n.size(); i += 2)
+            points.append(QPoint(n[i], n[i + 1]));
+
+        if (StrokeEngine::handles(tool.type())) {
+            doc.beginStroke(tool, points.first());
+            for (int i = 1; i < points.size(); ++i)
+                doc.addStrokePoint(points[i]);
+            doc.endStroke();
+        } else if (tool.type() == ToolType::Spray) {
+            for (const QPoint &point : points)
+                doc.spray(point, tool);
+            doc.commit();
+        } else if (tool.type() == ToolType::Eraser) {
+            for (int i = 1; i < points.size(); ++i)
+                doc.erase(points[i - 1], points[i], tool);
+            doc.commit();
+        } else {
+            doc.drawShape(points.first(), points.last(), tool);
+        }
+    } else if (command == "bucket" && toInts(args, 1, 2, n)) {
+        doc.bucketFill(QPoint(n[0], n[1]), tool);
+    } else if (command == "text" && args.size() == 4 && toInts(args.mid(0, 3), 1, 2, n)) {
+        doc.drawText(QPoint(n[0], n[1]), args[3], tool);
+    } else if (command == "select" && toInts(args, 1, 4, n)) {
+        doc.setSelectionRect(QRect(n[0], n[1], n[2], n[3]));
+    } else if (command == "copy" && args.size() == 1) {
+        doc.copySelection();
+    } else if (command == "cut" && args.size() == 1) {
+        doc.cutSelection();
+    } else if (command == "paste" && args.size() == 1) {
+        doc.pasteSelection();
+    } else if (command == "apply" && args.size() == 1) {
+        doc.applySelection();
+    } else if (command == "flip" && args.size() == 2 && (args[1] == "h" || args[1] == "v")) {
+        doc.flipSelection(args[1] == "h", args[1] == "v");
+    } else if (command == "rotate" && toInts(args, 1, 1, n)) {
+        doc.rotateSelection(n[0]);
+    } else if (command == "undo" && args.size() == 1) {
+        doc.undo();
+    } else if (command == "redo" && args.size() == 1) {
+        doc.redo();
+    } else if (command == "jump" && toInts(args, 1, 1, n) && n[0] >= 0 && n[0] < doc.historyNodeCount()) {
+        doc.jumpToHistory(n[0]);
+    } else if (command == "layer" && sub == "add" && args.size() <= 3) {
+        doc.addLayer(args.value(2));
+    } else if (command == "layer" && sub == "remove" && args.size() == 2) {
+        doc.removeLayer(doc.activeLayer());
+    } else if (command == "layer" && sub == "select" && toInts(args, 2, 1, n)
+               && n[0] >= 0 && n[0] < doc.layerCount()) {
+        doc.setActiveLayer(n[0]);
+    } else if (command == "layer" && sub == "move" && toInts(args, 2, 2, n)) {
+        doc.moveLayer(n[0], n[1]);
+    } else if (command == "layer" && sub == "opacity" && toInts(args, 2, 1, n)) {
+        doc.setLayerOpacity(doc.activeLayer(), n[0] / 100.0);
+    } else if (command == "layer" && sub == "visible" && args.size() == 3 && (args[2] == "on" || args[2] == "off")) {
+        doc.setLayerVisible(doc.activeLayer(), args[2] == "on");
+    } else if (command == "layer" && sub == "mode" && args.size() == 3 && Blend::fromName(args[2], mode)) {
+        doc.setLayerBlendMode(doc.activeLayer(), mode);
+    } else {
+        *error = "invalid command: " + args.join(' ');
+        return false;
+    }
+    return true;
+}
+
+QStringList BatchRunner::tokenize(const QString &line) {
+    QStringList tokens;
+    QString current;
+    bool quoted = false;
+    bool pending = false;
+
+    for (const QChar c : line) {
+        if (c == '"') {
+            quoted = !quoted;
+            pending = true;
+        } else if (c == '#' && !quoted) {
+            break;
+        } else if (c.isSpace() && !quoted) {
+            if (pending)
+                tokens.append(current);
+            current.clear();
+            pending = false;
+        } else {
+            current += c;
+            pending = true;
+        }
+    }
+    if (pending)
+        tokens.append(current);
+    return tokens;
+}
+
+QStringList BatchRunner::collectInputs(const QStringList &paths) {
+    QStringList filters("*.lpaint");
+    for (const QByteArray &format : QImageReader::supportedImageFormats())
+        filters.append("*." + QString::fromLatin1(format));
+
+    QStringList inputs;
+    for (const QString &path : paths) {
+        const QFileInfo info(path);
+        if (info.isDir()) {
+            const QDir dir(path);
+            for (const QString &name : dir.entryList(filters, QDir::Files, QDir::Name))
+                inputs.append(dir.absoluteFilePath(name));
+        } else if (info.isFile()) {
+            inputs.append(info.absoluteFilePath());
+        }
+    }
+    return inputs;
+}
@@ -0,0 +1,56 @@
+#ifndef BATCHRUNNER_H
+#define BATCHRUNNER_H
+
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include "document.h"
+#include "tool.h"
+
+// Modo --headless: roda um roteiro de comandos sobre um Document, sem
+// janela (plataforma offscreen). Com imagens ou pastas de entrada, cada
+// imagem é aberta num Document próprio e o roteiro roda em paralelo, uma
+// imagem por núcleo.
+//
+//   LittlePaint --headless -s roteiro.txt [-o saida] [-j threads] [entradas...]
+//
+// Uma linha por comando; # começa um comentário e "..." agrupa argumentos
+// com espaço. {input}, {name} e {output} são trocados pelo caminho da
+// entrada, pelo nome dela sem extensão e pela pasta de saída.
+//
+//   new W H                  open CAMINHO             export CAMINHO
+//   save CAMINHO (.lpaint)   resize W H               clear
+//   tool NOME                color COR                fill-color COR
+//   fill on|off              thickness N              opacity 0-1
+//   tolerance N              font FAMÍLIA TAMANHO     background COR
+//   stroke X Y X Y ...       bucket X Y               text X Y "TEXTO"
+//   select X Y W H           copy | cut | paste       apply
+//   flip h|v                 rotate GRAUS             undo | redo
+//   jump NÓ (nó do histórico: 0 é o estado inicial, um por passo criado)
+//   layer add [NOME]         layer remove             layer select N
+//   layer move DE PARA       layer opacity 0-100      layer visible on|off
+//   layer mode normal|multiply|screen|overlay
+//
+// As ferramentas desenham na camada ativa; remove, opacity, visible e mode
+// também agem sobre ela. Editar depois de um undo abre um ramo novo no
+// histórico; o ramo antigo continua alcançável por jump.
+//
+// stroke segue a ferramenta: lápis e pincel passam pelo StrokeEngine, spray
+// borrifa em cada ponto, borracha liga os pontos e as formas usam o
+// primeiro e o último.
+class BatchRunner {
+public:
+    // Ponto de entrada a partir de main(); devolve o código de saída
+    static int exec(const QStringList &arguments);
+
+    // Roda as linhas do roteiro num documento; para no primeiro erro
+    static bool run(const QStringList &script, Document &doc,
+                    const QHash<QString, QString> &variables, QString *error);
+
+private:
+    static bool runCommand(const QStringList &args, Document &doc, Tool &tool, QString *error);
+    static QStringList tokenize(const QString &line);
+    static QStringList collectInputs(const QStringList &paths);
+};
+
+#endif // BATCHRUNNER_H
@@ -0,0 +1,692 @@
+// Micro-benchmarks dos caminhos quentes do canvas (alvo littlepaint_bench).
+// Cada caso repete o corpo até somar MinTime ou MaxIterations e informa a
+// mediana por iteração, a vazão em megapixels/s e o pico de memória
+// residente durante o caso. A preparação de cada iteração fica fora da
+// medição.
+//
+//   littlepaint_bench [filtro...] [--csv]
+//   littlepaint_bench --verify
+//
+// Com filtros, só roda os casos cujo nome contém algum deles. --verify não
+// mede nada: confere os caminhos rápidos contra as referências (Blend::row
+// contra Blend::pixel, o replay dos traços contra o traço ao vivo) e sai
+// com 1 se algum pixel diferir.
+
+#include <QApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QLineF>
+#include <QLinearGradient>
+#include <QPainter>
+#include <QRandomGenerator>
+#include <QStringList>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "blend.h"
+#include "canvaswidget.h"
+#include "document.h"
+#include "floodfill.h"
+#include "imageexporter.h"
+#include "mipmap.h"
+#include "projectfile.h"
+#include "sprayengine.h"
+#include "strokeengine.h"
+#include "thumbnailcache.h"
+#include "tiledimage.h"
+#include "tool.h"
+#include "UndoStack.h"
+
+#ifdef Q_OS_UNIX
+#include <sys/resource.h>
+#endif
+
+namespace {
+
+const qint64 MinTime = 500;      // ms por caso
+const int MaxIterations = 200;
+
+// Zera o pico de RSS do processo (Linux); nos outros sistemas o pico é
+// o do processo inteiro até ali
+void resetPeakRss() {
+#ifdef Q_OS_LINUX
+    QFile clear("/proc/self/clear_refs");
+    if (clear.open(QIODevice::WriteOnly))
+        clear.write("5");
+#endif
+}
+
+double peakRssMb() {
+#ifdef Q_OS_LINUX
+    QFile status("/proc/self/status");
+    if (status.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        for (const QByteArray &line : status.readAll().split('\n')) {
+            if (line.startsWith("VmHWM:"))
+                return line.mid(6).trimmed().split(' ').first().toDouble() / 1024.0;
+        }
+    }
+#endif
+#ifdef Q_OS_UNIX
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef Q_OS_MACOS
+    return usage.ru_maxrss / (1024.0 * 1024.0);  // bytes
+#else
+    return usage.ru_maxrss / 1024.0;             // kilobytes
+#endif
+#else
+    return 0.0;
+#endif
+}
+
+class Bench {
+public:
+    Bench(const QStringList &filters, bool csv)
+        : filters(filters), csv(csv), out(stdout)
+    {
+        if (csv)
+            out << "name,iterations,ms_per_iteration,mpix_per_s,peak_rss_mb\n";
+        else
+            out << QString("%1 %2 %3 %4 %5\n").arg("benchmark", -28).arg("iter", 6)
+                       .arg("ms/iter", 10).arg("MP/s", 10).arg("peak MB", 10);
+        out.flush();
+    }
+
+    // setup roda antes de cada iteração, fora da medição; body devolve
+    // quantos pixels processou
+    void run(const QString &name, const std::function<void()> &setup,
+             const std::function<qint64()> &body) {
+        if (!filters.isEmpty()
+            && std::none_of(filters.begin(), filters.end(), [&](const QString &f) { return name.contains(f); }))
+            return;
+
+        resetPeakRss();
+        setup();
+        const qint64 pixels = body();  // aquecimento
+
+        std::vector<double> times;
+        QElapsedTimer total;
+        total.start();
+        while (total.elapsed() < MinTime && int(times.size()) < MaxIterations) {
+            setup();
+            QElapsedTimer timer;
+            timer.start();
+            body();
+            times.push_back(timer.nsecsElapsed() / 1e6);
+        }
+
+        std::sort(times.begin(), times.end());
+        const double median = times[times.size() / 2];
+        const double mpix = median > 0 ? pixels / (median * 1000.0) : 0.0;
+        const double peak = peakRssMb();
+
+        if (csv)
+            out << QString("%1,%2,%3,%4,%5\n").arg(name).arg(times.size())
+                       .arg(median, 0, 'f', 3).arg(mpix, 0, 'f', 1).arg(peak, 0, 'f', 1);
+        else
+            out << QString("%1 %2 %3 %4 %5\n").arg(name, -28).arg(times.size(), 6)
+                       .arg(median, 10, 'f', 3).arg(mpix, 10, 'f', 1).arg(peak, 10, 'f', 1);
+        out.flush();
+    }
+
+private:
+    QStringList filters;
+    bool csv;
+    QTextStream out;
+};
+
+qint64 area(const QSize &size) {
+    return qint64(size.width()) * size.height();
+}
+
+qint64 area(const QRect &rect) {
+    return rect.isEmpty() ? 0 : qint64(rect.width()) * rect.height();
+}
+
+// Conteúdo parecido com uma ilustração: degradê e manchas, com tiles
+// uniformes só nas bordas
+QImage sampleImage(const QSize &size) {
+    QImage image(size, TiledImage::LayerFormat);
+    QLinearGradient gradient(0, 0, size.width(), size.height());
+    gradient.setColorAt(0, QColor(30, 60, 120));
+    gradient.setColorAt(1, QColor(240, 200, 90));
+
+    QPainter painter(&image);
+    painter.fillRect(image.rect(), Qt::white);
+    painter.fillRect(image.rect().adjusted(size.width() / 8, size.height() / 8,
+                                           -size.width() / 8, -size.height() / 8), gradient);
+    painter.setRenderHint(QPainter::Antialiasing);
+    QRandomGenerator random(42);
+    for (int i = 0; i < 400; ++i) {
+        painter.setBrush(QColor::fromRgb(random.generate()));
+        painter.setPen(Qt::NoPen);
+        const int r = random.bounded(4, size.width() / 16 + 5);
+        painter.drawEllipse(QPoint(random.bounded(size.width()), random.bounded(size.height())), r, r);
+    }
+    return image;
+}
+
+QImage checkerboard(const QSize &size) {
+    QImage image(size, TiledImage::LayerFormat);
+    for (int y = 0; y < size.height(); ++y) {
+        quint32 *line = reinterpret_cast<quint32 *>(image.scanLine(y));
+        for (int x = 0; x < size.width(); ++x)
+            line[x] = (x + y) & 1 ? 0xff808080 : 0xff8a8a8a;
+    }
+    return image;
+}
+
+// Labirinto perfeito com corredores e paredes de 1 pixel (busca em
+// profundidade iterativa): o balde precisa percorrer o caminho inteiro
+QImage maze(const QSize &size) {
+    QImage image(size, TiledImage::LayerFormat);
+    image.fill(Qt::black);
+    const int cellsX = (size.width() - 1) / 2;
+    const int cellsY = (size.height() - 1) / 2;
+    std::vector<bool> visited(size_t(cellsX) * cellsY, false);
+    std::vector<QPoint> stack{QPoint(0, 0)};
+    visited[0] = true;
+    image.setPixel(1, 1, 0xffffffff);
+
+    QRandomGenerator random(7);
+    const QPoint steps[] = {QPoint(1, 0), QPoint(-1, 0), QPoint(0, 1), QPoint(0, -1)};
+    while (!stack.empty()) {
+        const QPoint cell = stack.back();
+        QPoint options[4];
+        int count = 0;
+        for (const QPoint &step : steps) {
+            const QPoint next = cell + step;
+            if (next.x() >= 0 && next.y() >= 0 && next.x() < cellsX && next.y() < cellsY
+                && !visited[size_t(next.y()) * cellsX + next.x()])
+                options[count++] = next;
+        }
+        if (count == 0) {
+            stack.pop_back();
+            continue;
+        }
+        const QPoint next = options[random.bounded(count)];
+        visited[size_t(next.y()) * cellsX + next.x()] = true;
+        image.setPixel(cell.x() + next.x() + 1, cell.y() + next.y() + 1, 0xffffffff);  // parede entre os dois
+        image.setPixel(next.x() * 2 + 1, next.y() * 2 + 1, 0xffffffff);
+        stack.push_back(next);
+    }
+    return image;
+}
+
+// Caminho em zigue-zague pelo canvas, como um traço de mão livre
+QVector<QPointF> strokePath(const QSize &size, int points) {
+    QVector<QPointF> path;
+    for (int i = 0; i < points; ++i) {
+        const qreal t = qreal(i) / (points - 1);
+        path.append(QPointF(size.width() * (0.1 + 0.8 * t),
+                            size.height() * (0.5 + 0.35 * std::sin(t * 12.0))));
+    }
+    return path;
+}
+
+qreal pathLength(const QVector<QPointF> &path) {
+    qreal length = 0;
+    for (int i = 1; i < path.size(); ++i)
+        length += QLineF(path[i - 1], path[i]).length();
+    return length;
+}
+
+void fillBenchmarks(Bench &bench) {
+    const QSize size(2048, 2048);
+    const struct {
+        const char *name;
+        TiledImage image;
+        QPoint seed;
+        int tolerance;
+    } cases[] = {
+        {"fill/empty-2048", TiledImage(size, TiledImage::LayerFormat, Qt::transparent), QPoint(1, 1), 0},
+        {"fill/checkerboard-2048", TiledImage::fromImage(checkerboard(size)), QPoint(1, 1), 16},
+        {"fill/maze-2047", TiledImage::fromImage(maze(size - QSize(1, 1))), QPoint(1, 1), 0},
+    };
+
+    for (const auto &c : cases) {
+        TiledImage canvas;
+        bench.run(c.name, [&] { canvas = c.image; }, [&] {
+            FloodFill::fill(canvas, c.seed, Qt::red, c.tolerance);
+            return area(canvas.size());
+        });
+    }
+}
+
+struct FormatCase {
+    const char *name;
+    QImage::Format format;
+};
+
+QVector<FormatCase> layerFormats() {
+    return {{"premultiplied", QImage::Format_ARGB32_Premultiplied}, {"straight", QImage::Format_ARGB32}};
+}
+
+void strokeBenchmarks(Bench &bench) {
+    const QSize size(4096, 4096);
+    const QVector<QPointF> path = strokePath(size, 400);
+
+    for (const ToolType type : {ToolType::Pencil, ToolType::Brush}) {
+        Tool tool;
+        tool.setType(type);
+        tool.setThickness(type == ToolType::Pencil ? 2 : 24);
+        tool.setOpacity(0.8f);
+
+        std::unique_ptr<Document> doc;
+        bench.run(type == ToolType::Pencil ? "stroke/pencil-4096" : "stroke/brush-4096",
+                  [&] { doc.reset(new Document(size)); }, [&] {
+            doc->beginStroke(tool, path.first());
+            for (int i = 1; i < path.size(); ++i) {
+                doc->addStrokePoint(path[i]);
+                if (i % 4 == 0)
+                    doc->flushStroke();  // um flush a cada quadro, como no paintEvent
+            }
+            doc->endStroke();
+            return qint64(pathLength(path) * tool.thickness());  // área varrida
+        });
+    }
+
+    // Spray e formas nos dois formatos: o interno (pré-multiplicado) e o
+    // ARGB32 comum, para comparar o custo das conversões do QPainter
+    for (const auto &format : layerFormats()) {
+        Tool spray;
+        spray.setType(ToolType::Spray);
+        spray.setThickness(50);
+        TiledImage canvas;
+        bench.run(QString("stroke/spray-4096-%1").arg(format.name),
+                  [&] { canvas = TiledImage(size, format.format, Qt::transparent); }, [&] {
+            qint64 pixels = 0;
+            for (const QPointF &point : path)
+                pixels += area(SprayEngine::spray(canvas, point.toPoint(), spray));
+            return pixels;
+        });
+
+        // Formas ainda passam pelo QPainter via Tool::apply
+        Tool line;
+        line.setType(ToolType::Line);
+        line.setThickness(8);
+        bench.run(QString("tool/line-apply-4096-%1").arg(format.name),
+                  [&] { canvas = TiledImage(size, format.format, Qt::transparent); }, [&] {
+            qint64 pixels = 0;
+            for (int i = 1; i < path.size(); i += 8) {
+                const QPoint a = path[i - 1].toPoint(), b = path[i].toPoint() + QPoint(200, 0);
+                canvas.paint(line.bounds(a, b), [&](QPainter &painter) {
+                    painter.setRenderHint(QPainter::Antialiasing);
+                    pixels += area(line.apply(painter, a, b));
+                });
+            }
+            return pixels;
+        });
+    }
+}
+
+// Composição de uma camada semitransparente sobre o fundo opaco, como em
+// Document::composite
+void compositeBenchmarks(Bench &bench) {
+    const QSize size(4096, 4096);
+    QImage layer(size, TiledImage::LayerFormat);
+    layer.fill(Qt::transparent);
+    {
+        QPainter painter(&layer);
+        painter.setOpacity(0.6);
+        painter.drawImage(0, 0, sampleImage(size));
+    }
+
+    for (const auto &format : layerFormats()) {
+        const TiledImage src = TiledImage::fromImage(layer.convertToFormat(format.format));
+        TiledImage dst;
+        bench.run(QString("composite/layer-4096-%1").arg(format.name),
+                  [&] { dst = TiledImage(size, QImage::Format_RGB32, Qt::white); }, [&] {
+            dst.draw(src);
+            return area(size);
+        });
+    }
+
+    // Kernels de mistura das camadas, linha a linha sobre o destino
+    const QImage src = layer.copy();
+    for (BlendMode mode : {BlendMode::Normal, BlendMode::Multiply, BlendMode::Screen, BlendMode::Overlay}) {
+        QImage dst;
+        bench.run(QString("composite/blend-%1-4096").arg(Blend::name(mode).toLower()),
+                  [&] { dst = sampleImage(size).convertToFormat(QImage::Format_RGB32); }, [&] {
+            for (int y = 0; y < size.height(); ++y)
+                Blend::row(mode, reinterpret_cast<quint32 *>(dst.scanLine(y)),
+                           reinterpret_cast<const quint32 *>(src.constScanLine(y)), size.width(), 200);
+            return area(size);
+        });
+    }
+
+    // Documento de 20 camadas: recompor tudo (mudou o fundo) e recompor
+    // só o que um traço na camada do meio sujou
+    const QSize docSize(2048, 2048);
+    Document doc(docSize);
+    doc.setImage(TiledImage::fromImage(sampleImage(docSize)), true);
+    doc.setSelectionRect(QRect(QPoint(0, 0), docSize / 2));
+    doc.copySelection();
+    for (int i = 1; i < 20; ++i) {
+        doc.addLayer();
+        doc.setSelectionRect(QRect((i * 97) % 1024, (i * 53) % 1024, 1024, 1024));
+        doc.pasteSelection();
+        doc.setLayerOpacity(i, 0.5);
+        if (i % 5 == 0)
+            doc.setLayerBlendMode(i, BlendMode::Multiply);
+    }
+    doc.clearSelection();
+    doc.setActiveLayer(10);
+
+    int step = 0;
+    bench.run("composite/20-layers-full-2048", [&] {
+        doc.setBackgroundColor(++step % 2 ? Qt::white : Qt::gray);
+    }, [&] {
+        doc.composite(doc.rect());
+        return area(docSize);
+    });
+
+    Tool shape;
+    shape.setType(ToolType::Rectangle);
+    shape.setThickness(8);
+    const QRect stroke(900, 900, 200, 200);
+    doc.composite(doc.rect());
+    bench.run("composite/20-layers-edit-2048", [&] {
+        shape.setOutlineColor(++step % 2 ? Qt::red : Qt::blue);
+        doc.drawShape(stroke.topLeft(), stroke.bottomRight(), shape);
+    }, [&] {
+        doc.composite(doc.rect());
+        return area(stroke.size());
+    });
+}
+
+void paintBenchmarks(Bench &bench, const QString &projectPath) {
+    const QSize viewport(1600, 1000);
+    CanvasWidget canvas;
+    if (!canvas.openProject(projectPath))
+        return;
+    QImage target(viewport, QImage::Format_ARGB32_Premultiplied);
+    const QRegion window(QRect(QPoint(0, 0), viewport));
+
+    // A widget tem o tamanho da imagem ampliada; como no QScrollArea, só a
+    // janela do viewport é desenhada. Com zoom inteiro o custo não depende do zoom.
+    for (const double zoom : {0.25, 0.5, 1.0, 2.0, 8.0, 32.0}) {
+        const QString suffix = QString::number(zoom);
+        canvas.setZoomFactor(zoom);
+
+        // Composição refeita: trocar o fundo suja a imagem inteira
+        int flip = 0;
+        bench.run("paint/recomposite-x" + suffix, [&] {
+            canvas.setBackgroundColor(++flip % 2 ? Qt::white : Qt::lightGray);
+        }, [&] {
+            canvas.render(&target, QPoint(), window);
+            return area(viewport);
+        });
+
+        // Só o blit da composição em cache
+        bench.run("paint/cached-x" + suffix, [] {}, [&] {
+            canvas.render(&target, QPoint(), window);
+            return area(viewport);
+        });
+    }
+
+    // Grade ligada: comparar com paint/cached-x do mesmo zoom
+    canvas.toggleGrid();
+    for (const double zoom : {0.5, 1.0, 8.0}) {
+        canvas.setZoomFactor(zoom);
+        bench.run("paint/grid-x" + QString::number(zoom), [] {}, [&] {
+            canvas.render(&target, QPoint(), window);
+            return area(viewport);
+        });
+    }
+    canvas.toggleGrid();
+    canvas.discardRecovery();
+}
+
+void undoBenchmarks(Bench &bench) {
+    for (const int side : {1024, 4096, 8192}) {
+        const QSize size(side, side);
+        UndoStack stack;
+        TiledImage image = TiledImage::fromImage(sampleImage(QSize(1024, 1024)).scaled(size));
+        stack.push(image);
+
+        // Cada passo altera um quarto da imagem
+        int step = 0;
+        bench.run(QString("undo/push+undo-%1").arg(side), [&] {
+            // Push depois de undo abre um ramo: sem o clear a árvore cresceria
+            // um quarto de imagem por iteração
+            stack.clear();
+            stack.push(image);
+            image.paint(QRect(0, 0, side / 2, side / 2), [&](QPainter &painter) {
+                painter.fillRect(0, 0, side / 2, side / 2, ++step % 2 ? Qt::red : Qt::blue);
+            });
+        }, [&] {
+            stack.push(image);
+            image = stack.undo();
+            return area(size);
+        });
+    }
+
+    // Dois ramos de 8 passos a partir do mesmo nó: pular de uma ponta à
+    // outra troca só os tiles que os 16 passos mudaram
+    {
+        const QSize size(4096, 4096);
+        UndoStack stack;
+        TiledImage image = TiledImage::fromImage(sampleImage(QSize(1024, 1024)).scaled(size));
+        stack.push(image);
+        int leaves[2] = {0, 0};
+        for (int branch = 0; branch < 2; ++branch) {
+            image = stack.jumpTo(0);
+            for (int i = 0; i < 8; ++i) {
+                image.paint(QRect(i * 256, branch * 2048, 256, 256), [&](QPainter &painter) {
+                    painter.fillRect(i * 256, branch * 2048, 256, 256, branch ? Qt::red : Qt::blue);
+                });
+                stack.push(image);
+            }
+            leaves[branch] = stack.currentNode();
+        }
+        int target = 0;
+        bench.run("undo/jump-branches-4096", [] {}, [&] {
+            image = stack.jumpTo(leaves[target ^= 1]);
+            return area(QSize(16 * 256, 256));
+        });
+    }
+
+    // Traços de pincel viram comandos: o undo refaz no máximo
+    // KeyframeInterval traços a partir do quadro-chave mais próximo
+    const QSize docSize(2048, 2048);
+    Document doc(docSize);
+    doc.setImage(TiledImage::fromImage(sampleImage(docSize)), true);
+    Tool brush;
+    brush.setType(ToolType::Brush);
+    brush.setThickness(24);
+    int stroke = 0;
+    bench.run("undo/brush-command-2048", [&] {
+        for (int i = 0; i < 4; ++i) {
+            const qreal y = 100 + (++stroke % 18) * 100;
+            doc.beginStroke(brush, QPointF(100, y));
+            for (int x = 120; x < 1900; x += 20)
+                doc.addStrokePoint(QPointF(x, y + x % 60));
+            doc.endStroke();
+        }
+    }, [&] {
+        doc.undo();
+        return area(QSize(1800, 90));
+    });
+
+    // Miniatura do painel de histórico (no worker, fora do paintEvent)
+    const TiledImage large = TiledImage::fromImage(sampleImage(QSize(1024, 1024)).scaled(4096, 4096));
+    bench.run("undo/thumbnail-4096", [] {}, [&] {
+        MipmapPyramid::thumbnail(large, QSize(ThumbnailCache::Width, ThumbnailCache::Height));
+        return area(large.size());
+    });
+}
+
+void selectionBenchmarks(Bench &bench) {
+    Document doc(QSize(2048, 2048));
+    doc.setImage(TiledImage::fromImage(sampleImage(QSize(2048, 2048))));
+    doc.setSelectionRect(QRect(512, 512, 1024, 1024));
+
+    bench.run("selection/rotate-1024", [&] { doc.copySelection(); }, [&] {
+        doc.rotateSelection(30);
+        return area(QSize(1024, 1024));
+    });
+}
+
+void exportBenchmarks(Bench &bench, const QString &dir) {
+    const TiledImage image = TiledImage::fromImage(sampleImage(QSize(4096, 4096)));
+    for (const char *format : {"png", "jpg"}) {
+        const QString path = dir + "/export." + format;
+        bench.run(QString("export/%1-4096").arg(format), [] {}, [&] {
+            ImageExporter::write(image, path, QByteArray(format));
+            return area(image.size());
+        });
+    }
+}
+
+} // namespace
+
+// Pixel pré-multiplicado aleatório; um quarto transparente e um quarto
+// opaco, para passar pelos atalhos dos kernels
+quint32 randomPremultiplied(QRandomGenerator &random) {
+    const int pick = random.bounded(4);
+    const int a = pick == 0 ? 0 : pick == 1 ? 255 : random.bounded(256);
+    return qRgba(random.bounded(a + 1), random.bounded(a + 1), random.bounded(a + 1), a);
+}
+
+int differingPixels(const QImage &a, const QImage &b) {
+    if (a.size() != b.size())
+        return qMax(1, a.width() * a.height());
+    const QImage x = a.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+    const QImage y = b.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+    int count = 0;
+    for (int row = 0; row < x.height(); ++row) {
+        const quint32 *p = reinterpret_cast<const quint32 *>(x.constScanLine(row));
+        const quint32 *q = reinterpret_cast<const quint32 *>(y.constScanLine(row));
+        for (int i = 0; i < x.width(); ++i)
+            count += p[i] != q[i];
+    }
+    return count;
+}
+
+void report(QTextStream &out, const QString &name, int mismatches) {
+    out << QString("%1 %2\n").arg(name, -28)
+               .arg(mismatches == 0 ? QString("ok") : QString("FAIL (%1 px)").arg(mismatches));
+    out.flush();
+}
+
+// Blend::row (SSE2 quando compilado com ele) contra Blend::pixel, que é a
+// versão escalar: linhas de tamanho variado para cobrir também o resto fora
+// dos blocos de quatro, e linhas quase transparentes para o atalho da fonte
+int verifyBlend(QTextStream &out) {
+    QRandomGenerator random(11);
+    int failures = 0;
+    for (BlendMode mode : {BlendMode::Normal, BlendMode::Multiply, BlendMode::Screen, BlendMode::Overlay}) {
+        int mismatches = 0;
+        for (int round = 0; round < 4000; ++round) {
+            const int count = random.bounded(1, 70);
+            const int opacity = round % 4 == 0 ? 255 : random.bounded(1, 256);
+            const bool sparse = round % 3 == 0;
+            std::vector<quint32> src(count), dst(count);
+            for (int i = 0; i < count; ++i) {
+                src[i] = sparse && random.bounded(4) != 0 ? 0 : randomPremultiplied(random);
+                dst[i] = randomPremultiplied(random);
+            }
+
+            std::vector<quint32> fast = dst;
+            Blend::row(mode, fast.data(), src.data(), count, opacity);
+            for (int i = 0; i < count; ++i)
+                mismatches += fast[i] != Blend::pixel(mode, dst[i], src[i], opacity);
+        }
+        report(out, "verify/blend-" + Blend::name(mode).toLower(), mismatches);
+        failures += mismatches > 0;
+    }
+    return failures;
+}
+
+// Traço ao vivo no Document contra o replay do StrokeCommand gravado: o
+// undo parte do quadro-chave e o redo refaz a receita (mesmos pontos e
+// mesma semente do spray) com StrokeCommand::apply
+int verifyStrokes(QTextStream &out) {
+    const QSize size(1024, 768);
+    const QVector<QPointF> path = strokePath(size, 120);
+    int failures = 0;
+    for (const ToolType type : {ToolType::Pencil, ToolType::Brush, ToolType::Spray, ToolType::Eraser}) {
+        Tool tool;
+        tool.setType(type);
+        tool.setThickness(type == ToolType::Pencil ? 2 : 24);
+        tool.setOpacity(0.8f);
+
+        // Fundo com conteúdo: pincel e borracha misturam com o que já existe
+        Document doc(size);
+        doc.setImage(TiledImage::fromImage(sampleImage(size)), true);
+        const QImage before = doc.canvas().toImage();
+
+        if (StrokeEngine::handles(type)) {
+            doc.beginStroke(tool, path.first());
+            for (int i = 1; i < path.size(); ++i) {
+                doc.addStrokePoint(path[i]);
+                if (i % 4 == 0)
+                    doc.flushStroke();
+            }
+            doc.endStroke();
+        } else {
+            for (int i = 0; i < path.size(); ++i) {
+                if (type == ToolType::Spray)
+                    doc.spray(path[i].toPoint(), tool);
+                else if (i > 0)
+                    doc.erase(path[i - 1].toPoint(), path[i].toPoint(), tool);
+            }
+            doc.commit();
+        }
+        const QImage live = doc.canvas().toImage();
+
+        int mismatches = differingPixels(live, before) == 0 ? 1 : 0;  // o traço precisa mudar algo
+        mismatches += doc.undo() ? differingPixels(doc.canvas().toImage(), before) : 1;
+        mismatches += doc.redo() ? differingPixels(doc.canvas().toImage(), live) : 1;
+
+        const char *name = type == ToolType::Pencil ? "pencil"
+                         : type == ToolType::Brush ? "brush"
+                         : type == ToolType::Spray ? "spray" : "eraser";
+        report(out, QString("verify/replay-%1").arg(name), mismatches);
+        failures += mismatches > 0;
+    }
+    return failures;
+}
+
+int main(int argc, char *argv[]) {
+    // Sem janela: roda em máquinas de CI sem display
+    qputenv("QT_QPA_PLATFORM", "offscreen");
+    QApplication app(argc, argv);
+
+    QStringList filters = app.arguments().mid(1);
+    const bool csv = filters.removeAll("--csv") > 0;
+    if (filters.removeAll("--verify") > 0) {
+        QTextStream out(stdout);
+        const int failures = verifyBlend(out) + verifyStrokes(out);
+        return failures > 0 ? 1 : 0;
+    }
+
+    QTemporaryDir dir;
+    if (!dir.isValid())
+        return 1;
+
+    ProjectFile::Contents contents;
+    Layer layer;
+    layer.name = "Layer 1";
+    layer.image = TiledImage::fromImage(sampleImage(QSize(6000, 4000)));
+    contents.layers.append(layer);
+    const QString projectPath = dir.path() + "/sample.lpaint";
+    if (!ProjectFile::save(contents, projectPath))
+        return 1;
+
+    Bench bench(filters, csv);
+    fillBenchmarks(bench);
+    strokeBenchmarks(bench);
+    compositeBenchmarks(bench);
+    paintBenchmarks(bench, projectPath);
+    undoBenchmarks(bench);
+    selectionBenchmarks(bench);
+    exportBenchmarks(bench, dir.path());
+    return 0;
+}
@@ -0,0 +1,184 @@
+#include "blend.h"
+#include <algorithm>
+
+#if defined(__SSE2__) && defined(__GNUC__)
+#include <emmintrin.h>
+#define LP_BLEND_SSE2
+#endif
+
+namespace {
+
+// x * y / 255 arredondado, sem divisão (exato para 0 e 255)
+inline int mul255(int a, int b) {
+    const int t = a * b + 128;
+    return (t + (t >> 8)) >> 8;
+}
+
+template <BlendMode Mode>
+inline int blendChannel(int s, int d, int sa, int da) {
+    switch (Mode) {
+    case BlendMode::Normal:
+        return s + mul255(d, 255 - sa);
+    case BlendMode::Multiply:
+        return mul255(s, 255 - da) + mul255(d, 255 - sa) + mul255(s, d);
+    case BlendMode::Screen:
+        return s + d - mul255(s, d);
+    case BlendMode::Overlay: {
+        // Hard light com fonte e destino trocados, já multiplicado por sa * da
+        const int mixed = 2 * d <= da ? 2 * mul255(s, d)
+                                      : std::max(0, mul255(sa, da) - 2 * mul255(std::max(0, da - d), std::max(0, sa - s)));
+        return mul255(s, 255 - da) + mul255(d, 255 - sa) + mixed;
+    }
+    }
+    return d;
+}
+
+template <BlendMode Mode>
+inline quint32 blendPixel(quint32 dst, quint32 src, int opacity) {
+    if (opacity < 255) {
+        src = quint32(mul255(int(src & 0xff), opacity))
+            | quint32(mul255(int((src >> 8) & 0xff), opacity)) << 8
+            | quint32(mul255(int((src >> 16) & 0xff), opacity)) << 16
+            | quint32(mul255(int(src >> 24), opacity)) << 24;
+    }
+    if (src == 0)
+        return dst;
+
+    const int sa = int(src >> 24);
+    const int da = int(dst >> 24);
+    quint32 out = 0;
+    for (int shift = 0; shift < 32; shift += 8) {
+        const int value = blendChannel<Mode>(int((src >> shift) & 0xff), int((dst >> shift) & 0xff), sa, da);
+        out |= quint32(qBound(0, value, 255)) << shift;
+    }
+    return out;
+}
+
+#ifdef LP_BLEND_SSE2
+inline __m128i mul255(__m128i a, __m128i b) {
+    const __m128i t = _mm_add_epi16(_mm_mullo_epi16(a, b), _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+// Alpha de cada um dos dois pixels repetido nos quatro canais
+inline __m128i alphas(__m128i x) {
+    return _mm_shufflehi_epi16(_mm_shufflelo_epi16(x, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+}
+
+// Dois pixels, um canal por palavra de 16 bits
+template <BlendMode Mode>
+inline __m128i blendLanes(__m128i s, __m128i d) {
+    const __m128i full = _mm_set1_epi16(255);
+    const __m128i sa = alphas(s);
+    const __m128i da = alphas(d);
+    switch (Mode) {
+    case BlendMode::Normal:
+        return _mm_add_epi16(s, mul255(d, _mm_sub_epi16(full, sa)));
+    case BlendMode::Multiply:
+        return _mm_add_epi16(_mm_add_epi16(mul255(s, _mm_sub_epi16(full, da)), mul255(d, _mm_sub_epi16(full, sa))),
+                             mul255(s, d));
+    case BlendMode::Screen:
+        return _mm_sub_epi16(_mm_add_epi16(s, d), mul255(s, d));
+    case BlendMode::Overlay: {
+        const __m128i sd = mul255(s, d);
+        const __m128i low = _mm_add_epi16(sd, sd);
+        const __m128i inv = mul255(_mm_subs_epu16(da, d), _mm_subs_epu16(sa, s));
+        const __m128i high = _mm_subs_epu16(mul255(sa, da), _mm_add_epi16(inv, inv));
+        const __m128i useHigh = _mm_cmpgt_epi16(_mm_add_epi16(d, d), da);
+        const __m128i mixed = _mm_or_si128(_mm_and_si128(useHigh, high), _mm_andnot_si128(useHigh, low));
+        return _mm_add_epi16(_mm_add_epi16(mul255(s, _mm_sub_epi16(full, da)), mul255(d, _mm_sub_epi16(full, sa))),
+                             mixed);
+    }
+    }
+    return d;
+}
+
+template <BlendMode Mode>
+void blendRow(quint32 *dst, const quint32 *src, int count, int opacity) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i scale = _mm_set1_epi16(short(opacity));
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        // Fonte transparente não muda nada em nenhum modo
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(s, zero)) == 0xffff)
+            continue;
+
+        const __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i *>(dst + i));
+        __m128i sLow = _mm_unpacklo_epi8(s, zero);
+        __m128i sHigh = _mm_unpackhi_epi8(s, zero);
+        if (opacity < 255) {
+            sLow = mul255(sLow, scale);
+            sHigh = mul255(sHigh, scale);
+        }
+        const __m128i low = blendLanes<Mode>(sLow, _mm_unpacklo_epi8(d, zero));
+        const __m128i high = blendLanes<Mode>(sHigh, _mm_unpackhi_epi8(d, zero));
+        // packus satura: arredondamentos acima de 255 ficam em 255
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_packus_epi16(low, high));
+    }
+    for (; i < count; ++i)
+        dst[i] = blendPixel<Mode>(dst[i], src[i], opacity);
+}
+#else
+template <BlendMode Mode>
+void blendRow(quint32 *dst, const quint32 *src, int count, int opacity) {
+    for (int i = 0; i < count; ++i)
+        dst[i] = blendPixel<Mode>(dst[i], src[i], opacity);
+}
+#endif
+
+} // namespace
+
+void Blend::row(BlendMode mode, quint32 *dst, const quint32 *src, int count, int opacity) {
+    if (opacity <= 0)
+        return;
+    switch (mode) {
+    case BlendMode::Normal:   blendRow<BlendMode::Normal>(dst, src, count, opacity); break;
+    case BlendMode::Multiply: blendRow<BlendMode::Multiply>(dst, src, count, opacity); break;
+    case BlendMode::Screen:   blendRow<BlendMode::Screen>(dst, src, count, opacity); break;
+    case BlendMode::Overlay:  blendRow<BlendMode::Overlay>(dst, src, count, opacity); break;
+    }
+}
+
+void Blend::fill(BlendMode mode, quint32 *dst, quint32 src, int count, int opacity) {
+    if (src == 0 || opacity <= 0)
+        return;
+
+    // Em blocos, reaproveitando o kernel de linha
+    quint32 chunk[128];
+    std::fill(chunk, chunk + 128, src);
+    for (int i = 0; i < count; i += 128)
+        row(mode, dst + i, chunk, std::min(128, count - i), opacity);
+}
+
+quint32 Blend::pixel(BlendMode mode, quint32 dst, quint32 src, int opacity) {
+    if (opacity <= 0)
+        return dst;
+    switch (mode) {
+    case BlendMode::Normal:   return blendPixel<BlendMode::Normal>(dst, src, opacity);
+    case BlendMode::Multiply: return blendPixel<BlendMode::Multiply>(dst, src, opacity);
+    case BlendMode::Screen:   return blendPixel<BlendMode::Screen>(dst, src, opacity);
+    case BlendMode::Overlay:  return blendPixel<BlendMode::Overlay>(dst, src, opacity);
+    }
+    return dst;
+}
+
+QString Blend::name(BlendMode mode) {
+    switch (mode) {
+    case BlendMode::Normal:   return "Normal";
+    case BlendMode::Multiply: return "Multiply";
+    case BlendMode::Screen:   return "Screen";
+    case BlendMode::Overlay:  return "Overlay";
+    }
+    return QString();
+}
+
+bool Blend::fromName(const QString &name, BlendMode &mode) {
+    for (BlendMode m : {BlendMode::Normal, BlendMode::Multiply, BlendMode::Screen, BlendMode::Overlay}) {
+        if (name.compare(Blend::name(m), Qt::CaseInsensitive) == 0) {
+            mode = m;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,25 @@
+#ifndef BLEND_H
+#define BLEND_H
+
+#include <QString>
+#include <QtGlobal>
+
+enum class BlendMode : quint8 { Normal, Multiply, Screen, Overlay };
+
+// Modos de mistura de camadas sobre pixels pré-multiplicados (o destino
+// também pode ser RGB32, que é o mesmo com alpha 255). Fórmulas separáveis
+// do W3C Compositing; a opacidade (0-255) multiplica a fonte antes.
+// Com SSE2 as linhas são misturadas quatro pixels por vez em 16 bits por
+// canal; sem ele fica a versão escalar, com o mesmo arredondamento.
+class Blend {
+public:
+    static void row(BlendMode mode, quint32 *dst, const quint32 *src, int count, int opacity);
+    // Fonte de uma cor só (tile uniforme)
+    static void fill(BlendMode mode, quint32 *dst, quint32 src, int count, int opacity);
+    static quint32 pixel(BlendMode mode, quint32 dst, quint32 src, int opacity);
+
+    static QString name(BlendMode mode);
+    static bool fromName(const QString &name, BlendMode &mode);
+};
+
+#endif // BLEND_H
@@ -1,79 +1,126 @@
 #include "canvaswidget.h"
+#include "projectfile.h"
 #include <QPainter>
 #include <QMouseEvent>
+#include <QPaintEvent>
 #include <QPainterPath>
 #include <QInputDialog>
 #include <QLineEdit>
-#include <QQueue>
-#include <QTransform>
 #include <QFileInfo>
+#include <QElapsedTimer>
+#include <QSizeF>
+#include <QtMath>
+#include "profiler.h"
 
+namespace {
+
+// Limites do zoom: 3% ainda cabe numa tela com o canvas inteiro e 32x é o
+// último passo inteiro do zoomIn
+const float MinZoom = 1.0f / 32;
+const float MaxZoom = 32.0f;
+
+// Maior zoom em que a widget ampliada ainda cabe em QWIDGETSIZE_MAX; acima
+// disso o Qt corta o tamanho e as conversões de coordenadas deixam de bater
+float maxZoomFor(const QSize &imageSize) {
+    const int side = qMax(1, qMax(imageSize.width(), imageSize.height()));
+    return qMin(MaxZoom, float(QWIDGETSIZE_MAX / side));
+}
+
+} // namespace
 
 CanvasWidget::CanvasWidget(QWidget *parent)
     : QWidget(parent),
       zoomFactor(1.0f),
       isDrawing(false),
-      previewActive(false),
-      selectionActive(false)
+      previewActive(false)
 {
     setAttribute(Qt::WA_StaticContents);
     setMouseTracking(true);
 
-    drawingLayer = QImage(800, 600, QImage::Format_ARGB32);
-    drawingLayer.fill(Qt::transparent);
-
-    canvasImage = QImage(800, 600, QImage::Format_ARGB32);
-    canvasImage.fill(Qt::transparent);
+    connect(&imageLoader, &ImageLoader::previewReady, this, &CanvasWidget::showLoadingPreview);
+    connect(&imageLoader, &ImageLoader::loaded, this, &CanvasWidget::finishLoading);
+    connect(&imageExporter, &ImageExporter::progress, this, &CanvasWidget::exportProgress);
+    connect(&imageExporter, &ImageExporter::finished, this, &CanvasWidget::exportFinished);
+    connect(&imageLoader, &ImageLoader::failed, this, [this](const QString &path, const QString &error) {
+        loadingPreview = QImage();
+        loadingSize = QSize();
+        update();
+        emit openFailed(path, error);
+    });
 
-    selectionImage = QImage(1, 1, QImage::Format_ARGB32);  // ✅ inicialização segura
-    selectionImage.fill(Qt::transparent);
+    // O checkpoint só compara referências de tiles; a gravação é no worker
+    connect(&autosaveTimer, &QTimer::timeout, this, [this]() {
+        if (!loadingSize.isValid())
+            recoveryJournal.checkpoint(doc.layerStack(), doc.backgroundColor());
+    });
+    autosaveTimer.start(AutosaveInterval);
 
-    setMinimumSize(canvasImage.size());
-    undoStack.push(canvasImage);
-    
-    canvasImage = QImage(this->size(), QImage::Format_ARGB32);
-    canvasImage.fill(Qt::transparent);  // base transparente
+    connect(&hudTimer, &QTimer::timeout, this, &CanvasWidget::updateHud);
 
-    backgroundLayer = QImage(this->size(), QImage::Format_RGB32);
-    backgroundLayer.fill(backgroundColor);  // fundo visível
+    historyTimer.setSingleShot(true);
+    historyTimer.setInterval(HistoryInterval);
+    connect(&historyTimer, &QTimer::timeout, this, &CanvasWidget::updateHistory);
+    connect(&historyThumbnails, &ThumbnailCache::ready, this, &CanvasWidget::historyThumbnailReady);
+    connect(&historyThumbnails, &ThumbnailCache::evicted, this, &CanvasWidget::historyThumbnailEvicted);
 
+    resizeToImage(doc.size());
 }
 
 void CanvasWidget::zoomIn() {
-    zoomFactor *= 1.2f;
-    updateGeometry();
-    update();
+    // A partir de 200% só fatores inteiros: é onde o desenho usa o vizinho
+    // mais próximo direto, sem transformar
+    float next = zoomFactor * 1.2f;
+    if (next >= 2.0f)
+        next = qMax(qFloor(zoomFactor) + 1, qRound(next));
+    setZoomFactor(next);
 }
 
 void CanvasWidget::zoomOut() {
-    zoomFactor /= 1.2f;
-    updateGeometry();
+    float next = zoomFactor / 1.2f;
+    if (zoomFactor > 2.0f)
+        next = qMin(qCeil(zoomFactor) - 1, qRound(next));
+    setZoomFactor(next);
+}
+
+void CanvasWidget::setZoomFactor(double factor) {
+    if (factor <= 0.0) return;
+    zoomFactor = qBound(MinZoom, float(factor), qMax(MinZoom, maxZoomFor(doc.size())));
+    recorder.zoom(zoomFactor);
+    resizeToImage(doc.size());
     update();
 }
 
+int CanvasWidget::integerZoom() const {
+    const int factor = qRound(zoomFactor);
+    return factor >= 1 && qAbs(zoomFactor - factor) < 1e-4f ? factor : 0;
+}
+
+void CanvasWidget::resizeToImage(const QSize &imageSize) {
+    // A widget tem o tamanho da imagem ampliada; o QScrollArea mostra só um
+    // pedaço dela e o paintEvent só desenha esse pedaço. Uma imagem nova
+    // maior pode baixar o zoom para a widget caber
+    zoomFactor = qMin(zoomFactor, qMax(MinZoom, maxZoomFor(imageSize)));
+    const QSize zoomed = QSizeF(imageSize * zoomFactor).toSize().expandedTo(QSize(1, 1));
+    setMinimumSize(zoomed);
+    resize(zoomed);
+}
+
 void CanvasWidget::fitToScreen() {
-    if (canvasImage.isNull()) return;
+    if (doc.canvas().isNull()) return;
     QSize areaSize = size();
     if (parentWidget())  // ✅ proteção contra nullptr
         areaSize = parentWidget()->size();
 
-    float scaleX = static_cast<float>(areaSize.width()) / canvasImage.width();
-    float scaleY = static_cast<float>(areaSize.height()) / canvasImage.height();
-    zoomFactor = qMin(scaleX, scaleY);
-    updateGeometry();
-    update();
+    float scaleX = static_cast<float>(areaSize.width()) / doc.size().width();
+    float scaleY = static_cast<float>(areaSize.height()) / doc.size().height();
+    setZoomFactor(qMin(scaleX, scaleY));
 }
 
 void CanvasWidget::resizeCanvas(int width, int height) {
-    QImage newImage(width, height, QImage::Format_ARGB32);
-    newImage.fill(Qt::white);
-    QPainter painter(&newImage);
-    painter.drawImage(0, 0, canvasImage);
-    canvasImage = newImage;
-    setMinimumSize(canvasImage.size());
-
-    undoStack.push(canvasImage);
-    update();
+    recorder.command(InputRecorder::Command::Resize, width, height);
+    doc.resize(width, height);
+    resizeToImage(doc.size());
+    refresh();
 }
 
 void CanvasWidget::toggleGrid() {
@@ -81,6 +128,16 @@ void CanvasWidget::toggleGrid() {
     update();
 }
 
+int CanvasWidget::gridSpacing() const {
+    return grid.spacing();
+}
+
+void CanvasWidget::setGridSpacing(int pixels) {
+    grid.setSpacing(pixels);
+    if (showGrid)
+        update();
+}
+
 Tool CanvasWidget::activeTool() const {
     return tool;
 }
@@ -91,28 +148,41 @@ Tool CanvasWidget::getTool() const {
 
 void CanvasWidget::setActiveTool(const Tool &newTool) {
     tool = newTool;
+    recorder.tool(tool);
 }
 
 void CanvasWidget::setColor(const QColor &color) {
     tool.setOutlineColor(color);
+    recorder.tool(tool);
 }
 
 void CanvasWidget::setThickness(int value) {
     tool.setThickness(value);
+    recorder.tool(tool);
+}
+
+void CanvasWidget::setHistoryMemoryBudget(int megabytes) {
+    doc.setHistoryMemoryBudget(qint64(megabytes) * 1024 * 1024);
 }
 void CanvasWidget::mousePressEvent(QMouseEvent *event) {
+    recorder.mouse(InputRecorder::Kind::Press, event->localPos(), event->button(), event->buttons());
+    if (inputPendingSince < 0 && Profiler::isEnabled())
+        inputPendingSince = Profiler::now();
+    const bool hasQueuedText = textQueued;
+    const QString queued = queuedText;
+    textQueued = false;
+    queuedText.clear();
+    if (imageLoader.isLoading()) return;  // ✅ nada de editar a imagem que vai ser trocada
     lastPoint = event->pos() / zoomFactor;
 
     if (tool.type() == ToolType::Eyedropper) {
         QPoint pos = event->pos() / zoomFactor;
-        if (canvasImage.rect().contains(pos)) {
-            QColor pickedColor = canvasImage.pixelColor(pos);
-            if (pickedColor.isValid()) {
-                if (event->button() == Qt::LeftButton) {
-                    emit outlineColorPicked(pickedColor);
-                } else if (event->button() == Qt::RightButton) {
-                    emit fillColorPicked(pickedColor);
-                }
+        QColor pickedColor = doc.pixelColor(pos);
+        if (pickedColor.isValid()) {
+            if (event->button() == Qt::LeftButton) {
+                emit outlineColorPicked(pickedColor);
+            } else if (event->button() == Qt::RightButton) {
+                emit fillColorPicked(pickedColor);
             }
         }
         return;
@@ -126,47 +196,35 @@ void CanvasWidget::mousePressEvent(QMouseEvent *event) {
 
     if (tool.type() == ToolType::Bucket) {
         QPoint seed = event->pos() / zoomFactor;
-        if (!canvasImage.rect().contains(seed)) return;
-
-        QColor targetColor = canvasImage.pixelColor(seed);
-        if (!targetColor.isValid() || targetColor == tool.outlineColor()) return;  // ✅ proteção extra
-
-        QQueue<QPoint> queue;
-        queue.enqueue(seed);
+        QRect filled = doc.bucketFill(seed, tool);
+        if (filled.isEmpty()) return;  // ✅ fora da imagem ou a cor já era a mesma
 
-        while (!queue.isEmpty()) {
-            QPoint p = queue.dequeue();
-            if (!canvasImage.rect().contains(p)) continue;
-            if (canvasImage.pixelColor(p) != targetColor) continue;
-
-            canvasImage.setPixelColor(p, tool.outlineColor());
-
-            queue.enqueue(QPoint(p.x() + 1, p.y()));
-            queue.enqueue(QPoint(p.x() - 1, p.y()));
-            queue.enqueue(QPoint(p.x(), p.y() + 1));
-            queue.enqueue(QPoint(p.x(), p.y() - 1));
-        }
-
-        undoStack.push(canvasImage);
-        update();
+        refresh(filled);
         return;
     }
 
     if (tool.type() == ToolType::Text) {
         QPoint pos = event->pos() / zoomFactor;
-        bool ok;
-        QString text = QInputDialog::getText(this, tr("Insert Text"),
-                                             tr("Text:"), QLineEdit::Normal,
-                                             "", &ok);
-        if (ok && !text.isEmpty()) {
-            QPainter painter(&canvasImage);
-            painter.setPen(QPen(tool.outlineColor(), tool.thickness()));
-            painter.setFont(tool.font());
-            painter.drawText(pos, text);
-
-            undoStack.push(canvasImage);
-            update();
+        QString text = queued;
+        bool ok = !text.isEmpty();
+        if (!hasQueuedText) {
+            text = QInputDialog::getText(this, tr("Insert Text"),
+                                         tr("Text:"), QLineEdit::Normal,
+                                         "", &ok);
         }
+        if (!ok)
+            text.clear();
+
+        // Cancelado vai como texto vazio: o replay não abre o diálogo
+        recorder.text(text);
+        if (!text.isEmpty())
+            refresh(doc.drawText(pos, text, tool));
+        return;
+    }
+
+    // Lápis e pincel: o traço é carimbado no próximo paintEvent
+    if (StrokeEngine::handles(tool.type())) {
+        update(imageToWidget(doc.beginStroke(tool, event->localPos() / zoomFactor)));
         return;
     }
 
@@ -175,112 +233,194 @@ void CanvasWidget::mousePressEvent(QMouseEvent *event) {
     previewEnd = lastPoint;
     previewActive = true;
 
-    if (tool.type() == ToolType::Select) {
-        selectionRect.setTopLeft(lastPoint);
-        selectionRect.setBottomRight(lastPoint);
-        selectionActive = true;
-    }
+    if (tool.type() == ToolType::Select)
+        doc.setSelectionRect(QRect(lastPoint, lastPoint));
 
     update();
 }
 
 void CanvasWidget::mouseMoveEvent(QMouseEvent *event) {
+    recorder.mouse(InputRecorder::Kind::Move, event->localPos(), event->button(), event->buttons());
+    if (inputPendingSince < 0 && Profiler::isEnabled() && isDrawing)
+        inputPendingSince = Profiler::now();
     if (!isDrawing) return;
 
     QPoint currentPoint = event->pos() / zoomFactor;
 
-    if (tool.type() == ToolType::Select && selectionActive) {
-        selectionRect.setBottomRight(currentPoint);
-    } else if (tool.type() == ToolType::Pencil || tool.type() == ToolType::Brush ||
-               tool.type() == ToolType::Spray || tool.type() == ToolType::Eraser) {
-        QPainter painter(&canvasImage);
-        painter.setRenderHint(QPainter::Antialiasing);
-        tool.apply(painter, lastPoint, currentPoint);
+    if (tool.type() == ToolType::Select && doc.hasSelection()) {
+        QRect before = selectionBounds();
+        QRect area = doc.selectionRect();
+        area.setBottomRight(currentPoint);
+        doc.setSelectionRect(area);
+        update(imageToWidget(before.united(selectionBounds())));
+    } else if (doc.isStroking()) {
+        // Só enfileira: vários eventos no mesmo quadro viram um único flush
+        update(imageToWidget(doc.addStrokePoint(event->localPos() / zoomFactor)));
+    } else if (tool.type() == ToolType::Spray) {
+        QRect dirty = doc.spray(currentPoint, tool);
         lastPoint = currentPoint;
-        update();  // garante que o traço apareça imediatamente
+        refresh(dirty);
+    } else if (tool.type() == ToolType::Eraser) {
+        QRect dirty = doc.erase(lastPoint, currentPoint, tool);
+        lastPoint = currentPoint;
+        refresh(dirty);  // redesenha só o trecho do traço
     } else {
+        QRect before = previewBounds();
         previewEnd = currentPoint;
-        update();  // atualiza preview de formas geométricas
+        update(imageToWidget(before.united(previewBounds())));  // atualiza preview de formas geométricas
     }
 }
 
 void CanvasWidget::mouseReleaseEvent(QMouseEvent *event) {
+    recorder.mouse(InputRecorder::Kind::Release, event->localPos(), event->button(), event->buttons());
+    if (inputPendingSince < 0 && Profiler::isEnabled())
+        inputPendingSince = Profiler::now();
     if (event->button() != Qt::LeftButton || !isDrawing) return;
     isDrawing = false;
     QPoint endPoint = event->pos() / zoomFactor;
 
     if (tool.type() == ToolType::Select) {
-        selectionRect.setBottomRight(endPoint);
-        selectionActive = true;
+        QRect area = doc.selectionRect();
+        area.setBottomRight(endPoint);
+        doc.setSelectionRect(area);
 
         // ✅ proteção contra seleção nula
-        if (selectionRect.isNull()) {
-            selectionActive = false;
-            selectionImage = QImage();
-        }
+        if (area.isNull())
+            doc.clearSelection();
+} else if (doc.isStroking()) {
+    doc.addStrokePoint(event->localPos() / zoomFactor);
+    refresh(doc.endStroke());
+    return;
+} else if (tool.type() == ToolType::Spray || tool.type() == ToolType::Eraser) {
+    doc.commit();  // o arrasto inteiro vira um passo do histórico
+    historyTimer.start();
+    return;
 } else if (tool.type() != ToolType::Pencil &&
-           tool.type() != ToolType::Brush &&
-           tool.type() != ToolType::Spray &&
-           tool.type() != ToolType::Eraser) {
-    QPainter painter(&canvasImage);
-    painter.setRenderHint(QPainter::Antialiasing);
-    tool.apply(painter, previewStart, endPoint);
+           tool.type() != ToolType::Brush) {
+    QRect dirty = previewBounds() | doc.drawShape(previewStart, endPoint, tool);
     previewActive = false;
 
-    undoStack.push(canvasImage);
+    refresh(dirty);
+    return;
 }
 
     update();
 }
 void CanvasWidget::paintEvent(QPaintEvent *event) {
-    QPainter painter(this);
-    painter.scale(zoomFactor, zoomFactor);
-    
+    PROFILE_SCOPE("paint");
+    QElapsedTimer frameTimer;
+    frameTimer.start();
 
-    // Fundo visível
-    if (useBackgroundImage) {
-    painter.drawImage(0, 0, backgroundLayer);
-}   else {
-    painter.fillRect(rect(), backgroundColor);
-}
+    // Carimba os pontos do traço acumulados desde o último quadro
+    mipmap.invalidate(doc.flushStroke());
 
-    // Conteúdo desenhado
-    painter.drawImage(0, 0, canvasImage);
+    QPainter painter(this);
+    painter.scale(zoomFactor, zoomFactor);
 
+    // Imagem ainda carregando: só o fundo e a prévia esticada no tamanho final
+    if (loadingSize.isValid()) {
+        painter.fillRect(widgetToImage(event->rect()), doc.backgroundColor());
+        if (!loadingPreview.isNull()) {
+            painter.setRenderHint(QPainter::SmoothPixmapTransform);
+            painter.drawImage(QRect(QPoint(0, 0), loadingSize), loadingPreview);
+        }
+        return;
+    }
 
-    // Desenha as camadas
-    painter.drawImage(0, 0, drawingLayer);
+    // Só a parte suja que aparece no viewport do QScrollArea: com zoom
+    // alto a widget é enorme, mas nada fora da janela é rasterizado
+    QRect visible = event->rect();
+    if (isVisible())
+        visible &= visibleRegion().boundingRect();
+    if (visible.isEmpty())
+        return;
+    const QRect dirty = widgetToImage(visible);
+    const QRect source = dirty.intersected(doc.rect());
+
+    // Fora da imagem só aparece a cor de fundo
+    if (!source.contains(dirty))
+        painter.fillRect(dirty, doc.backgroundColor());
+
+    // Fundo, conteúdo e camadas já compostos; com zoom reduzido desenha
+    // a partir do nível da pirâmide mais próximo em vez da imagem inteira
+    const int lod = mipmap.levelForZoom(doc.size(), zoomFactor);
+    if (!source.isEmpty() && lod > 0) {
+        const int scale = 1 << lod;
+        const QRect levelRect(QPoint(source.left() >> lod, source.top() >> lod),
+                              QPoint(source.right() >> lod, source.bottom() >> lod));
+        const TiledImage &base = doc.composite(MipmapPyramid::baseArea(lod, levelRect));
+        const TiledImage &level = mipmap.level(lod, levelRect, base);
+
+        painter.save();
+        painter.scale(scale, scale);
+        painter.setRenderHint(QPainter::SmoothPixmapTransform);
+        level.render(painter, levelRect);
+        painter.restore();
+    } else if (!source.isEmpty() && integerZoom() > 1) {
+        // Zoom inteiro: vizinho mais próximo ampliado direto nos pixels da
+        // tela, sem o QPainter transformar cada tile
+        const int factor = integerZoom();
+        const TiledImage &image = doc.composite(source);
+        painter.save();
+        painter.resetTransform();
+        image.renderScaled(painter, visible.intersected(QRect(QPoint(0, 0), doc.size() * factor)), factor);
+        painter.restore();
+    } else if (!source.isEmpty()) {
+        doc.composite(source).render(painter, source);
+    }
 
     // Desenha seleção se ativa
-    if (selectionActive && !selectionImage.isNull() && !selectionRect.isNull()) {
-        painter.drawImage(selectionRect.topLeft(), selectionImage);
+    const QRect selectionRect = doc.selectionRect();
+    if (doc.hasSelection() && !doc.selectionImage().isNull() && !selectionRect.isNull()
+        && selectionBounds().intersects(dirty)) {
+        painter.drawImage(selectionRect.topLeft(), doc.selectionImage());
         painter.setPen(QPen(Qt::blue, 1, Qt::DashLine));
         painter.drawRect(selectionRect);
     }
 
-    // Desenha grade se ativada
+    // Desenha grade se ativada: o padrão em cache só sobre a área visível suja
     if (showGrid) {
-        painter.setPen(QPen(Qt::lightGray, 1, Qt::DotLine));
-        int step = 20 * zoomFactor;
-        for (int x = 0; x < width(); x += step)
-            painter.drawLine(x, 0, x, height());
-        for (int y = 0; y < height(); y += step)
-            painter.drawLine(0, y, width(), y);
-    }
-
-    // Desenha histórico visual
-    int x = 10;
-    int y = height() / zoomFactor - 85;
-    for (const QImage &thumb : historyThumbnails) {
-        painter.drawImage(x, y, thumb);
-        x += 110;
+        painter.save();
+        painter.resetTransform();
+        grid.draw(painter, visible, zoomFactor);
+        painter.restore();
     }
 
     // Desenha pré-visualização da forma
     if (previewActive && isDrawing) {
         drawPreviewShape(painter);
     }
-    
+
+    // Do primeiro evento ainda não desenhado até os pixels dele estarem na tela
+    if (inputPendingSince >= 0) {
+        Profiler::record("input-to-pixel", inputPendingSince, Profiler::now() - inputPendingSince);
+        inputPendingSince = -1;
+    }
+
+    emit frameDrawn(frameTimer.nsecsElapsed());
+}
+
+QRect CanvasWidget::imageToWidget(const QRect &rect) const {
+    return QRectF(rect.x() * zoomFactor, rect.y() * zoomFactor,
+                  rect.width() * zoomFactor, rect.height() * zoomFactor)
+        .toAlignedRect().adjusted(-1, -1, 1, 1);
+}
+
+QRect CanvasWidget::widgetToImage(const QRect &rect) const {
+    return QRectF(rect.x() / zoomFactor, rect.y() / zoomFactor,
+                  rect.width() / zoomFactor, rect.height() / zoomFactor)
+        .toAlignedRect().adjusted(-1, -1, 1, 1);
+}
+
+QRect CanvasWidget::previewBounds() const {
+    return tool.bounds(previewStart, previewEnd);
+}
+
+QRect CanvasWidget::selectionBounds() const {
+    QRect area = doc.selectionRect().normalized();
+    if (doc.hasSelection() && !doc.selectionImage().isNull())
+        area |= QRect(doc.selectionRect().topLeft(), doc.selectionImage().size());
+    return area.adjusted(-2, -2, 2, 2);
 }
 
 void CanvasWidget::drawPreviewShape(QPainter &painter) {
@@ -326,172 +466,384 @@ void CanvasWidget::drawPreviewShape(QPainter &painter) {
     }
 }
 void CanvasWidget::clearCanvas() {
-    canvasImage.fill(Qt::transparent);
-    undoStack.push(canvasImage);
-    update();
+    recorder.command(InputRecorder::Command::Clear);
+    doc.clear();
+    refresh();
 }
 
 void CanvasWidget::undo() {
-    if (undoStack.canUndo()) {
-        canvasImage = undoStack.undo();
-        update();
-        historyThumbnails.append(canvasImage.scaled(100, 75, Qt::KeepAspectRatio));
+    recorder.command(InputRecorder::Command::Undo);
+    abandonDrag();
+    if (doc.undo()) {
+        refresh();
+        emit layersChanged();
     }
 }
 
 void CanvasWidget::redo() {
-    if (undoStack.canRedo()) {
-        canvasImage = undoStack.redo();
-        update();
-        historyThumbnails.append(canvasImage.scaled(100, 75, Qt::KeepAspectRatio));
+    recorder.command(InputRecorder::Command::Redo);
+    abandonDrag();
+    if (doc.redo()) {
+        refresh();
+        emit layersChanged();
     }
 }
 
-void CanvasWidget::openImage(const QString &path) {
-    QImage loaded(path);
-    if (!loaded.isNull()) {
-        canvasImage = loaded.convertToFormat(QImage::Format_ARGB32);
-        setMinimumSize(canvasImage.size());
-        undoStack.push(canvasImage);
-        update();
+void CanvasWidget::jumpToHistory(int node) {
+    recorder.command(InputRecorder::Command::JumpHistory, node);
+    abandonDrag();
+    if (doc.jumpToHistory(node)) {
+        refresh();
+        emit layersChanged();
     }
 }
 
-void CanvasWidget::saveImage(const QString &path) {
-        
-    QString format = QFileInfo(path).suffix().toLower();
-    QImage imageToSave;
+void CanvasWidget::abandonDrag() {
+    // O Document fecha o traço de lápis/pincel; prévias de forma são descartadas
+    if (previewActive)
+        update(imageToWidget(previewBounds()));
+    isDrawing = false;
+    previewActive = false;
+}
 
-    if (format == "png" && exportWithTransparency) {
-    imageToSave = canvasImage;
-    } else {
-    imageToSave = composedImage();
+void CanvasWidget::openImage(const QString &path) {
+    if (QFileInfo(path).suffix().toLower() == "lpaint") {
+        openProject(path);
+        return;
     }
 
-    imageToSave.save(path, format.toUpper().toUtf8().constData());
-    QPainter painter(&imageToSave);
+    // Decodifica no worker; a interface segue respondendo
+    imageLoader.load(path);
+}
 
-    if (useBackgroundImage) {
-        painter.drawImage(0, 0, backgroundLayer);
-    } else {
-        painter.fillRect(imageToSave.rect(), backgroundColor);
+void CanvasWidget::saveProject(const QString &path, bool includeHistory) {
+    imageExporter.startProject(doc.contents(includeHistory), path);
+}
+
+bool CanvasWidget::openProject(const QString &path) {
+    // Só lê as tabelas: os tiles são descomprimidos quando aparecem na tela
+    ProjectFile::Contents contents;
+    QString error;
+    if (!ProjectFile::load(path, contents, &error)) {
+        emit openFailed(path, error);
+        return false;
     }
 
-    painter.drawImage(0, 0, canvasImage);
+    imageLoader.cancel();
+    loadingPreview = QImage();
+    loadingSize = QSize();
+
+    doc.setContents(contents);
+    resetHistory();
+
+    resizeToImage(doc.size());
+    refresh();
+    emit layersChanged();
+    return true;
 }
 
+bool CanvasWidget::recover(const QString &journalPath) {
+    if (!doc.recover(journalPath))
+        return false;
 
-bool CanvasWidget::exportImage(const QString &path, const char *format) {
-    QImage imageToSave;
+    resetHistory();
+    resizeToImage(doc.size());
+    refresh();
+    emit layersChanged();
+    return true;
+}
 
-if (QString(format).toLower() == "png" && exportWithTransparency) {
-    imageToSave = canvasImage;
-} else {
-    imageToSave = composedImage();
+void CanvasWidget::waitForExports() {
+    imageExporter.waitForDone();
 }
 
-return imageToSave.save(path, format);
+void CanvasWidget::discardRecovery() {
+    autosaveTimer.stop();
+    recoveryJournal.discard();
+}
 
+void CanvasWidget::showLoadingPreview(const QImage &preview, const QSize &fullSize) {
+    loadingPreview = preview;
+    loadingSize = fullSize;
+    resizeToImage(fullSize);
+    update();
 }
 
+void CanvasWidget::finishLoading(const TiledImage &image) {
+    loadingPreview = QImage();
+    loadingSize = QSize();
 
-// Seleção
-void CanvasWidget::copySelection() {
-    if (!selectionActive || selectionRect.isNull()) return;
-    selectionImage = canvasImage.copy(selectionRect);
+    doc.setImage(image);
+    resizeToImage(doc.size());
+    refresh();
+    emit layersChanged();
 }
 
-void CanvasWidget::cutSelection() {
-    if (!selectionActive || selectionRect.isNull()) return;
-    selectionImage = canvasImage.copy(selectionRect);
+void CanvasWidget::saveImage(const QString &path) {
+    QString format = QFileInfo(path).suffix().toLower();
+    exportImage(path, format.toUtf8().constData());
+}
 
-    QPainter painter(&canvasImage);
-    painter.setCompositionMode(QPainter::CompositionMode_Source);
-    painter.fillRect(selectionRect, Qt::transparent);
 
-    undoStack.push(canvasImage);
-    update();
+bool CanvasWidget::exportImage(const QString &path, const char *format) {
+    // Cópia rasa: o worker lê os tiles enquanto a edição continua
+    const TiledImage snapshot = doc.exportSnapshot(QByteArray(format));
+    if (snapshot.isNull())
+        return false;
+
+    imageExporter.start(snapshot, path, QByteArray(format));
+    return true;
 }
 
-void CanvasWidget::pasteSelection() {
-    if (selectionImage.isNull()) return;
 
-    QPoint pastePos = selectionRect.topLeft();  // ou mousePos
-    QPainter painter(&canvasImage);
-    painter.drawImage(pastePos, selectionImage);
+// Seleção
+void CanvasWidget::copySelection() {
+    recorder.command(InputRecorder::Command::Copy);
+    doc.copySelection();
+}
 
-    undoStack.push(canvasImage);
-    update();
+void CanvasWidget::cutSelection() {
+    recorder.command(InputRecorder::Command::Cut);
+    refresh(doc.cutSelection());
+}
+
+void CanvasWidget::pasteSelection() {
+    recorder.command(InputRecorder::Command::Paste);
+    refresh(doc.pasteSelection());
 }
 
 void CanvasWidget::applySelection() {
-    selectionActive = false;
-    selectionRect = QRect();
-    selectionImage = QImage(1, 1, QImage::Format_ARGB32);  // ✅ reinicialização segura
-    selectionImage.fill(Qt::transparent);
+    recorder.command(InputRecorder::Command::Apply);
+    doc.applySelection();
     update();
-    historyThumbnails.append(canvasImage.scaled(100, 75, Qt::KeepAspectRatio));
+    historyTimer.start();
 }
 
 void CanvasWidget::flipSelectionHorizontal() {
-    if (selectionImage.isNull()) return;
-    selectionImage = selectionImage.mirrored(true, false);
+    recorder.command(InputRecorder::Command::FlipHorizontal);
+    doc.flipSelection(true, false);
     update();
 }
 
 void CanvasWidget::flipSelectionVertical() {
-    if (selectionImage.isNull()) return;
-    selectionImage = selectionImage.mirrored(false, true);
+    recorder.command(InputRecorder::Command::FlipVertical);
+    doc.flipSelection(false, true);
     update();
 }
 
 void CanvasWidget::rotateSelection(int angle) {
-    if (selectionImage.isNull()) return;
-
-    QTransform transform;
-    transform.rotate(angle);
-    selectionImage = selectionImage.transformed(transform, Qt::SmoothTransformation);
+    recorder.command(InputRecorder::Command::Rotate, angle);
+    doc.rotateSelection(angle);
     update();
 }
 void CanvasWidget::setOutlineColor(const QColor &color) {
     tool.setOutlineColor(color);
+    recorder.tool(tool);
 }
 
 void CanvasWidget::setFillColor(const QColor &color) {
     tool.setFillColor(color);
+    recorder.tool(tool);
+}
+
+bool CanvasWidget::startRecording(const QString &path) {
+    if (!recorder.start(path))
+        return false;
+    // Estado inicial: a ferramenta e o zoom valem desde o primeiro evento
+    recorder.tool(tool);
+    recorder.zoom(zoomFactor);
+    return true;
+}
+
+void CanvasWidget::stopRecording() {
+    recorder.stop();
+}
+
+int CanvasWidget::layerCount() const {
+    return doc.layerCount();
+}
+
+const Layer &CanvasWidget::layer(int index) const {
+    return doc.layer(index);
+}
+
+int CanvasWidget::activeLayer() const {
+    return doc.activeLayer();
+}
+
+void CanvasWidget::setActiveLayer(int index) {
+    if (index == doc.activeLayer())
+        return;
+    recorder.command(InputRecorder::Command::SelectLayer, index);
+    doc.setActiveLayer(index);
+    emit layersChanged();
+}
+
+void CanvasWidget::addLayer() {
+    recorder.command(InputRecorder::Command::AddLayer);
+    refresh(doc.addLayer());
+    emit layersChanged();
+}
+
+void CanvasWidget::removeLayer(int index) {
+    recorder.command(InputRecorder::Command::RemoveLayer, index);
+    refresh(doc.removeLayer(index));
+    emit layersChanged();
+}
+
+void CanvasWidget::moveLayer(int from, int to) {
+    recorder.command(InputRecorder::Command::MoveLayer, from, to);
+    refresh(doc.moveLayer(from, to));
+    emit layersChanged();
+}
+
+void CanvasWidget::renameLayer(int index, const QString &name) {
+    doc.setLayerName(index, name);
+    emit layersChanged();
+}
+
+void CanvasWidget::setLayerOpacity(int index, int percent) {
+    recorder.command(InputRecorder::Command::LayerOpacity, index, percent);
+    refresh(doc.setLayerOpacity(index, percent / 100.0));
+    emit layersChanged();
+}
+
+void CanvasWidget::setLayerVisible(int index, bool visible) {
+    recorder.command(InputRecorder::Command::LayerVisible, index, visible);
+    refresh(doc.setLayerVisible(index, visible));
+    emit layersChanged();
+}
+
+void CanvasWidget::setLayerBlendMode(int index, BlendMode mode) {
+    recorder.command(InputRecorder::Command::LayerMode, index, int(mode));
+    refresh(doc.setLayerBlendMode(index, mode));
+    emit layersChanged();
+}
+
+bool CanvasWidget::isRecording() const {
+    return recorder.isRecording();
+}
+
+void CanvasWidget::queueText(const QString &text) {
+    queuedText = text;
+    textQueued = true;
 }
 void CanvasWidget::setBackgroundColor(const QColor &color) {
-    backgroundColor = color;
-    useBackgroundImage = false;
-    backgroundLayer.fill(color);
-    update();
+    doc.setBackgroundColor(color);
+    refresh();
 }
 
 void CanvasWidget::setBackgroundImage(const QImage &image) {
-    backgroundLayer = image.scaled(canvasImage.size());
-    useBackgroundImage = true;
-    update();
+    doc.setBackgroundImage(image);
+    refresh();
 }
 
 void CanvasWidget::clearBackgroundImage() {
-    useBackgroundImage = false;
-    backgroundLayer.fill(backgroundColor);
-    update();
+    doc.clearBackgroundImage();
+    refresh();
 }
 
 void CanvasWidget::setExportTransparency(bool enabled) {
-    exportWithTransparency = enabled;
+    doc.setExportTransparency(enabled);
 }
 QImage CanvasWidget::composedImage() const {
-    QImage result(canvasImage.size(), QImage::Format_RGB32);
-    QPainter painter(&result);
+    return doc.composite(doc.rect()).toImage();
+}
+
+void CanvasWidget::refresh() {
+    mipmap.invalidate(doc.rect());
+    update();
+    historyTimer.start();
+}
+
+void CanvasWidget::refresh(const QRect &dirty) {
+    mipmap.invalidate(dirty);
+    update(imageToWidget(dirty));
+    historyTimer.start();
+}
 
-    if (useBackgroundImage) {
-        painter.drawImage(0, 0, backgroundLayer);
+void CanvasWidget::updateHistory() {
+    // No meio de um arrasto o nó atual ainda não tem esses pixels
+    if (isDrawing || loadingSize.isValid()) {
+        historyTimer.start();
+        return;
+    }
+
+    const int node = doc.historyNode();
+    const int count = doc.historyNodeCount();
+    if (node == historyShownNode && count == historyShownCount)
+        return;
+    historyShownNode = node;
+    historyShownCount = count;
+
+    // O estado de um nó nunca muda: a miniatura só é feita uma vez
+    if (node >= 0 && !historyThumbnails.contains(node))
+        historyThumbnails.request(node, doc.layerStack());
+    emit historyChanged();
+}
+
+void CanvasWidget::resetHistory() {
+    historyThumbnails.clear();
+    historyShownNode = -1;
+    historyShownCount = 0;
+    emit historyCleared();
+}
+
+int CanvasWidget::historyNode() const {
+    return doc.historyNode();
+}
+
+int CanvasWidget::historyNodeCount() const {
+    return doc.historyNodeCount();
+}
+
+int CanvasWidget::historyParent(int node) const {
+    return doc.historyParent(node);
+}
+
+QImage CanvasWidget::historyThumbnail(int node) {
+    return historyThumbnails.thumbnail(node);
+}
+
+void CanvasWidget::setHudVisible(bool visible) {
+    hudVisible = visible;
+    if (visible) {
+        // Dentro do QScrollArea o pai é o viewport; sem ele, a própria widget
+        if (!hud)
+            hud = new HudOverlay(parentWidget() ? parentWidget() : this);
+        Profiler::setEnabled(true);
+        updateHud();
+        hud->show();
+        hud->raise();
+        hudTimer.start(HudInterval);
     } else {
-        painter.fillRect(result.rect(), backgroundColor);
+        hudTimer.stop();
+        inputPendingSince = -1;
+        if (hud)
+            hud->hide();
     }
+}
+
+bool CanvasWidget::isHudVisible() const {
+    return hudVisible;
+}
 
-    painter.drawImage(0, 0, canvasImage);
-    return result;
+void CanvasWidget::updateHud() {
+    static const QVector<const char *> names = {
+        "paint", "input-to-pixel", "stroke-flush", "tool-apply",
+        "bucket-fill", "composite", "mipmap", "undo-push",
+    };
+    const QVector<Profiler::Summary> summaries = Profiler::summaries(names);
+
+    QStringList hudLines;
+    for (int i = 0; i < names.size(); ++i) {
+        const Profiler::Summary &s = summaries[i];
+        // Quadro e latência sempre aparecem; o resto só quando foi medido
+        if (s.count == 0 && i > 1)
+            continue;
+        hudLines << QString("%1 p50 %2  p95 %3  max %4 ms")
+                        .arg(QString(names[i]), -15)
+                        .arg(s.p50, 0, 'f', 2).arg(s.p95, 0, 'f', 2).arg(s.max, 0, 'f', 2);
+    }
+    hud->setLines(hudLines);
 }
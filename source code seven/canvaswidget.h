@@ -8,8 +8,18 @@
 #include <QVector>
 #include <QString>
 #include <QColor>
+#include <QTimer>
 #include "tool.h"
-#include "UndoStack.h"
+#include "document.h"
+#include "mipmap.h"
+#include "gridoverlay.h"
+#include "hudoverlay.h"
+#include "thumbnailcache.h"
+#include "tiledimage.h"
+#include "imageloader.h"
+#include "imageexporter.h"
+#include "recoveryjournal.h"
+#include "inputrecorder.h"
 
 class CanvasWidget : public QWidget {
     Q_OBJECT  // Necessário para que sinais e slots funcionem
@@ -30,6 +40,8 @@ public:
     void resizeCanvas(int width, int height);
     void setZoomFactor(double factor);
     void toggleGrid();
+    int gridSpacing() const;
+    void setGridSpacing(int pixels);  // pixels da imagem por célula
 
     // Ferramenta ativa
     Tool activeTool() const;
@@ -39,18 +51,48 @@ public:
     Tool getTool() const;
     void setColor(const QColor &color);
     void setThickness(int value);
+    void setHistoryMemoryBudget(int megabytes);
     QImage composedImage() const;
 
     // Imagem
     void clearCanvas();
     void undo();
     void redo();
+    void jumpToHistory(int node);  // qualquer nó da árvore do histórico
+    int historyNode() const;
+    int historyNodeCount() const;
+    int historyParent(int node) const;
+    QImage historyThumbnail(int node);  // nula até o worker entregar
     void openImage(const QString &path);
+    // Gravação em segundo plano; o resultado chega em exportFinished
     void saveImage(const QString &path);
     bool exportImage(const QString &path, const char *format = "png");
+
+    // Projeto nativo (.lpaint): camadas, fundo e, opcionalmente, o histórico
+    void saveProject(const QString &path, bool includeHistory = true);
+    // Bloqueia até as gravações pendentes terminarem (exportFinished sai antes)
+    void waitForExports();
+    bool openProject(const QString &path);
+
+    // Recuperação depois de uma queda (diário do autosave)
+    bool recover(const QString &journalPath);
+    void discardRecovery();
     void setOutlineColor(const QColor &color);
     void setFillColor(const QColor &color);
 
+    // Camadas (índice 0 é a de baixo); as ferramentas desenham na ativa
+    int layerCount() const;
+    const Layer &layer(int index) const;
+    int activeLayer() const;
+    void setActiveLayer(int index);
+    void addLayer();
+    void removeLayer(int index);
+    void moveLayer(int from, int to);
+    void renameLayer(int index, const QString &name);
+    void setLayerOpacity(int index, int percent);
+    void setLayerVisible(int index, bool visible);
+    void setLayerBlendMode(int index, BlendMode mode);
+
     // Seleção
     void copySelection();
     void cutSelection();
@@ -60,10 +102,31 @@ public:
     void flipSelectionVertical();
     void rotateSelection(int angle);
 
+    // Gravação da entrada (mouse, ferramenta, zoom e comandos) para o InputReplayer
+    bool startRecording(const QString &path);
+    void stopRecording();
+    bool isRecording() const;
+    // Resposta do diálogo para o próximo clique (vazia: cancelado); o clique
+    // seguinte consome a resposta mesmo que não seja da ferramenta de texto
+    void queueText(const QString &text);
+
+    // HUD de desempenho: percentis do tempo de quadro e da latência do traço
+    void setHudVisible(bool visible);
+    bool isHudVisible() const;
+
 signals:
     void colorPicked(const QColor &color);
     void outlineColorPicked(const QColor &color);
     void fillColorPicked(const QColor &color);
+    void openFailed(const QString &path, const QString &error);
+    void exportProgress(int percent);
+    void exportFinished(const QString &path, bool ok);
+    void frameDrawn(qint64 nsecs);  // tempo gasto no paintEvent
+    void layersChanged();           // lista, ativa ou propriedades das camadas
+    void historyChanged();          // nó atual ou número de nós
+    void historyCleared();          // outro documento: os nós antigos não valem mais
+    void historyThumbnailReady(int node);
+    void historyThumbnailEvicted(int node);
 
 protected:
     void paintEvent(QPaintEvent *event) override;
@@ -71,28 +134,66 @@ protected:
     void mouseMoveEvent(QMouseEvent *event) override;
     void mouseReleaseEvent(QMouseEvent *event) override;
 
-    // Fundo dinâmico
-    QColor backgroundColor = Qt::white;
-    bool useBackgroundImage = false;
-    bool exportWithTransparency = false;
-
 private:
     void drawPreviewShape(QPainter &painter);
-
-    // Estado da seleção
-    QRect selectionRect;
-    QImage selectionImage;
-    bool selectionActive = false;
-
-    // Camadas e imagem principal
-    QImage canvasImage;
-    QImage backgroundLayer;
-    QImage drawingLayer;
-    QImage selectionLayer;
-
-    // Histórico visual
-    QVector<QImage> historyThumbnails;
-    UndoStack undoStack;
+    void showLoadingPreview(const QImage &preview, const QSize &fullSize);
+    void finishLoading(const TiledImage &image);
+
+    // Conversão entre coordenadas da imagem e do widget (arredonda para fora)
+    QRect imageToWidget(const QRect &rect) const;
+    QRect widgetToImage(const QRect &rect) const;
+    int integerZoom() const;  // o fator se o zoom for inteiro, senão 0
+    void resizeToImage(const QSize &imageSize);
+    QRect previewBounds() const;
+    QRect selectionBounds() const;
+    void updateHud();
+
+    // Documento alterado (inteiro ou numa área): invalida a pirâmide e redesenha
+    void refresh();
+    void refresh(const QRect &dirty);
+    void updateHistory();
+    void resetHistory();
+    // Undo/redo com o botão ainda apertado: o arrasto termina aqui, e os
+    // próximos eventos do mouse não alimentam um traço sem base
+    void abandonDrag();
+
+    // Camadas, seleção, histórico e composição; a widget só mostra e edita
+    Document doc;
+
+    // Níveis reduzidos da composição para zoom abaixo de 50%
+    MipmapPyramid mipmap;
+
+    // Abertura em segundo plano: prévia mostrada até a imagem inteira chegar
+    ImageLoader imageLoader;
+    QImage loadingPreview;
+    QSize loadingSize;
+
+    ImageExporter imageExporter;
+
+    // Autosave: a cada intervalo só os tiles alterados vão para o diário
+    static const int AutosaveInterval = 30 * 1000;
+    RecoveryJournal recoveryJournal;
+    QTimer autosaveTimer;
+
+    InputRecorder recorder;
+    QString queuedText;
+    bool textQueued = false;
+
+    // O texto do HUD é recalculado no timer, não a cada quadro; a caixa é
+    // criada no viewport do QScrollArea na primeira vez que aparece
+    static const int HudInterval = 250;
+    bool hudVisible = false;
+    QTimer hudTimer;
+    HudOverlay *hud = nullptr;
+    qint64 inputPendingSince = -1;  // primeiro evento ainda não desenhado (Profiler::now)
+
+    // Miniaturas do histórico: pedidas ao worker quando a edição assenta,
+    // fora do paintEvent
+    static const int HistoryInterval = 200;
+    ThumbnailCache historyThumbnails;
+    QTimer historyTimer;
+    int historyShownNode = -1;
+    int historyShownCount = 0;
 
     // Ferramenta e desenho
     Tool tool;
@@ -102,6 +203,7 @@ private:
     // Zoom e grade
     float zoomFactor = 1.0f;
     bool showGrid = false;
+    GridOverlay grid;
 
     // Pontos de controle
     QPoint lastPoint;
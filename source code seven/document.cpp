@@ -0,0 +1,830 @@
+#include "document.h"
+#include "floodfill.h"
+#include "mipmap.h"
+#include "sprayengine.h"
+#include "imageloader.h"
+#include "recoveryjournal.h"
+#include "profiler.h"
+#include <QDataStream>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QFontMetrics>
+#include <QPainter>
+#include <QTransform>
+
+namespace {
+
+// Vagas do atlas do histórico em potências de dois: criar ou apagar uma
+// camada quase nunca muda o tamanho dele (o que viraria um passo com a
+// imagem inteira em vez de só os tiles trocados)
+int atlasSlots(int count) {
+    int slots = 4;
+    while (slots < count)
+        slots *= 2;
+    return slots;
+}
+
+} // namespace
+
+Document::Document(const QSize &size)
+    : backgroundLayer(size, QImage::Format_RGB32, Qt::white)  // fundo visível
+{
+    selectionPixels = QImage(1, 1, TiledImage::LayerFormat);  // ✅ inicialização segura
+    selectionPixels.fill(Qt::transparent);
+
+    layers.append(Layer{nextLayerName(), TiledImage(size, TiledImage::LayerFormat, Qt::transparent)});
+    undoStack.setReplay(&Document::replayCommand);
+    pushHistory();
+}
+
+QSize Document::size() const { return layers.first().image.size(); }
+QRect Document::rect() const { return layers.first().image.rect(); }
+const TiledImage &Document::canvas() const { return layers.at(active).image; }
+TiledImage &Document::activeImage() { return layers[active].image; }
+
+const TiledImage &Document::flattened() const {
+    if (flatImage.size() != size()) {
+        flatImage = TiledImage(size(), TiledImage::LayerFormat);
+        flatDirty = flatImage.rect();
+    }
+    if (flatDirty.isEmpty())
+        return flatImage;
+
+    PROFILE_SCOPE("flatten");
+    for (int index : flatImage.tilesIn(flatDirty))
+        flattenTile(flatImage, index, layers);
+    flatDirty = QRegion();
+    return flatImage;
+}
+
+const QVector<Layer> &Document::layerStack() const {
+    return layers;
+}
+
+void Document::flattenTile(TiledImage &dst, int index, const QVector<Layer> &layers) {
+    dst.setUniform(index, 0);
+    for (const Layer &layer : layers)
+        blendTile(dst, index, layer.image, layer.mode, layer.opacity255());
+}
+
+TiledImage Document::flatten(const QVector<Layer> &layers) {
+    if (layers.isEmpty())
+        return TiledImage();
+    TiledImage out(layers.first().image.size(), TiledImage::LayerFormat);
+    for (int i = 0; i < out.tileCount(); ++i)
+        flattenTile(out, i, layers);
+    return out;
+}
+
+void Document::setImage(const TiledImage &image, bool resetHistory) {
+    layers.clear();
+    layerNumber = 1;
+    layers.append(Layer{nextLayerName(), image.convertedTo(TiledImage::LayerFormat)});
+    active = 0;
+    if (resetHistory)
+        undoStack.clear();
+    pushHistory();
+    invalidateAll();
+}
+
+bool Document::open(const QString &path, QString *error) {
+    if (QFileInfo(path).suffix().toLower() == "lpaint") {
+        ProjectFile::Contents loaded;
+        if (!ProjectFile::load(path, loaded, error))
+            return false;
+        setContents(loaded);
+        return true;
+    }
+
+    const TiledImage image = ImageLoader::read(path, error);
+    if (image.isNull())
+        return false;
+    setImage(image);
+    return true;
+}
+
+bool Document::recover(const QString &journalPath) {
+    TiledImage image;
+    QColor color;
+    if (!RecoveryJournal::recover(journalPath, image, color))
+        return false;
+
+    background = color;
+    useBackgroundImage = false;
+    backgroundLayer = TiledImage(image.size(), QImage::Format_RGB32, background);
+    setImage(image, true);
+    return true;
+}
+
+ProjectFile::Contents Document::contents(bool includeHistory) {
+    ProjectFile::Contents contents;
+    contents.layers = layers;
+    contents.activeLayer = active;
+    if (useBackgroundImage)
+        contents.background = backgroundLayer;
+    contents.backgroundColor = background;
+    contents.exportTransparency = exportWithTransparency;
+    if (includeHistory)
+        contents.historyWriter = undoStack.saveSnapshot();  // serializado por quem gravar
+    return contents;
+}
+
+void Document::setContents(const ProjectFile::Contents &contents) {
+    // Projetos antigos guardam ARGB32 sem pré-multiplicação
+    bool converted = false;
+    layers.clear();
+    for (Layer layer : contents.layers) {
+        converted |= layer.image.format() != TiledImage::LayerFormat;
+        layer.image = layer.image.convertedTo(TiledImage::LayerFormat);
+        layers.append(layer);
+    }
+    if (layers.isEmpty())
+        layers.append(Layer{QString(), TiledImage(QSize(800, 600), TiledImage::LayerFormat, Qt::transparent)});
+    active = qBound(0, contents.activeLayer, layers.size() - 1);
+    layerNumber = layers.size() + 1;
+
+    background = contents.backgroundColor;
+    exportWithTransparency = contents.exportTransparency;
+    useBackgroundImage = !contents.background.isNull();
+    backgroundLayer = useBackgroundImage ? contents.background
+                                         : TiledImage(size(), QImage::Format_RGB32, background);
+
+    // O histórico guarda tiles crus no formato antigo: não dá para misturar
+    if (contents.history.isEmpty() || converted) {
+        undoStack.clear();
+        pushHistory();
+    } else {
+        undoStack.restore(contents.history, layerAtlas(), layerInfo());  // se falhar, começa um histórico novo
+    }
+    invalidateAll();
+}
+
+QColor Document::backgroundColor() const {
+    return background;
+}
+
+void Document::setBackgroundColor(const QColor &color) {
+    background = color;
+    useBackgroundImage = false;
+    backgroundLayer.fill(color);
+    belowDirty = compositeDirty = rect();
+}
+
+void Document::setBackgroundImage(const QImage &image) {
+    backgroundLayer = TiledImage::fromImage(image.scaled(size()).convertToFormat(QImage::Format_RGB32));
+    useBackgroundImage = true;
+    belowDirty = compositeDirty = rect();
+}
+
+void Document::clearBackgroundImage() {
+    useBackgroundImage = false;
+    backgroundLayer.fill(background);
+    belowDirty = compositeDirty = rect();
+}
+
+bool Document::exportTransparency() const {
+    return exportWithTransparency;
+}
+
+void Document::setExportTransparency(bool enabled) {
+    exportWithTransparency = enabled;
+}
+
+int Document::layerCount() const {
+    return layers.size();
+}
+
+const Layer &Document::layer(int index) const {
+    return layers.at(index);
+}
+
+int Document::activeLayer() const {
+    return active;
+}
+
+void Document::setActiveLayer(int index) {
+    if (index < 0 || index >= layers.size() || index == active)
+        return;
+    // A imagem final não muda, só o que fica abaixo e acima da ativa
+    active = index;
+    belowDirty = aboveDirty = rect();
+}
+
+QRect Document::addLayer(const QString &name) {
+    Layer layer;
+    layer.name = name.isEmpty() ? nextLayerName() : name;
+    layer.image = TiledImage(size(), TiledImage::LayerFormat, Qt::transparent);
+    layers.insert(active + 1, layer);
+    ++active;
+
+    pushHistory();
+    belowDirty = aboveDirty = rect();
+    return QRect();  // camada vazia: nada aparece de diferente
+}
+
+QRect Document::removeLayer(int index) {
+    if (layers.size() <= 1 || index < 0 || index >= layers.size())
+        return QRect();
+
+    layers.remove(index);
+    if (active > index || active == layers.size())
+        --active;
+
+    pushHistory();
+    invalidateAll();
+    return rect();
+}
+
+QRect Document::moveLayer(int from, int to) {
+    if (from < 0 || from >= layers.size() || to < 0 || to >= layers.size() || from == to)
+        return QRect();
+
+    layers.move(from, to);
+    if (active == from)
+        active = to;
+    else if (from < active && to >= active)
+        --active;
+    else if (from > active && to <= active)
+        ++active;
+
+    pushHistory();
+    invalidateAll();
+    return rect();
+}
+
+void Document::setLayerName(int index, const QString &name) {
+    if (index < 0 || index >= layers.size() || layers[index].name == name)
+        return;
+    layers[index].name = name;
+    pushHistory();
+}
+
+QRect Document::setLayerOpacity(int index, qreal opacity) {
+    opacity = qBound<qreal>(0, opacity, 1);
+    if (index < 0 || index >= layers.size() || qFuzzyCompare(layers[index].opacity, opacity))
+        return QRect();
+    layers[index].opacity = opacity;
+    pushHistory();
+    invalidateLayer(index, QRect());
+    return rect();
+}
+
+QRect Document::setLayerVisible(int index, bool visible) {
+    if (index < 0 || index >= layers.size() || layers[index].visible == visible)
+        return QRect();
+    layers[index].visible = visible;
+    pushHistory();
+    invalidateLayer(index, QRect());
+    return rect();
+}
+
+QRect Document::setLayerBlendMode(int index, BlendMode mode) {
+    if (index < 0 || index >= layers.size() || layers[index].mode == mode)
+        return QRect();
+    layers[index].mode = mode;
+    pushHistory();
+    invalidateLayer(index, QRect());
+    return rect();
+}
+
+QRect Document::resize(int width, int height) {
+    for (int i = 0; i < layers.size(); ++i) {
+        // A de baixo ganha área branca, como o canvas sempre ganhou
+        TiledImage newImage(QSize(width, height), TiledImage::LayerFormat, i == 0 ? Qt::white : Qt::transparent);
+        newImage.draw(layers[i].image);
+        layers[i].image = newImage;
+    }
+
+    pushHistory();
+    invalidateAll();
+    return rect();
+}
+
+QRect Document::clear() {
+    activeImage().fill(Qt::transparent);
+    pushHistory();
+    invalidate();
+    return rect();
+}
+
+QRect Document::bucketFill(const QPoint &seed, const Tool &tool) {
+    if (!rect().contains(seed))
+        return QRect();
+
+    const QRect filled = FloodFill::fill(activeImage(), seed, tool.outlineColor(), tool.tolerance());
+    if (filled.isEmpty())
+        return filled;  // ✅ a cor já era a mesma
+
+    pushHistory();
+    invalidate(filled);
+    return filled;
+}
+
+QRect Document::drawText(const QPoint &pos, const QString &text, const Tool &tool) {
+    if (text.isEmpty())
+        return QRect();
+
+    QRect textRect = QFontMetrics(tool.font()).boundingRect(text).translated(pos);
+    textRect.adjust(-tool.thickness(), -tool.thickness(), tool.thickness(), tool.thickness());
+    activeImage().paint(textRect, [&](QPainter &painter) {
+        painter.setPen(QPen(tool.outlineColor(), tool.thickness()));
+        painter.setFont(tool.font());
+        painter.drawText(pos, text);
+    });
+
+    pushHistory();
+    invalidate(textRect);
+    return textRect;
+}
+
+QRect Document::drawShape(const QPoint &start, const QPoint &end, const Tool &tool) {
+    const QRect dirty = tool.bounds(start, end);
+    activeImage().paint(dirty, [&](QPainter &painter) {
+        painter.setRenderHint(QPainter::Antialiasing);
+        tool.apply(painter, start, end);
+    });
+
+    pushHistory();
+    invalidate(dirty);
+    return dirty;
+}
+
+QRect Document::spray(const QPoint &pos, const Tool &tool) {
+    if (pendingCommand.isEmpty() || pendingCommand.kind != StrokeCommand::Kind::Spray) {
+        beginCommand(StrokeCommand::Kind::Spray, tool);
+        pendingCommand.seed = SprayEngine::randomSeed();
+        sprayRandom = pendingCommand.seed;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    const QRect dirty = SprayEngine::spray(activeImage(), pos, tool, sprayRandom);
+    pendingCommand.points.append(pos);
+    pendingCommand.cost += timer.nsecsElapsed();
+    invalidate(dirty);
+    return dirty;
+}
+
+QRect Document::erase(const QPoint &from, const QPoint &to, const Tool &tool) {
+    // O comando é uma linha de pontos: um salto começa outro
+    if (pendingCommand.isEmpty() || pendingCommand.kind != StrokeCommand::Kind::Erase
+        || pendingCommand.points.last() != QPointF(from)) {
+        beginCommand(StrokeCommand::Kind::Erase, tool);
+        pendingCommand.points.append(from);
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    QRect dirty;
+    activeImage().paint(tool.bounds(from, to), [&](QPainter &painter) {
+        painter.setRenderHint(QPainter::Antialiasing);
+        dirty = tool.apply(painter, from, to);
+    });
+    pendingCommand.points.append(to);
+    pendingCommand.cost += timer.nsecsElapsed();
+    invalidate(dirty);
+    return dirty;
+}
+
+void Document::commit() {
+    if (pendingCommand.isEmpty())
+        pushHistory();
+    else
+        pushCommand();
+}
+
+QRect Document::beginStroke(const Tool &tool, const QPointF &pos) {
+    // O traço ao vivo usa os mesmos pontos arredondados que o replay
+    const QPointF start = StrokeCommand::quantize(pos);
+    beginCommand(StrokeCommand::Kind::Stroke, tool);
+    pendingCommand.points.append(start);
+    return strokeEngine.begin(tool, activeImage(), start);
+}
+
+QRect Document::addStrokePoint(const QPointF &pos) {
+    const QPointF point = StrokeCommand::quantize(pos);
+    pendingCommand.points.append(point);
+    return strokeEngine.addPoint(point);
+}
+
+QRect Document::flushStroke() {
+    if (!strokeEngine.hasPending())
+        return QRect();
+    QElapsedTimer timer;
+    timer.start();
+    const QRect dirty = strokeEngine.flush(activeImage());
+    pendingCommand.cost += timer.nsecsElapsed();
+    invalidate(dirty);
+    return dirty;
+}
+
+QRect Document::endStroke() {
+    const QRect dirty = flushStroke();
+    activeImage().compact(strokeEngine.end());
+    pushCommand();
+    return dirty;
+}
+
+bool Document::isStroking() const {
+    return strokeEngine.isActive();
+}
+
+void Document::finishStroke() {
+    // O StrokeEngine carimba a partir dos tiles do início do traço: depois de
+    // mover o cursor do histórico eles seriam de outro estado (ou de outra
+    // grade). O traço ao vivo vira um passo antes, e o undo o desfaz
+    if (strokeEngine.isActive())
+        endStroke();
+}
+
+bool Document::hasSelection() const {
+    return selectionActive;
+}
+
+QRect Document::selectionRect() const {
+    return selection;
+}
+
+QImage Document::selectionImage() const {
+    return selectionPixels;
+}
+
+void Document::setSelectionRect(const QRect &rect) {
+    selection = rect;
+    selectionActive = true;
+}
+
+void Document::clearSelection() {
+    selectionActive = false;
+    selectionPixels = QImage();
+}
+
+void Document::copySelection() {
+    if (!selectionActive || selection.isNull()) return;
+    selectionPixels = activeImage().copy(selection);
+}
+
+QRect Document::cutSelection() {
+    if (!selectionActive || selection.isNull()) return QRect();
+    selectionPixels = activeImage().copy(selection);
+
+    const QRect area = selection.normalized();
+    activeImage().paint(area, [&](QPainter &painter) {
+        painter.setCompositionMode(QPainter::CompositionMode_Source);
+        painter.fillRect(selection, Qt::transparent);
+    });
+
+    pushHistory();
+    invalidate(area);
+    return area;
+}
+
+QRect Document::pasteSelection() {
+    if (selectionPixels.isNull()) return QRect();
+
+    const QRect area(selection.topLeft(), selectionPixels.size());
+    activeImage().paint(area, [&](QPainter &painter) {
+        painter.drawImage(area.topLeft(), selectionPixels);
+    });
+
+    pushHistory();
+    invalidate(area);
+    return area;
+}
+
+void Document::applySelection() {
+    selectionActive = false;
+    selection = QRect();
+    selectionPixels = QImage(1, 1, TiledImage::LayerFormat);  // ✅ reinicialização segura
+    selectionPixels.fill(Qt::transparent);
+}
+
+void Document::flipSelection(bool horizontal, bool vertical) {
+    if (selectionPixels.isNull()) return;
+    selectionPixels = selectionPixels.mirrored(horizontal, vertical);
+}
+
+void Document::rotateSelection(int angle) {
+    if (selectionPixels.isNull()) return;
+
+    QTransform transform;
+    transform.rotate(angle);
+    selectionPixels = selectionPixels.transformed(transform, Qt::SmoothTransformation);
+}
+
+bool Document::undo() {
+    finishStroke();
+    pendingCommand.clear();  // arrasto ainda aberto é descartado, como sempre foi
+    if (!undoStack.canUndo())
+        return false;
+    const TiledImage atlas = undoStack.undo();
+    restoreLayers(atlas, undoStack.currentExtra());
+    return true;
+}
+
+bool Document::redo() {
+    finishStroke();
+    pendingCommand.clear();
+    if (!undoStack.canRedo())
+        return false;
+    const TiledImage atlas = undoStack.redo();
+    restoreLayers(atlas, undoStack.currentExtra());
+    return true;
+}
+
+int Document::historyNode() const {
+    return undoStack.currentNode();
+}
+
+int Document::historyNodeCount() const {
+    return undoStack.nodeCount();
+}
+
+int Document::historyParent(int node) const {
+    return undoStack.parentNode(node);
+}
+
+bool Document::jumpToHistory(int node) {
+    finishStroke();
+    pendingCommand.clear();
+    if (node < 0 || node >= undoStack.nodeCount() || node == undoStack.currentNode())
+        return false;
+    const TiledImage atlas = undoStack.jumpTo(node);
+    restoreLayers(atlas, undoStack.currentExtra());
+    return true;
+}
+
+void Document::setHistoryMemoryBudget(qint64 bytes) {
+    undoStack.setMemoryBudget(bytes);
+}
+
+void Document::invalidate(const QRect &rect) {
+    invalidateLayer(active, rect);
+}
+
+void Document::invalidateLayer(int index, const QRect &rect) {
+    const QRect area = rect.isNull() ? this->rect() : rect.intersected(this->rect());
+    compositeDirty += area;
+    flatDirty += area;
+    if (index < active)
+        belowDirty += area;
+    else if (index > active)
+        aboveDirty += area;
+}
+
+void Document::invalidateAll() {
+    compositeDirty = belowDirty = aboveDirty = flatDirty = rect();
+}
+
+void Document::pushHistory() {
+    // Um arrasto ainda aberto entra junto neste passo, como tiles
+    pendingCommand.clear();
+    undoStack.push(layerAtlas(), layerInfo());
+}
+
+void Document::beginCommand(StrokeCommand::Kind kind, const Tool &tool) {
+    if (!pendingCommand.isEmpty())
+        pushCommand();
+    pendingCommand.kind = kind;
+    pendingCommand.tool = tool;
+    pendingCommand.layer = active;
+    pendingCommand.layerSize = size();
+}
+
+void Document::pushCommand() {
+    undoStack.pushCommand(layerAtlas(), layerInfo(), pendingCommand.save(), pendingCommand.cost);
+    pendingCommand.clear();
+}
+
+TiledImage Document::replayCommand(const TiledImage &atlas, const QByteArray &data) {
+    StrokeCommand command;
+    if (!StrokeCommand::load(data, command))
+        return atlas;
+
+    // A camada do comando sai do atlas, recebe o traço e volta para uma cópia
+    TiledImage layer(command.layerSize, TiledImage::LayerFormat);
+    const int perLayer = layer.tileCount();
+    const int first = command.layer * perLayer;
+    if (first < 0 || first + perLayer > atlas.tileCount())
+        return atlas;
+    for (int i = 0; i < perLayer; ++i)
+        layer.setTileAt(i, atlas.peekTile(first + i));
+
+    command.apply(layer);
+
+    TiledImage result = atlas;
+    for (int i = 0; i < perLayer; ++i)
+        result.setTileAt(first + i, layer.peekTile(i));
+    return result;
+}
+
+TiledImage Document::layerAtlas() const {
+    // Camadas uma embaixo da outra, cada uma numa faixa de tiles inteiros
+    const TiledImage &first = layers.first().image;
+    const int perLayer = first.tileCount();
+    TiledImage atlas(QSize(first.width(), first.tilesY() * TiledImage::TileSize * atlasSlots(layers.size())),
+                     TiledImage::LayerFormat);
+    for (int k = 0; k < layers.size(); ++k) {
+        for (int i = 0; i < perLayer; ++i)
+            atlas.setTileAt(k * perLayer + i, layers[k].image.peekTile(i));
+    }
+    return atlas;
+}
+
+QByteArray Document::layerInfo() const {
+    QByteArray info;
+    QDataStream out(&info, QIODevice::WriteOnly);
+    out << size() << qint32(active) << qint32(layers.size());
+    for (const Layer &layer : layers)
+        out << layer.name << double(layer.opacity) << layer.visible << quint8(layer.mode);
+    return info;
+}
+
+void Document::restoreLayers(const TiledImage &atlas, const QByteArray &info) {
+    QDataStream in(info);
+    QSize layerSize;
+    qint32 activeIndex = 0, count = 0;
+    in >> layerSize >> activeIndex >> count;
+    if (count <= 0 || layerSize.isEmpty())
+        return;
+
+    QVector<Layer> restored(count);
+    const int perLayer = TiledImage(layerSize, TiledImage::LayerFormat).tileCount();
+    if (atlas.tileCount() < perLayer * count)
+        return;
+
+    bool sameStructure = layerSize == size() && count == layers.size() && activeIndex == active;
+    for (int k = 0; k < count; ++k) {
+        Layer &layer = restored[k];
+        double opacity = 1;
+        quint8 mode = 0;
+        in >> layer.name >> opacity >> layer.visible >> mode;
+        layer.opacity = opacity;
+        layer.mode = static_cast<BlendMode>(mode);
+        layer.image = TiledImage(layerSize, TiledImage::LayerFormat);
+        for (int i = 0; i < perLayer; ++i)
+            layer.image.setTileAt(i, atlas.peekTile(k * perLayer + i));
+        if (sameStructure) {
+            const Layer &old = layers[k];
+            sameStructure = old.opacity == layer.opacity && old.visible == layer.visible && old.mode == layer.mode;
+        }
+    }
+
+    // Mesma estrutura: só os tiles trocados pelo passo são recompostos
+    if (sameStructure) {
+        for (int k = 0; k < count; ++k) {
+            const TiledImage &before = layers[k].image;
+            const TiledImage &after = restored[k].image;
+            for (int i = 0; i < after.tileCount(); ++i) {
+                if (!before.peekTile(i).sharesWith(after.peekTile(i)))
+                    invalidateLayer(k, after.tileRect(i));
+            }
+        }
+        layers = restored;
+        return;
+    }
+
+    layers = restored;
+    active = qBound(0, int(activeIndex), layers.size() - 1);
+    invalidateAll();
+}
+
+QString Document::nextLayerName() {
+    return QString("Layer %1").arg(layerNumber++);
+}
+
+bool Document::aboveMergeable() const {
+    for (int k = active + 1; k < layers.size(); ++k) {
+        if (layers[k].opacity255() > 0 && layers[k].mode != BlendMode::Normal)
+            return false;
+    }
+    return true;
+}
+
+void Document::updateBelow(int index) const {
+    const QRect tileRect = belowImage.tileRect(index);
+    if (!belowDirty.intersects(tileRect))
+        return;
+
+    // Fundo uniforme ou a imagem de fundo (de outro tamanho, só onde tem
+    // tile na mesma posição), depois as camadas abaixo da ativa
+    belowImage.setUniform(index, TiledImage::toPixel(background, belowImage.format()));
+    if (useBackgroundImage) {
+        const int tx = index % belowImage.tilesX();
+        const int ty = index / belowImage.tilesX();
+        if (tx < backgroundLayer.tilesX() && ty < backgroundLayer.tilesY()) {
+            const int src = backgroundLayer.tileIndex(tx, ty);
+            if (backgroundLayer.tileRect(src).size() == tileRect.size())
+                belowImage.setTileAt(index, backgroundLayer.tileAt(src));
+            else
+                belowImage.drawTile(index, backgroundLayer.tileAt(src), backgroundLayer.tileRect(src).size(),
+                                    backgroundLayer.format());
+        }
+    }
+    for (int k = 0; k < active; ++k)
+        blendTile(belowImage, index, layers[k].image, layers[k].mode, layers[k].opacity255());
+}
+
+void Document::updateAbove(int index) const {
+    const QRect tileRect = aboveImage.tileRect(index);
+    if (!aboveDirty.intersects(tileRect))
+        return;
+
+    aboveImage.setUniform(index, 0);
+    for (int k = active + 1; k < layers.size(); ++k)
+        blendTile(aboveImage, index, layers[k].image, BlendMode::Normal, layers[k].opacity255());
+}
+
+void Document::blendTile(TiledImage &dst, int index, const TiledImage &src, BlendMode mode, int opacity) {
+    if (opacity <= 0)
+        return;
+
+    const TiledImage::Tile &tile = src.tileAt(index);
+    const TiledImage::Tile &under = dst.tileAt(index);
+    if (tile.isUniform()) {
+        if (tile.value == 0)
+            return;  // transparente não muda nada em nenhum modo
+        if (under.isUniform()) {
+            dst.setUniform(index, Blend::pixel(mode, under.value, tile.value, opacity));
+            return;
+        }
+        QImage &image = dst.writableTile(index);
+        for (int y = 0; y < image.height(); ++y)
+            Blend::fill(mode, reinterpret_cast<quint32 *>(image.scanLine(y)), tile.value, image.width(), opacity);
+        return;
+    }
+
+    // Sobre transparente todos os modos devolvem a própria fonte: o tile é
+    // só compartilhado
+    if (opacity == 255 && dst.format() == src.format() && under.isUniform() && under.value == 0) {
+        dst.setTileAt(index, tile);
+        return;
+    }
+
+    QImage &image = dst.writableTile(index);
+    const int width = qMin(image.width(), tile.image.width());
+    const int height = qMin(image.height(), tile.image.height());
+    for (int y = 0; y < height; ++y)
+        Blend::row(mode, reinterpret_cast<quint32 *>(image.scanLine(y)),
+                   reinterpret_cast<const quint32 *>(tile.image.constScanLine(y)), width, opacity);
+}
+
+const TiledImage &Document::composite(const QRect &area) const {
+    if (compositeImage.size() != size()) {
+        compositeImage = TiledImage(size(), QImage::Format_RGB32);
+        belowImage = TiledImage(size(), QImage::Format_RGB32);
+        aboveImage = TiledImage(size(), TiledImage::LayerFormat);
+        compositeDirty = belowDirty = aboveDirty = compositeImage.rect();
+    }
+
+    const QRegion pending = compositeDirty.intersected(area);
+    if (pending.isEmpty())
+        return compositeImage;
+
+    PROFILE_SCOPE("composite");
+
+    const QVector<int> indices = compositeImage.tilesIn(pending);
+
+    // Recompõe tiles inteiros: o que está abaixo da ativa (em cache), a
+    // ativa, e o que está acima (em cache se for tudo Normal)
+    const Layer &current = layers.at(active);
+    const bool merged = aboveMergeable();
+    for (int index : indices) {
+        updateBelow(index);
+        compositeImage.setTileAt(index, belowImage.tileAt(index));
+        blendTile(compositeImage, index, current.image, current.mode, current.opacity255());
+        if (merged) {
+            updateAbove(index);
+            blendTile(compositeImage, index, aboveImage, BlendMode::Normal, 255);
+        } else {
+            for (int k = active + 1; k < layers.size(); ++k)
+                blendTile(compositeImage, index, layers[k].image, layers[k].mode, layers[k].opacity255());
+        }
+    }
+
+    // Uma subtração por chamada, não uma por tile: os tiles refeitos cobrem
+    // exatamente a área pendente alinhada à grade
+    const QRegion covered = compositeImage.tileBounds(pending);
+    compositeDirty -= covered;
+    belowDirty -= covered;
+    if (merged)
+        aboveDirty -= covered;
+    return compositeImage;
+}
+
+QColor Document::pixelColor(const QPoint &pos) const {
+    if (!rect().contains(pos))
+        return QColor();
+    return composite(QRect(pos, QSize(1, 1))).pixelColor(pos);
+}
+
+TiledImage Document::exportSnapshot(const QByteArray &format) const {
+    // Cópia rasa: quem grava lê os tiles enquanto a edição continua
+    if (format.toLower() == "png" && exportWithTransparency)
+        return flattened();
+    return composite(rect());
+}
+
+QImage Document::thumbnail(const QSize &size) const {
+    return MipmapPyramid::thumbnail(flattened(), size);
+}
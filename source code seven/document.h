@@ -0,0 +1,193 @@
+#ifndef DOCUMENT_H
+#define DOCUMENT_H
+
+#include <QByteArray>
+#include <QColor>
+#include <QImage>
+#include <QPoint>
+#include <QPointF>
+#include <QRect>
+#include <QRegion>
+#include <QSize>
+#include <QString>
+#include "tool.h"
+#include "layer.h"
+#include "UndoStack.h"
+#include "tiledimage.h"
+#include "strokeengine.h"
+#include "strokecommand.h"
+#include "projectfile.h"
+
+// O desenho em si, sem widget: camadas, fundo, seleção, histórico e a
+// composição em cache. Tudo em coordenadas da imagem; cada edição devolve a
+// área alterada para quem estiver mostrando o documento redesenhar só ali.
+// As ferramentas desenham na camada ativa.
+// A CanvasWidget é uma vista sobre um Document, e o modo --headless usa o
+// mesmo Document sem janela nenhuma (um por thread).
+class Document {
+public:
+    explicit Document(const QSize &size = QSize(800, 600));
+
+    QSize size() const;
+    QRect rect() const;
+    const TiledImage &canvas() const;  // pixels da camada ativa
+    // Camadas visíveis achatadas sobre transparente (sem o fundo)
+    const TiledImage &flattened() const;
+
+    // O mesmo achatamento sobre uma cópia das camadas (tiles compartilhados,
+    // nada é decodificado na cópia). Não toca no Document, então roda num
+    // worker, e tiles ainda no arquivo de projeto são decodificados lá.
+    const QVector<Layer> &layerStack() const;
+    static void flattenTile(TiledImage &dst, int index, const QVector<Layer> &layers);
+    static TiledImage flatten(const QVector<Layer> &layers);
+
+    // Troca o documento por uma camada só com a imagem; com resetHistory o
+    // histórico começa de novo
+    void setImage(const TiledImage &image, bool resetHistory = false);
+    // Abertura síncrona (imagem comum ou .lpaint)
+    bool open(const QString &path, QString *error = nullptr);
+    bool recover(const QString &journalPath);
+
+    // Projeto nativo
+    ProjectFile::Contents contents(bool includeHistory);
+    void setContents(const ProjectFile::Contents &contents);
+
+    // Fundo
+    QColor backgroundColor() const;
+    void setBackgroundColor(const QColor &color);
+    void setBackgroundImage(const QImage &image);
+    void clearBackgroundImage();
+    bool exportTransparency() const;
+    void setExportTransparency(bool enabled);
+
+    // Camadas (índice 0 é a de baixo). Cada mudança vira um passo do histórico
+    // e devolve a área a redesenhar
+    int layerCount() const;
+    const Layer &layer(int index) const;
+    int activeLayer() const;
+    void setActiveLayer(int index);
+    QRect addLayer(const QString &name = QString());  // acima da ativa, e vira a ativa
+    QRect removeLayer(int index);                     // sempre sobra uma
+    QRect moveLayer(int from, int to);
+    void setLayerName(int index, const QString &name);
+    QRect setLayerOpacity(int index, qreal opacity);
+    QRect setLayerVisible(int index, bool visible);
+    QRect setLayerBlendMode(int index, BlendMode mode);
+
+    // Edições que viram um passo do histórico sozinhas
+    QRect resize(int width, int height);
+    QRect clear();
+    QRect bucketFill(const QPoint &seed, const Tool &tool);
+    QRect drawText(const QPoint &pos, const QString &text, const Tool &tool);
+    QRect drawShape(const QPoint &start, const QPoint &end, const Tool &tool);
+
+    // Edições contínuas (arrasto): o passo só é fechado por commit().
+    // Lápis, pincel, spray e borracha viram passos de comando no histórico.
+    QRect spray(const QPoint &pos, const Tool &tool);
+    QRect erase(const QPoint &from, const QPoint &to, const Tool &tool);
+    void commit();
+
+    // Traço de lápis/pincel: os pontos ficam na fila até o flush; endStroke
+    // carimba o resto e fecha o passo
+    QRect beginStroke(const Tool &tool, const QPointF &pos);
+    QRect addStrokePoint(const QPointF &pos);
+    QRect flushStroke();
+    QRect endStroke();
+    bool isStroking() const;
+
+    // Seleção
+    bool hasSelection() const;
+    QRect selectionRect() const;
+    QImage selectionImage() const;
+    void setSelectionRect(const QRect &rect);
+    void clearSelection();
+    void copySelection();
+    QRect cutSelection();
+    QRect pasteSelection();
+    void applySelection();
+    void flipSelection(bool horizontal, bool vertical);
+    void rotateSelection(int angle);
+
+    // Histórico
+    bool undo();
+    bool redo();
+    // O histórico é uma árvore: editar depois de um undo abre um ramo novo,
+    // e qualquer nó pode ser visitado trocando só os tiles do caminho
+    int historyNode() const;
+    int historyNodeCount() const;
+    int historyParent(int node) const;
+    bool jumpToHistory(int node);
+    void setHistoryMemoryBudget(qint64 bytes);
+
+    // Fundo + camadas; só os tiles sujos são recompostos
+    const TiledImage &composite(const QRect &area) const;
+    QColor pixelColor(const QPoint &pos) const;
+
+    // O que vai para o arquivo: PNG com transparência leva as camadas sem o fundo
+    TiledImage exportSnapshot(const QByteArray &format) const;
+    QImage thumbnail(const QSize &size) const;
+
+private:
+    TiledImage &activeImage();
+
+    // Pixels da camada ativa mudaram (rect nulo = imagem inteira)
+    void invalidate(const QRect &rect = QRect());
+    void invalidateLayer(int index, const QRect &rect);
+    void invalidateAll();
+
+    // Histórico: as camadas empilhadas numa imagem só (tiles compartilhados,
+    // nada é copiado) para o UndoStack comparar tudo de uma vez; nome,
+    // opacidade, modo e a camada ativa vão no extra de cada passo
+    void pushHistory();
+    TiledImage layerAtlas() const;
+    // Traço à mão livre em andamento, gravado como comando
+    void beginCommand(StrokeCommand::Kind kind, const Tool &tool);
+    void finishStroke();  // fecha o traço de lápis/pincel em andamento, se houver
+    void pushCommand();
+    static TiledImage replayCommand(const TiledImage &atlas, const QByteArray &command);
+    QByteArray layerInfo() const;
+    void restoreLayers(const TiledImage &atlas, const QByteArray &info);
+    QString nextLayerName();
+
+    // Cache da composição: fundo + camadas abaixo da ativa, e as de cima
+    // já achatadas quando são todas Normal. Editar a camada ativa recompõe
+    // só os tiles sujos com no máximo três misturas por tile, não importa
+    // quantas camadas o documento tenha.
+    bool aboveMergeable() const;
+    // Refazem o tile se ele estiver sujo; quem chama limpa a região suja
+    // uma vez no fim, para todos os tiles
+    void updateBelow(int index) const;
+    void updateAbove(int index) const;
+    static void blendTile(TiledImage &dst, int index, const TiledImage &src, BlendMode mode, int opacity);
+
+    // Camadas (em tiles: áreas de uma cor não ocupam memória) e fundo
+    QVector<Layer> layers;
+    int active = 0;
+    int layerNumber = 1;  // para os nomes "Layer N"
+    TiledImage backgroundLayer;
+    QColor background = Qt::white;
+    bool useBackgroundImage = false;
+    bool exportWithTransparency = false;
+
+    // Estado da seleção
+    QRect selection;
+    QImage selectionPixels;
+    bool selectionActive = false;
+
+    UndoStack undoStack;
+    StrokeEngine strokeEngine;
+    StrokeCommand pendingCommand;
+    quint32 sprayRandom = 0;
+
+    // Composição em cache
+    mutable TiledImage compositeImage;
+    mutable QRegion compositeDirty;
+    mutable TiledImage belowImage;
+    mutable QRegion belowDirty;
+    mutable TiledImage aboveImage;
+    mutable QRegion aboveDirty;
+    mutable TiledImage flatImage;
+    mutable QRegion flatDirty;
+};
+
+#endif // DOCUMENT_H
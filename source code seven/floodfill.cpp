@@ -0,0 +1,414 @@
+#include "floodfill.h"
+#include "profiler.h"
+#include <QColor>
+#include <algorithm>
+#include <vector>
+
+#if defined(__SSE2__) && defined(__GNUC__)
+#include <emmintrin.h>
+#define LP_FILL_SSE2
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define LP_FILL_AVX2
+#endif
+
+namespace {
+
+// Trecho horizontal [x1, x2] da linha y, vindo da linha y - dy
+struct Span {
+    int x1;
+    int x2;
+    int y;
+    int dy;
+};
+
+// Distância por canal (máximo entre A, R, G e B) dentro da tolerância
+inline bool colorMatches(quint32 pixel, quint32 target, int tolerance) {
+    if (tolerance == 0)
+        return pixel == target;
+    for (int shift = 0; shift < 32; shift += 8) {
+        const int a = (pixel >> shift) & 0xff;
+        const int b = (target >> shift) & 0xff;
+        if (qAbs(a - b) > tolerance)
+            return false;
+    }
+    return true;
+}
+
+// Kernels de varredura: devolvem o limite da sequência de pixels parecidos
+// com o alvo. matchEnd anda para a direita a partir de x (exclusivo no fim);
+// matchStart anda para a esquerda a partir de x - 1.
+int matchEndScalar(const quint32 *row, int x, int end, quint32 target, int tolerance) {
+    while (x < end && colorMatches(row[x], target, tolerance))
+        ++x;
+    return x;
+}
+
+int matchStartScalar(const quint32 *row, int x, quint32 target, int tolerance) {
+    while (x > 0 && colorMatches(row[x - 1], target, tolerance))
+        --x;
+    return x;
+}
+
+#ifdef LP_FILL_SSE2
+// Máscara de 16 bits com 1 em cada byte dentro da tolerância
+inline int matchMask128(__m128i pixels, __m128i target, __m128i tolerance) {
+    const __m128i diff = _mm_or_si128(_mm_subs_epu8(pixels, target), _mm_subs_epu8(target, pixels));
+    const __m128i over = _mm_subs_epu8(diff, tolerance);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(over, _mm_setzero_si128()));
+}
+
+int matchEndSse2(const quint32 *row, int x, int end, quint32 target, int tolerance) {
+    const __m128i t = _mm_set1_epi32(int(target));
+    const __m128i tol = _mm_set1_epi8(char(tolerance));
+    while (x + 4 <= end) {
+        const int mask = matchMask128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(row + x)), t, tol);
+        if (mask != 0xffff)
+            return x + __builtin_ctz(~mask & 0xffff) / 4;
+        x += 4;
+    }
+    return matchEndScalar(row, x, end, target, tolerance);
+}
+
+int matchStartSse2(const quint32 *row, int x, quint32 target, int tolerance) {
+    const __m128i t = _mm_set1_epi32(int(target));
+    const __m128i tol = _mm_set1_epi8(char(tolerance));
+    while (x >= 4) {
+        const int mask = matchMask128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(row + x - 4)), t, tol);
+        if (mask != 0xffff)
+            return x - 4 + (31 - __builtin_clz(~mask & 0xffff)) / 4 + 1;
+        x -= 4;
+    }
+    return matchStartScalar(row, x, target, tolerance);
+}
+#endif
+
+#ifdef LP_FILL_AVX2
+__attribute__((target("avx2")))
+inline unsigned matchMask256(__m256i pixels, __m256i target, __m256i tolerance) {
+    const __m256i diff = _mm256_or_si256(_mm256_subs_epu8(pixels, target), _mm256_subs_epu8(target, pixels));
+    const __m256i over = _mm256_subs_epu8(diff, tolerance);
+    return unsigned(_mm256_movemask_epi8(_mm256_cmpeq_epi8(over, _mm256_setzero_si256())));
+}
+
+__attribute__((target("avx2")))
+int matchEndAvx2(const quint32 *row, int x, int end, quint32 target, int tolerance) {
+    const __m256i t = _mm256_set1_epi32(int(target));
+    const __m256i tol = _mm256_set1_epi8(char(tolerance));
+    while (x + 8 <= end) {
+        const unsigned mask = matchMask256(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(row + x)), t, tol);
+        if (mask != 0xffffffffu)
+            return x + __builtin_ctz(~mask) / 4;
+        x += 8;
+    }
+    return matchEndScalar(row, x, end, target, tolerance);
+}
+
+__attribute__((target("avx2")))
+int matchStartAvx2(const quint32 *row, int x, quint32 target, int tolerance) {
+    const __m256i t = _mm256_set1_epi32(int(target));
+    const __m256i tol = _mm256_set1_epi8(char(tolerance));
+    while (x >= 8) {
+        const unsigned mask = matchMask256(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(row + x - 8)), t, tol);
+        if (mask != 0xffffffffu)
+            return x - 8 + (31 - __builtin_clz(~mask)) / 4 + 1;
+        x -= 8;
+    }
+    return matchStartScalar(row, x, target, tolerance);
+}
+#endif
+
+struct Kernels {
+    int (*matchEnd)(const quint32 *, int, int, quint32, int);
+    int (*matchStart)(const quint32 *, int, quint32, int);
+};
+
+// Escolhe o kernel uma vez, conforme a CPU
+const Kernels &selectKernels() {
+    static const Kernels selected = [] {
+#ifdef LP_FILL_AVX2
+        if (__builtin_cpu_supports("avx2"))
+            return Kernels{matchEndAvx2, matchStartAvx2};
+#endif
+#ifdef LP_FILL_SSE2
+        return Kernels{matchEndSse2, matchStartSse2};
+#else
+        return Kernels{matchEndScalar, matchStartScalar};
+#endif
+    }();
+    return selected;
+}
+
+// Estado comum às duas superfícies (imagem contínua e imagem em tiles)
+struct FillState {
+    int width = 0;
+    int height = 0;
+    quint32 target = 0;
+    quint32 replacement = 0;
+    int tolerance = 0;
+    Kernels kernels;
+
+    // Só é usado quando a cor nova também cai na tolerância do alvo;
+    // nesse caso os pixels pintados precisam ser marcados como visitados.
+    std::vector<quint32> visited;
+    int wordsPerRow = 0;
+
+    // Prepara o preenchimento; devolve false se não há nada a fazer
+    bool prepare(quint32 seedValue, quint32 newValue, int tol) {
+        target = seedValue;
+        replacement = newValue;
+        tolerance = qBound(0, tol, 255);
+        kernels = selectKernels();
+
+        if (target == replacement)
+            return false;
+
+        if (tolerance > 0 && colorMatches(replacement, target, tolerance)) {
+            wordsPerRow = (width + 31) / 32;
+            visited.assign(size_t(wordsPerRow) * height, 0u);
+        }
+        return true;
+    }
+
+    bool isVisited(int x, int y) const {
+        return !visited.empty() && (visited[size_t(y) * wordsPerRow + x / 32] >> (x % 32)) & 1u;
+    }
+
+    void markVisited(int x1, int x2, int y) {
+        if (visited.empty()) return;
+        quint32 *bitsRow = visited.data() + size_t(y) * wordsPerRow;
+        for (int x = x1; x <= x2; ++x)
+            bitsRow[x / 32] |= 1u << (x % 32);
+    }
+
+    // Corta [from, end) no primeiro pixel já visitado
+    int clipVisitedEnd(int from, int end, int y) const {
+        if (!visited.empty()) {
+            for (int x = from; x < end; ++x) {
+                if (isVisited(x, y))
+                    return x;
+            }
+        }
+        return end;
+    }
+
+    // Corta [start, from) no último pixel já visitado
+    int clipVisitedStart(int start, int from, int y) const {
+        if (!visited.empty()) {
+            for (int x = from - 1; x >= start; --x) {
+                if (isVisited(x, y))
+                    return x + 1;
+            }
+        }
+        return start;
+    }
+};
+
+// Imagem contínua: as linhas são lidas direto da QImage
+struct ImageSurface : FillState {
+    uchar *bits;
+    qsizetype stride;
+
+    quint32 *row(int y) const {
+        return reinterpret_cast<quint32 *>(bits + y * stride);
+    }
+
+    bool inside(int x, int y) const {
+        return x >= 0 && x < width && y >= 0 && y < height
+            && colorMatches(row(y)[x], target, tolerance) && !isVisited(x, y);
+    }
+
+    // Primeiro x >= from fora da região
+    int runEnd(int from, int y) const {
+        return clipVisitedEnd(from, kernels.matchEnd(row(y), from, width, target, tolerance), y);
+    }
+
+    // Menor x <= from tal que [x, from) está todo dentro da região
+    int runStart(int from, int y) const {
+        return clipVisitedStart(kernels.matchStart(row(y), from, target, tolerance), from, y);
+    }
+
+    void fillRun(int x1, int x2, int y) {
+        quint32 *r = row(y);
+        std::fill(r + x1, r + x2 + 1, replacement);
+        markVisited(x1, x2, y);
+    }
+};
+
+// Imagem em tiles: cada linha é percorrida um tile por vez. Tiles uniformes
+// são comparados pelo valor sem materializar pixels, e um tile que acaba
+// inteiramente preenchido volta a ser guardado como um valor só, para que
+// preencher uma área enorme não aloque a imagem inteira.
+struct TiledSurface : FillState {
+    static const int TileSize = TiledImage::TileSize;
+
+    TiledImage *image;
+    std::vector<int> written;  // pixels substituídos em cada tile
+
+    const TiledImage::Tile &tileAt(int x, int y) const {
+        return image->tileAt(image->tileIndex(x / TileSize, y / TileSize));
+    }
+
+    const quint32 *tileRow(const TiledImage::Tile &tile, int y) const {
+        return reinterpret_cast<const quint32 *>(tile.image.constScanLine(y % TileSize));
+    }
+
+    bool inside(int x, int y) const {
+        return x >= 0 && x < width && y >= 0 && y < height
+            && colorMatches(image->pixel(QPoint(x, y)), target, tolerance) && !isVisited(x, y);
+    }
+
+    int runEnd(int from, int y) const {
+        int x = from;
+        while (x < width) {
+            const int x0 = x / TileSize * TileSize;
+            const int segEnd = qMin(width, x0 + TileSize);
+            const TiledImage::Tile &tile = tileAt(x, y);
+
+            int end;
+            if (tile.isUniform())
+                end = colorMatches(tile.value, target, tolerance) ? segEnd : x;
+            else
+                end = x0 + kernels.matchEnd(tileRow(tile, y), x - x0, segEnd - x0, target, tolerance);
+
+            x = end;
+            if (end < segEnd)
+                break;
+        }
+        return clipVisitedEnd(from, x, y);
+    }
+
+    int runStart(int from, int y) const {
+        int x = from;
+        while (x > 0) {
+            const int x0 = (x - 1) / TileSize * TileSize;
+            const TiledImage::Tile &tile = tileAt(x - 1, y);
+
+            int start;
+            if (tile.isUniform())
+                start = colorMatches(tile.value, target, tolerance) ? x0 : x;
+            else
+                start = x0 + kernels.matchStart(tileRow(tile, y), x - x0, target, tolerance);
+
+            x = start;
+            if (start > x0)
+                break;
+        }
+        return clipVisitedStart(x, from, y);
+    }
+
+    void fillRun(int x1, int x2, int y) {
+        for (int x = x1; x <= x2;) {
+            const int x0 = x / TileSize * TileSize;
+            const int segEnd = qMin(x2 + 1, x0 + TileSize);
+            const int index = image->tileIndex(x / TileSize, y / TileSize);
+
+            QImage &img = image->writableTile(index);
+            quint32 *r = reinterpret_cast<quint32 *>(img.scanLine(y % TileSize));
+            std::fill(r + (x - x0), r + (segEnd - x0), replacement);
+
+            written[index] += segEnd - x;
+            if (written[index] == img.width() * img.height())
+                image->setUniform(index, replacement);
+            x = segEnd;
+        }
+        markVisited(x1, x2, y);
+    }
+};
+
+// Varredura combinada de preenchimento (Heckbert): cada span empilhado
+// é uma faixa da linha vizinha que ainda precisa ser examinada.
+template <typename Surface>
+QRect spanFill(Surface &s, const QPoint &seed) {
+    int minX = seed.x(), maxX = seed.x();
+    int minY = seed.y(), maxY = seed.y();
+
+    std::vector<Span> stack;
+    stack.push_back({seed.x(), seed.x(), seed.y(), 1});
+    stack.push_back({seed.x(), seed.x(), seed.y() - 1, -1});
+
+    while (!stack.empty()) {
+        Span span = stack.back();
+        stack.pop_back();
+
+        const int y = span.y;
+        if (y < 0 || y >= s.height) continue;
+
+        int x1 = span.x1;
+        int x2 = span.x2;
+        int x = x1;
+
+        // Estende para a esquerda a partir do início do span
+        if (s.inside(x, y)) {
+            x = s.runStart(x1, y);
+            if (x < x1) {
+                s.fillRun(x, x1 - 1, y);
+                stack.push_back({x, x1 - 1, y - span.dy, -span.dy});
+            }
+        }
+
+        while (x1 <= x2) {
+            // Preenche a sequência contínua de pixels da região
+            const int runStart = x1;
+            x1 = s.runEnd(x1, y);
+            if (x1 > runStart)
+                s.fillRun(runStart, x1 - 1, y);
+
+            if (x1 > x) {
+                minX = std::min(minX, x);
+                maxX = std::max(maxX, x1 - 1);
+                minY = std::min(minY, y);
+                maxY = std::max(maxY, y);
+                stack.push_back({x, x1 - 1, y + span.dy, span.dy});
+            }
+            if (x1 - 1 > x2)
+                stack.push_back({x2 + 1, x1 - 1, y - span.dy, -span.dy});
+
+            // Pula até o próximo pixel da região dentro do span
+            ++x1;
+            while (x1 < x2 && !s.inside(x1, y))
+                ++x1;
+            x = x1;
+        }
+    }
+
+    return QRect(QPoint(minX, minY), QPoint(maxX, maxY));
+}
+
+} // namespace
+
+QRect FloodFill::fill(QImage &image, const QPoint &seed, const QColor &color, int tolerance) {
+    PROFILE_SCOPE("bucket-fill");
+    if (image.depth() != 32 || !image.rect().contains(seed))
+        return QRect();
+
+    ImageSurface s;
+    s.bits = image.bits();
+    s.stride = image.bytesPerLine();
+    s.width = image.width();
+    s.height = image.height();
+    if (!s.prepare(s.row(seed.y())[seed.x()], TiledImage::toPixel(color, image.format()), tolerance))
+        return QRect();
+
+    return spanFill(s, seed);
+}
+
+QRect FloodFill::fill(TiledImage &image, const QPoint &seed, const QColor &color, int tolerance) {
+    PROFILE_SCOPE("bucket-fill");
+    if (!image.rect().contains(seed))
+        return QRect();
+
+    TiledSurface s;
+    s.image = &image;
+    s.width = image.width();
+    s.height = image.height();
+    s.written.assign(image.tileCount(), 0);
+    if (!s.prepare(image.pixel(seed), TiledImage::toPixel(color, image.format()), tolerance))
+        return QRect();
+
+    QRect filled = spanFill(s, seed);
+    image.compact(filled);
+    return filled;
+}
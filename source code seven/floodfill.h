@@ -0,0 +1,26 @@
+#ifndef FLOODFILL_H
+#define FLOODFILL_H
+
+#include <QColor>
+#include <QImage>
+#include <QPoint>
+#include <QRect>
+#include <QRgb>
+#include "tiledimage.h"
+
+// Preenchimento por balde baseado em spans: percorre linhas inteiras de
+// pixels de 32 bits em vez de enfileirar cada ponto, então a memória fica
+// proporcional à altura da região e não à sua área. A comparação de cores
+// usa SSE2/AVX2 quando disponível.
+class FloodFill {
+public:
+    // Pinta a região 4-conectada de cores parecidas com a da semente.
+    // tolerance é a maior diferença aceita em cada canal RGBA (0 = cor exata).
+    // Retorna o retângulo alterado (vazio se nada mudou).
+    static QRect fill(QImage &image, const QPoint &seed, const QColor &color, int tolerance = 0);
+
+    // Mesma coisa sobre uma imagem em tiles
+    static QRect fill(TiledImage &image, const QPoint &seed, const QColor &color, int tolerance = 0);
+};
+
+#endif // FLOODFILL_H
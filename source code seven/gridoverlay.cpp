@@ -0,0 +1,80 @@
+#include "gridoverlay.h"
+#include <QImage>
+#include <QPainter>
+#include <QtMath>
+
+namespace {
+
+// Mesmo desenho da antiga caneta DotLine de 1 px: um ponto a cada 3 pixels
+const int DotPeriod = 3;
+const QRgb DotColor = qRgb(192, 192, 192);  // Qt::lightGray
+
+} // namespace
+
+int GridOverlay::spacing() const {
+    return gridSpacing;
+}
+
+void GridOverlay::setSpacing(int pixels) {
+    gridSpacing = qMax(1, pixels);
+    cachedCell = 0.0;
+}
+
+void GridOverlay::rebuild(double cell) {
+    cachedCell = cell;
+
+    QImage column(1, DotPeriod, QImage::Format_ARGB32_Premultiplied);
+    column.fill(Qt::transparent);
+    column.setPixel(0, 0, DotColor);
+    vertical = QBrush(column);
+
+    QImage line(DotPeriod, 1, QImage::Format_ARGB32_Premultiplied);
+    line.fill(Qt::transparent);
+    line.setPixel(0, 0, DotColor);
+    horizontal = QBrush(line);
+
+    // O tile precisa repetir a célula e o pontilhado ao mesmo tempo
+    const int size = qRound(cell);
+    const int tileSize = size % DotPeriod == 0 ? size : size * DotPeriod;
+    tiled = qAbs(cell - size) < 1e-4 && size >= 1 && tileSize <= MaxTileSize;
+    if (!tiled)
+        return;
+
+    QImage tile(tileSize, tileSize, QImage::Format_ARGB32_Premultiplied);
+    tile.fill(Qt::transparent);
+    for (int a = 0; a < tileSize; a += size) {
+        for (int b = 0; b < tileSize; b += DotPeriod) {
+            tile.setPixel(a, b, DotColor);
+            tile.setPixel(b, a, DotColor);
+        }
+    }
+    pattern = QBrush(tile);
+}
+
+void GridOverlay::draw(QPainter &painter, const QRect &area, double zoom) {
+    if (area.isEmpty())
+        return;
+
+    // Célula pequena demais: só uma linha a cada 2, 4, 8... células
+    double cell = gridSpacing * zoom;
+    if (cell <= 0.0)
+        return;
+    while (cell < MinCell)
+        cell *= 2;
+    if (cell != cachedCell)
+        rebuild(cell);
+
+    // As texturas começam na origem da widget: linhas e pontos caem sempre
+    // no mesmo lugar, seja qual for a área repintada
+    painter.save();
+    painter.setBrushOrigin(0, 0);
+    if (tiled) {
+        painter.fillRect(area, pattern);
+    } else {
+        for (int i = qCeil(area.left() / cell); i * cell <= area.right(); ++i)
+            painter.fillRect(QRect(qRound(i * cell), area.top(), 1, area.height()), vertical);
+        for (int i = qCeil(area.top() / cell); i * cell <= area.bottom(); ++i)
+            painter.fillRect(QRect(area.left(), qRound(i * cell), area.width(), 1), horizontal);
+    }
+    painter.restore();
+}
@@ -0,0 +1,40 @@
+#ifndef GRIDOVERLAY_H
+#define GRIDOVERLAY_H
+
+#include <QBrush>
+#include <QRect>
+
+class QPainter;
+
+// Grade pontilhada do canvas, pré-desenhada. Com célula de tamanho inteiro
+// na tela, um tile com as linhas de uma célula (três, se preciso, para o
+// pontilhado fechar o período) vira um QBrush e a grade inteira é um
+// fillRect só sobre a área suja. Células grandes ou fracionárias usam
+// faixas de 1 px texturizadas, uma por linha visível. Nada é refeito
+// enquanto o tamanho da célula na tela não mudar. Com zoom pequeno a célula
+// dobra (ainda múltipla do espaçamento) até ter MinCell pixels na tela, em
+// vez de cobrir o canvas de pontos.
+class GridOverlay {
+public:
+    static const int DefaultSpacing = 20;
+    static const int MaxTileSize = 256;  // acima disso o tile gastaria mais do que as faixas
+    static const int MinCell = 4;        // menor célula desenhada, em pixels da tela
+
+    int spacing() const;
+    void setSpacing(int pixels);  // pixels da imagem por célula
+
+    // area em coordenadas da tela; o painter não pode estar transformado
+    void draw(QPainter &painter, const QRect &area, double zoom);
+
+private:
+    void rebuild(double cell);
+
+    int gridSpacing = DefaultSpacing;
+    double cachedCell = 0.0;
+    bool tiled = false;
+    QBrush pattern;     // tile de células inteiras
+    QBrush vertical;    // 1 x 3: um ponto por período do pontilhado
+    QBrush horizontal;  // 3 x 1
+};
+
+#endif // GRIDOVERLAY_H
@@ -0,0 +1,29 @@
+#include "hudoverlay.h"
+#include <QFontMetrics>
+#include <QPainter>
+
+HudOverlay::HudOverlay(QWidget *parent)
+    : QWidget(parent)
+{
+    setAttribute(Qt::WA_TransparentForMouseEvents);
+    move(Margin, Margin);
+}
+
+void HudOverlay::setLines(const QStringList &newLines) {
+    lines = newLines;
+    const QFontMetrics metrics(font());
+    resize(metrics.averageCharWidth() * 46, metrics.height() * qMax(1, lines.size()) + 8);
+    update();
+}
+
+void HudOverlay::paintEvent(QPaintEvent *) {
+    QPainter painter(this);
+    painter.fillRect(rect(), QColor(0, 0, 0, 170));
+    painter.setPen(Qt::white);
+    const QFontMetrics metrics(font());
+    int y = 4 + metrics.ascent();
+    for (const QString &line : lines) {
+        painter.drawText(6, y, line);
+        y += metrics.height();
+    }
+}
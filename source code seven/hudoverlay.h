@@ -0,0 +1,26 @@
+#ifndef HUDOVERLAY_H
+#define HUDOVERLAY_H
+
+#include <QStringList>
+#include <QWidget>
+
+// Caixa do HUD de desempenho. É filha do viewport do QScrollArea, irmã do
+// canvas e por cima dele: fica parada no canto enquanto a imagem rola e
+// nunca é pintada nos pixels do canvas. Não recebe o mouse.
+class HudOverlay : public QWidget {
+public:
+    static const int Margin = 8;  // distância do canto do viewport
+
+    explicit HudOverlay(QWidget *parent);
+
+    // Troca o texto e ajusta o tamanho da caixa
+    void setLines(const QStringList &lines);
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+
+private:
+    QStringList lines;
+};
+
+#endif // HUDOVERLAY_H
@@ -0,0 +1,65 @@
+#include "imageexporter.h"
+#include "pngwriter.h"
+#include <QCoreApplication>
+#include <QEvent>
+#include <QMetaObject>
+
+ImageExporter::ImageExporter(QObject *parent)
+    : QObject(parent)
+{
+    // Gravações em fila, uma de cada vez; a compressão em si usa o pool global
+    workers.setMaxThreadCount(1);
+}
+
+ImageExporter::~ImageExporter() {
+    workers.waitForDone();
+}
+
+void ImageExporter::start(const TiledImage &image, const QString &path, const QByteArray &format) {
+    run(path, [image, path, format](const std::function<void(int)> &report) {
+        return write(image, path, format, report);
+    });
+}
+
+bool ImageExporter::write(const TiledImage &image, const QString &path, const QByteArray &format,
+                          const std::function<void(int)> &progress) {
+    if (format.toLower() == "png")
+        return PngWriter::write(image, path, progress);
+
+    const bool ok = image.toImage().save(path, format.toUpper().constData());
+    if (progress)
+        progress(100);
+    return ok;
+}
+
+void ImageExporter::startProject(const ProjectFile::Contents &contents, const QString &path) {
+    run(path, [contents, path](const std::function<void(int)> &report) {
+        return ProjectFile::save(contents, path, report);
+    });
+}
+
+void ImageExporter::run(const QString &path, const std::function<bool(const std::function<void(int)> &)> &job) {
+    ++pending;
+    workers.start([this, path, job] {
+        const auto report = [this](int percent) {
+            QMetaObject::invokeMethod(this, [this, percent] { emit progress(percent); }, Qt::QueuedConnection);
+        };
+
+        const bool ok = job(report);
+
+        QMetaObject::invokeMethod(this, [this, path, ok] {
+            --pending;
+            emit finished(path, ok);
+        }, Qt::QueuedConnection);
+    });
+}
+
+bool ImageExporter::isBusy() const {
+    return pending > 0;
+}
+
+void ImageExporter::waitForDone() {
+    workers.waitForDone();
+    // Os resultados chegam como chamadas enfileiradas: entrega aqui mesmo
+    QCoreApplication::sendPostedEvents(this, QEvent::MetaCall);
+}
@@ -0,0 +1,44 @@
+#ifndef IMAGEEXPORTER_H
+#define IMAGEEXPORTER_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QString>
+#include <QThreadPool>
+#include <functional>
+#include "tiledimage.h"
+#include "projectfile.h"
+
+// Salva imagens em segundo plano. Recebe um TiledImage por valor: os tiles
+// ficam compartilhados com o canvas, e qualquer edição feita durante a
+// gravação copia só o tile alterado. PNG usa o PngWriter paralelo, .lpaint
+// o ProjectFile; os outros formatos achatam a imagem e usam QImage::save.
+class ImageExporter : public QObject {
+    Q_OBJECT
+
+public:
+    explicit ImageExporter(QObject *parent = nullptr);
+    ~ImageExporter() override;  // espera as gravações pendentes
+
+    void start(const TiledImage &image, const QString &path, const QByteArray &format);
+    void startProject(const ProjectFile::Contents &contents, const QString &path);
+    bool isBusy() const;
+    // Espera as gravações na fila e entrega progress/finished antes de voltar
+    void waitForDone();
+
+    // Gravação síncrona, na thread que chamar (usada pelo worker e pelo modo --headless)
+    static bool write(const TiledImage &image, const QString &path, const QByteArray &format,
+                      const std::function<void(int)> &progress = nullptr);
+
+signals:
+    void progress(int percent);
+    void finished(const QString &path, bool ok);
+
+private:
+    void run(const QString &path, const std::function<bool(const std::function<void(int)> &)> &job);
+
+    QThreadPool workers;
+    int pending = 0;
+};
+
+#endif // IMAGEEXPORTER_H
@@ -0,0 +1,93 @@
+#include "imageloader.h"
+#include "profiler.h"
+#include <QImageReader>
+#include <QMetaObject>
+
+ImageLoader::ImageLoader(QObject *parent)
+    : QObject(parent)
+{
+    // Uma decodificação por vez: a nova só começa quando a anterior desiste
+    workers.setMaxThreadCount(1);
+}
+
+ImageLoader::~ImageLoader() {
+    cancel();
+    workers.waitForDone();
+}
+
+void ImageLoader::load(const QString &path) {
+    const int job = generation.fetchAndAddOrdered(1) + 1;
+    loading = true;
+    workers.clear();
+    workers.start([this, path, job] { decode(path, job); });
+}
+
+void ImageLoader::cancel() {
+    generation.fetchAndAddOrdered(1);
+    workers.clear();
+    loading = false;
+}
+
+bool ImageLoader::isLoading() const {
+    return loading;
+}
+
+// Roda no worker
+void ImageLoader::decode(const QString &path, int job) {
+    PROFILE_SCOPE("image-decode");
+    QImageReader probe(path);
+    probe.setAutoTransform(true);
+    const QSize fullSize = probe.size();
+
+    // Prévia: só quando o decodificador reduz sozinho, senão custaria o
+    // mesmo que a imagem inteira; sem ela a interface mostra o tamanho final
+    if (fullSize.isValid() && probe.supportsOption(QImageIOHandler::ScaledSize)
+        && qMax(fullSize.width(), fullSize.height()) > PreviewSize) {
+        probe.setScaledSize(fullSize.scaled(PreviewSize, PreviewSize, Qt::KeepAspectRatio));
+        const QImage preview = probe.read();
+        deliver(job, [this, preview, fullSize] { emit previewReady(preview, fullSize); });
+    } else if (fullSize.isValid()) {
+        deliver(job, [this, fullSize] { emit previewReady(QImage(), fullSize); });
+    }
+
+    if (generation.loadAcquire() != job)
+        return;
+
+    QString error;
+    const TiledImage tiled = read(path, &error);
+    if (tiled.isNull()) {
+        deliver(job, [this, path, error] {
+            loading = false;
+            emit failed(path, error);
+        });
+        return;
+    }
+
+    deliver(job, [this, tiled] {
+        loading = false;
+        emit loaded(tiled);
+    });
+}
+
+TiledImage ImageLoader::read(const QString &path, QString *error) {
+    QImageReader reader(path);
+    reader.setAutoTransform(true);
+    QImage image = reader.read();
+    if (image.isNull()) {
+        if (error)
+            *error = reader.errorString();
+        return TiledImage();
+    }
+
+    // Converte no lugar (já no formato interno) e divide em tiles ainda na thread que leu
+    image.convertTo(TiledImage::LayerFormat);
+    return TiledImage::fromImage(image);
+}
+
+void ImageLoader::deliver(int job, const std::function<void()> &action) {
+    // Entrega na thread do objeto, a menos que outro load() tenha começado
+    QMetaObject::invokeMethod(this, [this, job, action] {
+        if (generation.loadAcquire() == job)
+            action();
+    }, Qt::QueuedConnection);
+}
@@ -0,0 +1,46 @@
+#ifndef IMAGELOADER_H
+#define IMAGELOADER_H
+
+#include <QObject>
+#include <QImage>
+#include <QSize>
+#include <QString>
+#include <QThreadPool>
+#include <functional>
+#include "tiledimage.h"
+
+// Abre imagens fora da thread da interface. Primeiro sai uma prévia
+// reduzida (quando o formato decodifica direto em escala menor, como JPEG),
+// depois a imagem inteira já convertida em tiles. Os sinais chegam sempre
+// na thread do objeto; um load() novo descarta o anterior.
+class ImageLoader : public QObject {
+    Q_OBJECT
+
+public:
+    static const int PreviewSize = 1024;  // maior lado da prévia
+
+    explicit ImageLoader(QObject *parent = nullptr);
+    ~ImageLoader() override;
+
+    void load(const QString &path);
+    // Leitura síncrona, na thread que chamar (usada pelo worker e pelo modo --headless)
+    static TiledImage read(const QString &path, QString *error = nullptr);
+    void cancel();
+    bool isLoading() const;
+
+signals:
+    // preview pode ser nula quando o formato não decodifica em escala reduzida
+    void previewReady(const QImage &preview, const QSize &fullSize);
+    void loaded(const TiledImage &image);
+    void failed(const QString &path, const QString &error);
+
+private:
+    void decode(const QString &path, int job);
+    void deliver(int job, const std::function<void()> &action);
+
+    QThreadPool workers;
+    QAtomicInt generation;
+    bool loading = false;
+};
+
+#endif // IMAGELOADER_H
@@ -0,0 +1,309 @@
+#include "inputrecorder.h"
+#include <QtEndian>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+const int FlushSize = 64 * 1024;
+
+// Quantos inteiros seguem cada comando no log
+int argumentCount(InputRecorder::Command command) {
+    switch (command) {
+    case InputRecorder::Command::Rotate:
+    case InputRecorder::Command::RemoveLayer:
+    case InputRecorder::Command::SelectLayer:
+    case InputRecorder::Command::JumpHistory:
+        return 1;
+    case InputRecorder::Command::Resize:
+    case InputRecorder::Command::MoveLayer:
+    case InputRecorder::Command::LayerOpacity:
+    case InputRecorder::Command::LayerVisible:
+    case InputRecorder::Command::LayerMode:
+        return 2;
+    default:
+        return 0;
+    }
+}
+
+void putVarint(QByteArray &out, quint64 value) {
+    while (value >= 0x80) {
+        out.append(char(value | 0x80));
+        value >>= 7;
+    }
+    out.append(char(value));
+}
+
+// Zigzag: números pequenos com sinal viram varints curtos
+void putSigned(QByteArray &out, qint64 value) {
+    putVarint(out, (quint64(value) << 1) ^ quint64(value >> 63));
+}
+
+void putString(QByteArray &out, const QString &text) {
+    const QByteArray utf8 = text.toUtf8();
+    putVarint(out, quint64(utf8.size()));
+    out.append(utf8);
+}
+
+void putDouble(QByteArray &out, double value) {
+    quint64 bits;
+    std::memcpy(&bits, &value, sizeof bits);
+    out.append(reinterpret_cast<const char *>(&bits), sizeof bits);
+}
+
+QByteArray serializeTool(const Tool &tool) {
+    QByteArray out;
+    out.append(char(tool.type()));
+    putVarint(out, tool.outlineColor().rgba());
+    putVarint(out, tool.fillColor().rgba());
+    out.append(char(tool.fillEnabled()));
+    putSigned(out, tool.thickness());
+    putDouble(out, tool.opacity());
+    putSigned(out, tool.tolerance());
+    putString(out, tool.font().toString());
+    return out;
+}
+
+// Leitura sequencial; qualquer erro marca o leitor como inválido
+struct Reader {
+    const QByteArray &data;
+    int pos = 0;
+    bool ok = true;
+
+    bool atEnd() const { return pos >= data.size(); }
+
+    quint8 byte() {
+        if (pos >= data.size()) {
+            ok = false;
+            return 0;
+        }
+        return quint8(data[pos++]);
+    }
+
+    quint64 varint() {
+        quint64 value = 0;
+        for (int shift = 0; shift < 64 && ok; shift += 7) {
+            const quint8 b = byte();
+            value |= quint64(b & 0x7f) << shift;
+            if (!(b & 0x80))
+                return value;
+        }
+        ok = false;
+        return 0;
+    }
+
+    qint64 signedVarint() {
+        const quint64 v = varint();
+        return qint64(v >> 1) ^ -qint64(v & 1);
+    }
+
+    QByteArray bytes(int size) {
+        if (size < 0 || pos + size > data.size()) {
+            ok = false;
+            return QByteArray();
+        }
+        const QByteArray out = data.mid(pos, size);
+        pos += size;
+        return out;
+    }
+
+    QString string() {
+        return QString::fromUtf8(bytes(int(varint())));
+    }
+
+    double real() {
+        const QByteArray raw = bytes(8);
+        double value = 0;
+        if (ok)
+            std::memcpy(&value, raw.constData(), sizeof value);
+        return value;
+    }
+
+    Tool tool() {
+        Tool tool;
+        tool.setType(ToolType(byte()));
+        tool.setOutlineColor(QColor::fromRgba(QRgb(varint())));
+        tool.setFillColor(QColor::fromRgba(QRgb(varint())));
+        tool.setFillEnabled(byte() != 0);
+        tool.setThickness(int(signedVarint()));
+        tool.setOpacity(float(real()));
+        tool.setTolerance(int(signedVarint()));
+        QFont font;
+        font.fromString(string());
+        tool.setFont(font);
+        return tool;
+    }
+};
+
+} // namespace
+
+InputRecorder::~InputRecorder() {
+    stop();
+}
+
+bool InputRecorder::start(const QString &path) {
+    stop();
+    file.setFileName(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+
+    buffer.clear();
+    uchar header[8];
+    qToLittleEndian(Magic, header);
+    qToLittleEndian(Version, header + 4);
+    buffer.append(reinterpret_cast<const char *>(header), sizeof header);
+
+    lastTime = 0;
+    lastPos = QPointF();
+    lastTool.clear();
+    clock.start();
+    return true;
+}
+
+void InputRecorder::stop() {
+    if (!file.isOpen())
+        return;
+    flush();
+    file.close();
+}
+
+bool InputRecorder::isRecording() const {
+    return file.isOpen();
+}
+
+void InputRecorder::begin(Kind kind) {
+    const qint64 now = clock.nsecsElapsed() / 1000;
+    buffer.append(char(kind));
+    putVarint(buffer, quint64(now - lastTime));
+    lastTime = now;
+}
+
+void InputRecorder::mouse(Kind kind, const QPointF &pos, int button, int buttons) {
+    if (!isRecording())
+        return;
+
+    begin(kind);
+    const long dx = std::lround((pos.x() - lastPos.x()) * 16);
+    const long dy = std::lround((pos.y() - lastPos.y()) * 16);
+    putSigned(buffer, dx);
+    putSigned(buffer, dy);
+    // A referência é a posição já arredondada, para o erro não acumular
+    lastPos += QPointF(dx / 16.0, dy / 16.0);
+    if (kind != Kind::Move)
+        buffer.append(char(button));
+    buffer.append(char(buttons));
+
+    if (buffer.size() > FlushSize)
+        flush();
+}
+
+void InputRecorder::tool(const Tool &tool) {
+    if (!isRecording())
+        return;
+
+    const QByteArray serialized = serializeTool(tool);
+    if (serialized == lastTool)
+        return;
+    lastTool = serialized;
+
+    begin(Kind::Tool);
+    buffer.append(serialized);
+}
+
+void InputRecorder::zoom(double factor) {
+    if (!isRecording())
+        return;
+    begin(Kind::Zoom);
+    putDouble(buffer, factor);
+}
+
+void InputRecorder::text(const QString &text) {
+    if (!isRecording())
+        return;
+    begin(Kind::Text);
+    putString(buffer, text);
+}
+
+void InputRecorder::command(Command command, int arg1, int arg2) {
+    if (!isRecording())
+        return;
+    begin(Kind::Command);
+    buffer.append(char(command));
+    if (argumentCount(command) >= 1)
+        putSigned(buffer, arg1);
+    if (argumentCount(command) >= 2)
+        putSigned(buffer, arg2);
+}
+
+void InputRecorder::flush() {
+    file.write(buffer);
+    file.flush();
+    buffer.clear();
+}
+
+bool InputRecorder::load(const QString &path, QVector<Event> &events, QString *error) {
+    QFile in(path);
+    if (!in.open(QIODevice::ReadOnly)) {
+        if (error)
+            *error = in.errorString();
+        return false;
+    }
+    const QByteArray data = in.readAll();
+    if (data.size() < 8 || qFromLittleEndian<quint32>(data.constData()) != Magic
+        || qFromLittleEndian<quint32>(data.constData() + 4) > Version) {
+        if (error)
+            *error = "not an input log";
+        return false;
+    }
+
+    Reader reader{data, 8};
+    qint64 time = 0;
+    QPointF pos;
+    events.clear();
+    while (!reader.atEnd()) {
+        Event event;
+        event.kind = Kind(reader.byte());
+        time += qint64(reader.varint());
+        event.time = time;
+
+        switch (event.kind) {
+        case Kind::Press:
+        case Kind::Move:
+        case Kind::Release: {
+            const qint64 dx = reader.signedVarint();
+            const qint64 dy = reader.signedVarint();
+            pos += QPointF(dx / 16.0, dy / 16.0);
+            event.pos = pos;
+            if (event.kind != Kind::Move)
+                event.button = reader.byte();
+            event.buttons = reader.byte();
+            break;
+        }
+        case Kind::Tool:
+            event.tool = reader.tool();
+            break;
+        case Kind::Zoom:
+            event.zoom = reader.real();
+            break;
+        case Kind::Text:
+            event.text = reader.string();
+            break;
+        case Kind::Command:
+            event.command = Command(reader.byte());
+            if (argumentCount(event.command) >= 1)
+                event.arg1 = int(reader.signedVarint());
+            if (argumentCount(event.command) >= 2)
+                event.arg2 = int(reader.signedVarint());
+            break;
+        default:
+            reader.ok = false;
+            break;
+        }
+
+        // Log cortado (gravação interrompida): fica com o que veio inteiro
+        if (!reader.ok)
+            break;
+        events.append(event);
+    }
+    return true;
+}
@@ -0,0 +1,75 @@
+#ifndef INPUTRECORDER_H
+#define INPUTRECORDER_H
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QPointF>
+#include <QString>
+#include <QVector>
+#include "tool.h"
+
+// Grava a entrada do canvas (mouse, ferramenta, zoom, texto e comandos de
+// edição) com o instante de cada evento, para reproduzir travadas e medir
+// latência depois com o InputReplayer.
+//
+// O log é binário e compacto: cada registro é o tipo (1 byte), o tempo desde
+// o registro anterior em microssegundos e o conteúdo. Inteiros vão em varint
+// e as posições como diferença da anterior, em 1/16 de pixel; a ferramenta
+// só é gravada quando muda.
+class InputRecorder {
+public:
+    static const quint32 Magic = 0x4c504952;  // "LPIR"
+    static const quint32 Version = 1;
+
+    enum class Kind : quint8 { Press, Move, Release, Tool, Zoom, Text, Command };
+
+    enum class Command : quint8 {
+        Undo, Redo, Clear, Copy, Cut, Paste, Apply,
+        FlipHorizontal, FlipVertical, Rotate, Resize,
+        AddLayer, RemoveLayer, MoveLayer, SelectLayer, LayerOpacity, LayerVisible, LayerMode,
+        JumpHistory,
+    };
+
+    struct Event {
+        Kind kind = Kind::Move;
+        qint64 time = 0;     // microssegundos desde o início da gravação
+        QPointF pos;         // coordenadas da widget
+        quint8 button = 0;   // Qt::MouseButton
+        quint8 buttons = 0;  // Qt::MouseButtons
+        Tool tool;
+        double zoom = 1.0;
+        QString text;        // vazio: o diálogo de texto foi cancelado
+        Command command = Command::Undo;
+        int arg1 = 0;        // ângulo do Rotate, largura do Resize, índice da camada, nó do histórico
+        int arg2 = 0;        // altura do Resize, destino/opacidade (%)/visível/modo da camada
+    };
+
+    ~InputRecorder();
+
+    bool start(const QString &path);
+    void stop();
+    bool isRecording() const;
+
+    void mouse(Kind kind, const QPointF &pos, int button, int buttons);
+    void tool(const Tool &tool);
+    void zoom(double factor);
+    void text(const QString &text);
+    void command(Command command, int arg1 = 0, int arg2 = 0);
+
+    // Lê um log inteiro (tempos já acumulados desde o início)
+    static bool load(const QString &path, QVector<Event> &events, QString *error = nullptr);
+
+private:
+    void begin(Kind kind);
+    void flush();
+
+    QFile file;
+    QByteArray buffer;
+    QElapsedTimer clock;
+    qint64 lastTime = 0;
+    QPointF lastPos;
+    QByteArray lastTool;  // ferramenta serializada, para gravar só mudanças
+};
+
+#endif // INPUTRECORDER_H
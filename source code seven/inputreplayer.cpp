@@ -0,0 +1,171 @@
+#include "inputreplayer.h"
+#include "canvaswidget.h"
+#include <QCoreApplication>
+#include <QMouseEvent>
+#include <QTimer>
+#include <algorithm>
+
+namespace {
+
+const qint64 FrameWindow = 16000;  // µs de tempo gravado por quadro no modo Maximum
+
+double percentile(QVector<double> values, double p) {
+    if (values.isEmpty())
+        return 0.0;
+    std::sort(values.begin(), values.end());
+    return values[qMin(values.size() - 1, int(p * values.size()))];
+}
+
+} // namespace
+
+QString InputReplayer::Stats::toString() const {
+    return QString("%1 events, %2 frames in %3 ms\n"
+                   "paint: p50 %4 ms, p95 %5 ms, p99 %6 ms, max %7 ms\n"
+                   "input to frame: p50 %8 ms, p95 %9 ms, max %10 ms")
+        .arg(events).arg(frames).arg(totalMs)
+        .arg(frameP50, 0, 'f', 2).arg(frameP95, 0, 'f', 2).arg(frameP99, 0, 'f', 2).arg(frameMax, 0, 'f', 2)
+        .arg(latencyP50, 0, 'f', 2).arg(latencyP95, 0, 'f', 2).arg(latencyMax, 0, 'f', 2);
+}
+
+InputReplayer::InputReplayer(CanvasWidget *canvas, QObject *parent)
+    : QObject(parent),
+      canvas(canvas)
+{
+    connect(canvas, &CanvasWidget::frameDrawn, this, &InputReplayer::frameDrawn);
+}
+
+bool InputReplayer::start(const QString &path, Speed replaySpeed, QString *error) {
+    stop();
+    if (!InputRecorder::load(path, events, error))
+        return false;
+
+    speed = replaySpeed;
+    next = 0;
+    pendingSince = -1;
+    frameTimes.clear();
+    latencies.clear();
+    running = true;
+    clock.start();
+    QTimer::singleShot(0, this, &InputReplayer::step);
+    return true;
+}
+
+void InputReplayer::stop() {
+    running = false;
+}
+
+bool InputReplayer::isRunning() const {
+    return running;
+}
+
+void InputReplayer::step() {
+    if (!running)
+        return;
+
+    if (speed == Speed::Maximum) {
+        // Um quadro do tempo gravado de uma vez, e desenha na hora
+        const qint64 windowEnd = (events.value(next).time / FrameWindow + 1) * FrameWindow;
+        while (next < events.size() && events[next].time < windowEnd)
+            dispatch(next++);
+        canvas->repaint();
+    } else {
+        const qint64 now = clock.nsecsElapsed() / 1000;
+        while (next < events.size() && events[next].time <= now)
+            dispatch(next++);
+    }
+
+    if (next >= events.size()) {
+        finish();
+        return;
+    }
+
+    const qint64 wait = speed == Speed::Maximum
+                        ? 0 : qMax<qint64>(0, (events[next].time - clock.nsecsElapsed() / 1000) / 1000);
+    QTimer::singleShot(int(wait), Qt::PreciseTimer, this, &InputReplayer::step);
+}
+
+void InputReplayer::dispatch(int index) {
+    const InputRecorder::Event &event = events[index];
+    if (pendingSince < 0)
+        pendingSince = clock.nsecsElapsed();
+
+    switch (event.kind) {
+    case InputRecorder::Kind::Press:
+    case InputRecorder::Kind::Move:
+    case InputRecorder::Kind::Release: {
+        // O texto digitado no diálogo vem logo depois do clique. Sem ele (logs
+        // antigos) o diálogo foi cancelado: o replay nunca abre o diálogo
+        if (event.kind == InputRecorder::Kind::Press) {
+            const bool typed = index + 1 < events.size() && events[index + 1].kind == InputRecorder::Kind::Text;
+            canvas->queueText(typed ? events[index + 1].text : QString());
+        }
+
+        const QEvent::Type type = event.kind == InputRecorder::Kind::Press ? QEvent::MouseButtonPress
+                                : event.kind == InputRecorder::Kind::Move ? QEvent::MouseMove
+                                : QEvent::MouseButtonRelease;
+        QMouseEvent mouse(type, event.pos, Qt::MouseButton(event.button),
+                          Qt::MouseButtons(event.buttons), Qt::NoModifier);
+        QCoreApplication::sendEvent(canvas, &mouse);
+        break;
+    }
+    case InputRecorder::Kind::Tool:
+        canvas->setActiveTool(event.tool);
+        break;
+    case InputRecorder::Kind::Zoom:
+        canvas->setZoomFactor(event.zoom);
+        break;
+    case InputRecorder::Kind::Text:
+        break;  // já entregue junto com o clique
+    case InputRecorder::Kind::Command:
+        switch (event.command) {
+        case InputRecorder::Command::Undo:           canvas->undo(); break;
+        case InputRecorder::Command::Redo:           canvas->redo(); break;
+        case InputRecorder::Command::JumpHistory:    canvas->jumpToHistory(event.arg1); break;
+        case InputRecorder::Command::Clear:          canvas->clearCanvas(); break;
+        case InputRecorder::Command::Copy:           canvas->copySelection(); break;
+        case InputRecorder::Command::Cut:            canvas->cutSelection(); break;
+        case InputRecorder::Command::Paste:          canvas->pasteSelection(); break;
+        case InputRecorder::Command::Apply:          canvas->applySelection(); break;
+        case InputRecorder::Command::FlipHorizontal: canvas->flipSelectionHorizontal(); break;
+        case InputRecorder::Command::FlipVertical:   canvas->flipSelectionVertical(); break;
+        case InputRecorder::Command::Rotate:         canvas->rotateSelection(event.arg1); break;
+        case InputRecorder::Command::Resize:         canvas->resizeCanvas(event.arg1, event.arg2); break;
+        case InputRecorder::Command::AddLayer:       canvas->addLayer(); break;
+        case InputRecorder::Command::RemoveLayer:    canvas->removeLayer(event.arg1); break;
+        case InputRecorder::Command::MoveLayer:      canvas->moveLayer(event.arg1, event.arg2); break;
+        case InputRecorder::Command::SelectLayer:    canvas->setActiveLayer(event.arg1); break;
+        case InputRecorder::Command::LayerOpacity:   canvas->setLayerOpacity(event.arg1, event.arg2); break;
+        case InputRecorder::Command::LayerVisible:   canvas->setLayerVisible(event.arg1, event.arg2 != 0); break;
+        case InputRecorder::Command::LayerMode:      canvas->setLayerBlendMode(event.arg1, BlendMode(event.arg2)); break;
+        }
+        break;
+    }
+}
+
+void InputReplayer::frameDrawn(qint64 nsecs) {
+    if (!running)
+        return;
+    frameTimes.append(nsecs / 1e6);
+    if (pendingSince >= 0) {
+        latencies.append((clock.nsecsElapsed() - pendingSince) / 1e6);
+        pendingSince = -1;
+    }
+}
+
+void InputReplayer::finish() {
+    canvas->repaint();  // o que ainda estiver pendente entra na conta
+    running = false;
+
+    Stats stats;
+    stats.events = events.size();
+    stats.frames = frameTimes.size();
+    stats.totalMs = clock.elapsed();
+    stats.frameP50 = percentile(frameTimes, 0.50);
+    stats.frameP95 = percentile(frameTimes, 0.95);
+    stats.frameP99 = percentile(frameTimes, 0.99);
+    stats.frameMax = percentile(frameTimes, 1.0);
+    stats.latencyP50 = percentile(latencies, 0.50);
+    stats.latencyP95 = percentile(latencies, 0.95);
+    stats.latencyMax = percentile(latencies, 1.0);
+    emit finished(stats);
+}
@@ -0,0 +1,60 @@
+#ifndef INPUTREPLAYER_H
+#define INPUTREPLAYER_H
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QString>
+#include <QVector>
+#include "inputrecorder.h"
+
+class CanvasWidget;
+
+// Reproduz um log do InputRecorder numa CanvasWidget e mede cada quadro.
+// Em Original os eventos saem nos instantes gravados e o laço de eventos
+// desenha como faria com o mouse. Em Maximum saem sem espera, agrupados
+// pelas janelas de 16 ms do tempo gravado, com um repaint() síncrono no fim
+// de cada grupo: o mesmo trabalho por quadro, no menor tempo possível.
+class InputReplayer : public QObject {
+    Q_OBJECT
+
+public:
+    enum class Speed { Original, Maximum };
+
+    struct Stats {
+        int events = 0;
+        int frames = 0;
+        qint64 totalMs = 0;
+        double frameP50 = 0, frameP95 = 0, frameP99 = 0, frameMax = 0;  // paintEvent, ms
+        double latencyP50 = 0, latencyP95 = 0, latencyMax = 0;          // evento até o fim do quadro, ms
+
+        QString toString() const;
+    };
+
+    explicit InputReplayer(CanvasWidget *canvas, QObject *parent = nullptr);
+
+    bool start(const QString &path, Speed speed, QString *error = nullptr);
+    void stop();
+    bool isRunning() const;
+
+signals:
+    void finished(const InputReplayer::Stats &stats);
+
+private:
+    void step();
+    void dispatch(int index);
+    void frameDrawn(qint64 nsecs);
+    void finish();
+
+    CanvasWidget *canvas;
+    QVector<InputRecorder::Event> events;
+    Speed speed = Speed::Original;
+    int next = 0;
+    bool running = false;
+
+    QElapsedTimer clock;
+    qint64 pendingSince = -1;  // primeiro evento ainda não desenhado (ns)
+    QVector<double> frameTimes;
+    QVector<double> latencies;
+};
+
+#endif // INPUTREPLAYER_H
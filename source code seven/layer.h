@@ -0,0 +1,20 @@
+#ifndef LAYER_H
+#define LAYER_H
+
+#include <QString>
+#include "blend.h"
+#include "tiledimage.h"
+
+// Uma camada do documento: pixels em TiledImage::LayerFormat, todas do
+// tamanho do documento, misturadas de baixo para cima sobre o fundo
+struct Layer {
+    QString name;
+    TiledImage image;
+    qreal opacity = 1.0;
+    bool visible = true;
+    BlendMode mode = BlendMode::Normal;
+
+    int opacity255() const { return visible ? qBound(0, qRound(opacity * 255), 255) : 0; }
+};
+
+#endif // LAYER_H
@@ -1,19 +1,73 @@
 #include <QApplication>
 #include <QDebug>
 #include <QGuiApplication>
+#include <QMessageBox>
 #include "mainwindow.h"
+#include "recoveryjournal.h"
+#include "batchrunner.h"
+#include "profiler.h"
+#include <cstring>
 
 int main(int argc, char *argv[]) {
     qDebug() << "🔧 Iniciando LittlePaint...";
 
+    // --headless: roteiro em lote sem janela (servidores de render, CI)
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--headless") == 0) {
+            qputenv("QT_QPA_PLATFORM", "offscreen");
+            QGuiApplication app(argc, argv);
+            app.setApplicationName("LittlePaint");
+            return BatchRunner::exec(app.arguments());
+        }
+    }
+
     QApplication app(argc, argv);
     app.setApplicationName("LittlePaint");
 
     qDebug() << "🖥️ Plataforma gráfica:" << QGuiApplication::platformName();
 
+    // --trace <arquivo>: mede desde o início e grava o trace do Chrome ao sair
+    const int traceIndex = app.arguments().indexOf("--trace");
+    if (traceIndex > 0 && traceIndex + 1 < app.arguments().size()) {
+        const QString tracePath = app.arguments()[traceIndex + 1];
+        Profiler::setEnabled(true);
+        QObject::connect(&app, &QCoreApplication::aboutToQuit, [tracePath]() {
+            QString error;
+            if (Profiler::writeChromeTrace(tracePath, &error))
+                qDebug() << "📈 Trace gravado em" << tracePath;
+            else
+                qWarning() << "❌ Não foi possível gravar o trace:" << error;
+        });
+    }
+
     try {
         MainWindow window;
         qDebug() << "✅ MainWindow construído com sucesso.";
+
+        // --replay <log> [--max-speed]: reproduz a entrada gravada, imprime as medidas e sai
+        const QStringList args = app.arguments();
+        const int replayIndex = args.indexOf("--replay");
+        if (replayIndex > 0 && replayIndex + 1 < args.size()) {
+            window.show();
+            if (!window.replayInput(args[replayIndex + 1], args.contains("--max-speed"), true))
+                return 1;
+            return app.exec();
+        }
+
+        // Diários órfãos: a última execução não fechou direito
+        const QStringList journals = RecoveryJournal::orphanedJournals();
+        if (!journals.isEmpty()) {
+            qDebug() << "🩹 Diário de recuperação encontrado:" << journals.first();
+            const QMessageBox::StandardButton reply = QMessageBox::question(
+                nullptr, "Recover",
+                "LittlePaint did not close properly. Recover the unsaved drawing?",
+                QMessageBox::Yes | QMessageBox::No);
+            if (reply == QMessageBox::Yes && !window.recoverFrom(journals.first()))
+                QMessageBox::warning(nullptr, "Recover", "The recovery journal could not be read.");
+            for (const QString &journal : journals)
+                RecoveryJournal::remove(journal);
+        }
+
         window.show();
         qDebug() << "🚀 Interface exibida. Executando loop principal...";
         return app.exec();
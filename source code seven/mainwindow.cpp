@@ -1,6 +1,8 @@
 #include "mainwindow.h"
 #include "canvaswidget.h"
 #include "tool.h"
+#include "inputreplayer.h"
+#include "profiler.h"
 
 #include <QApplication>
 #include <QMenuBar>
@@ -9,6 +11,7 @@
 #include <QFileDialog>
 #include <QInputDialog>
 #include <QMessageBox>
+#include <QStatusBar>
 #include <QScrollArea>
 #include <QFontComboBox>
 #include <QSpinBox>
@@ -18,8 +21,16 @@
 #include <QVBoxLayout>
 #include <QPushButton>
 #include <QLabel>
+#include <QComboBox>
+#include <QDockWidget>
+#include <QHBoxLayout>
+#include <QListWidget>
+#include <QPixmap>
+#include <QSlider>
 #include <QCloseEvent>
 #include <QDebug>
+#include <QFileInfo>
+#include <QTextStream>
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent),
@@ -29,6 +40,9 @@ MainWindow::MainWindow(QWidget *parent)
       fillEnabled(false),
       thickness(2),
       opacity(1.0f),
+      tolerance(0),
+      historyBudgetMB(1024),
+      gridSpacing(GridOverlay::DefaultSpacing),
       fontSize(12),
       boldEnabled(false),
       italicEnabled(false)
@@ -44,12 +58,30 @@ MainWindow::MainWindow(QWidget *parent)
     connect(canvas, &CanvasWidget::colorPicked, this, &MainWindow::setColorFromEyedropper);
     connect(canvas, &CanvasWidget::outlineColorPicked, this, &MainWindow::setOutlineColorFromEyedropper);
     connect(canvas, &CanvasWidget::fillColorPicked, this, &MainWindow::setFillColorFromEyedropper);
+    connect(canvas, &CanvasWidget::openFailed, this, &MainWindow::imageOpenFailed);
+    connect(canvas, &CanvasWidget::exportProgress, this, &MainWindow::exportProgress);
+    connect(canvas, &CanvasWidget::exportFinished, this, &MainWindow::exportFinished);
+    connect(canvas, &CanvasWidget::layersChanged, this, &MainWindow::updateLayersDock);
+    connect(canvas, &CanvasWidget::historyChanged, this, &MainWindow::updateHistoryDock);
+    connect(canvas, &CanvasWidget::historyThumbnailReady, this, &MainWindow::setHistoryThumbnail);
+    connect(canvas, &CanvasWidget::historyThumbnailEvicted, this, &MainWindow::dropHistoryThumbnail);
+
+    replayer = new InputReplayer(canvas, this);
+
+    // Progresso da gravação em segundo plano, escondido quando não há nenhuma
+    exportBar = new QProgressBar(this);
+    exportBar->setRange(0, 100);
+    exportBar->setMaximumWidth(200);
+    exportBar->hide();
+    statusBar()->addPermanentWidget(exportBar);
 
     currentFont = QFont("Arial", fontSize);
     currentFont.setBold(boldEnabled);
     currentFont.setItalic(italicEnabled);
 
     createActions();
+    createLayersDock();
+    createHistoryDock();
     createMenus();
     createToolbars();
     updateTool();
@@ -195,6 +227,33 @@ void MainWindow::createActions() {
 
     rotateRAct = new QAction("Rotate Right", this);
     connect(rotateRAct, &QAction::triggered, this, &MainWindow::rotateRight);
+
+    // Depuração
+    recordAct = new QAction("Record Input", this);
+    recordAct->setCheckable(true);
+    connect(recordAct, &QAction::toggled, this, &MainWindow::toggleRecording);
+
+    replayAct = new QAction("Replay Input...", this);
+    connect(replayAct, &QAction::triggered, this, [=]() { chooseReplay(false); });
+
+    replayMaxAct = new QAction("Replay Input (Max Speed)...", this);
+    connect(replayMaxAct, &QAction::triggered, this, [=]() { chooseReplay(true); });
+
+    profilingAct = new QAction("Profiling", this);
+    profilingAct->setCheckable(true);
+    profilingAct->setChecked(Profiler::isEnabled());
+    connect(profilingAct, &QAction::toggled, this, &MainWindow::toggleProfiling);
+
+    hudAct = new QAction("Performance HUD", this);
+    hudAct->setCheckable(true);
+    connect(hudAct, &QAction::toggled, this, [=](bool checked) {
+        canvas->setHudVisible(checked);
+        if (checked)
+            profilingAct->setChecked(true);  // o HUD precisa das amostras
+    });
+
+    traceAct = new QAction("Export Chrome Trace...", this);
+    connect(traceAct, &QAction::triggered, this, &MainWindow::exportTrace);
 }
 
 void MainWindow::createMenus() {
@@ -219,6 +278,9 @@ void MainWindow::createMenus() {
     viewMenu->addAction(fitAct);
     viewMenu->addAction(themeAct);
     viewMenu->addAction(gridAct);
+    viewMenu->addSeparator();
+    viewMenu->addAction(layersDock->toggleViewAction());
+    viewMenu->addAction(historyDock->toggleViewAction());
 
     QMenu *selectMenu = menuBar()->addMenu("Select");
     selectMenu->addAction(copyAct);
@@ -229,6 +291,15 @@ void MainWindow::createMenus() {
     selectMenu->addAction(flipVAct);
     selectMenu->addAction(rotateLAct);
     selectMenu->addAction(rotateRAct);
+
+    QMenu *debugMenu = menuBar()->addMenu("Debug");
+    debugMenu->addAction(recordAct);
+    debugMenu->addAction(replayAct);
+    debugMenu->addAction(replayMaxAct);
+    debugMenu->addSeparator();
+    debugMenu->addAction(profilingAct);
+    debugMenu->addAction(hudAct);
+    debugMenu->addAction(traceAct);
 }
 
 void MainWindow::createToolbars() {
@@ -302,6 +373,13 @@ void MainWindow::createToolbars() {
     connect(opacitySpin, QOverload<int>::of(&QSpinBox::valueChanged), this, &MainWindow::changeOpacity);
     styleBar->addWidget(opacitySpin);
 
+    QSpinBox *toleranceSpin = new QSpinBox(this);
+    toleranceSpin->setRange(0, 255);
+    toleranceSpin->setValue(tolerance);
+    toleranceSpin->setToolTip("Bucket tolerance");
+    connect(toleranceSpin, QOverload<int>::of(&QSpinBox::valueChanged), this, &MainWindow::changeTolerance);
+    styleBar->addWidget(toleranceSpin);
+
     fontCombo = new QFontComboBox(this);
     connect(fontCombo, &QFontComboBox::currentFontChanged, this, &MainWindow::changeFont);
     styleBar->addWidget(fontCombo);
@@ -321,6 +399,152 @@ void MainWindow::createToolbars() {
     styleBar->addWidget(italicCheck);
 }
 
+void MainWindow::createLayersDock() {
+    layersDock = new QDockWidget("Layers", this);
+    QWidget *panel = new QWidget(layersDock);
+    QVBoxLayout *layout = new QVBoxLayout(panel);
+
+    layerModeCombo = new QComboBox(panel);
+    for (BlendMode mode : {BlendMode::Normal, BlendMode::Multiply, BlendMode::Screen, BlendMode::Overlay})
+        layerModeCombo->addItem(Blend::name(mode));
+    connect(layerModeCombo, QOverload<int>::of(&QComboBox::activated), this, &MainWindow::changeLayerMode);
+    layout->addWidget(layerModeCombo);
+
+    // Sem tracking: um passo no histórico quando o usuário solta o slider
+    layerOpacitySlider = new QSlider(Qt::Horizontal, panel);
+    layerOpacitySlider->setRange(0, 100);
+    layerOpacitySlider->setTracking(false);
+    connect(layerOpacitySlider, &QSlider::valueChanged, this, &MainWindow::changeLayerOpacity);
+    layout->addWidget(new QLabel("Opacity:", panel));
+    layout->addWidget(layerOpacitySlider);
+
+    layerList = new QListWidget(panel);
+    connect(layerList, &QListWidget::currentRowChanged, this, &MainWindow::layerRowChanged);
+    connect(layerList, &QListWidget::itemChanged, this, &MainWindow::layerItemChanged);
+    layout->addWidget(layerList);
+
+    QHBoxLayout *buttons = new QHBoxLayout;
+    const auto addButton = [&](const QString &text, void (MainWindow::*slot)()) {
+        QPushButton *button = new QPushButton(text, panel);
+        connect(button, &QPushButton::clicked, this, slot);
+        buttons->addWidget(button);
+    };
+    addButton("+", &MainWindow::addLayer);
+    addButton("-", &MainWindow::removeLayer);
+    addButton("Up", &MainWindow::moveLayerUp);
+    addButton("Down", &MainWindow::moveLayerDown);
+    layout->addLayout(buttons);
+
+    layersDock->setWidget(panel);
+    addDockWidget(Qt::RightDockWidgetArea, layersDock);
+    updateLayersDock();
+}
+
+void MainWindow::updateLayersDock() {
+    // Reconstrói sem disparar os slots de edição
+    const QSignalBlocker listBlocker(layerList);
+    const QSignalBlocker sliderBlocker(layerOpacitySlider);
+    const QSignalBlocker comboBlocker(layerModeCombo);
+
+    const int count = canvas->layerCount();
+    layerList->clear();
+    for (int row = 0; row < count; ++row) {
+        const Layer &layer = canvas->layer(count - 1 - row);
+        QListWidgetItem *item = new QListWidgetItem(layer.name, layerList);
+        item->setFlags(item->flags() | Qt::ItemIsEditable | Qt::ItemIsUserCheckable);
+        item->setCheckState(layer.visible ? Qt::Checked : Qt::Unchecked);
+    }
+    layerList->setCurrentRow(count - 1 - canvas->activeLayer());
+
+    const Layer &active = canvas->layer(canvas->activeLayer());
+    layerOpacitySlider->setValue(qRound(active.opacity * 100));
+    layerModeCombo->setCurrentIndex(int(active.mode));
+}
+
+void MainWindow::createHistoryDock() {
+    historyDock = new QDockWidget("History", this);
+    historyList = new QListWidget(historyDock);
+    historyList->setIconSize(QSize(ThumbnailCache::Width, ThumbnailCache::Height));
+    historyList->setUniformItemSizes(true);
+    connect(historyList, &QListWidget::itemClicked, this, [this](QListWidgetItem *item) {
+        canvas->jumpToHistory(historyList->row(item));
+    });
+    connect(canvas, &CanvasWidget::historyCleared, historyList, &QListWidget::clear);
+
+    historyDock->setWidget(historyList);
+    addDockWidget(Qt::RightDockWidgetArea, historyDock);
+    updateHistoryDock();
+}
+
+void MainWindow::updateHistoryDock() {
+    // Uma linha por nó, na ordem de criação; as que já existem não mudam
+    const int count = canvas->historyNodeCount();
+    if (historyList->count() > count)
+        historyList->clear();
+    for (int node = historyList->count(); node < count; ++node) {
+        const int parent = canvas->historyParent(node);
+        QString text = QString::number(node);
+        if (node > 0 && parent != node - 1)
+            text += QString(" (from %1)").arg(parent);  // ramo aberto depois de um undo
+        QListWidgetItem *item = new QListWidgetItem(text, historyList);
+        const QImage thumb = canvas->historyThumbnail(node);
+        if (!thumb.isNull())
+            item->setIcon(QPixmap::fromImage(thumb));
+    }
+
+    const QSignalBlocker blocker(historyList);
+    historyList->setCurrentRow(canvas->historyNode());
+}
+
+void MainWindow::setHistoryThumbnail(int node) {
+    if (QListWidgetItem *item = historyList->item(node))
+        item->setIcon(QPixmap::fromImage(canvas->historyThumbnail(node)));
+}
+
+void MainWindow::dropHistoryThumbnail(int node) {
+    // O ícone segue o LRU: a lista não segura miniaturas que o cache soltou
+    if (QListWidgetItem *item = historyList->item(node))
+        item->setIcon(QIcon());
+}
+
+void MainWindow::layerRowChanged(int row) {
+    if (row >= 0)
+        canvas->setActiveLayer(canvas->layerCount() - 1 - row);
+}
+
+void MainWindow::layerItemChanged(QListWidgetItem *item) {
+    const int index = canvas->layerCount() - 1 - layerList->row(item);
+    const Layer &layer = canvas->layer(index);
+    const bool visible = item->checkState() == Qt::Checked;
+    if (visible != layer.visible)
+        canvas->setLayerVisible(index, visible);
+    else if (item->text() != layer.name)
+        canvas->renameLayer(index, item->text());
+}
+
+void MainWindow::addLayer() { canvas->addLayer(); }
+void MainWindow::removeLayer() { canvas->removeLayer(canvas->activeLayer()); }
+
+void MainWindow::moveLayerUp() {
+    const int index = canvas->activeLayer();
+    if (index + 1 < canvas->layerCount())
+        canvas->moveLayer(index, index + 1);
+}
+
+void MainWindow::moveLayerDown() {
+    const int index = canvas->activeLayer();
+    if (index > 0)
+        canvas->moveLayer(index, index - 1);
+}
+
+void MainWindow::changeLayerOpacity(int percent) {
+    canvas->setLayerOpacity(canvas->activeLayer(), percent);
+}
+
+void MainWindow::changeLayerMode(int index) {
+    canvas->setLayerBlendMode(canvas->activeLayer(), BlendMode(index));
+}
+
 void MainWindow::updateTool() {
     Tool tool = canvas->activeTool();
     tool.setOutlineColor(currentOutlineColor);
@@ -328,6 +552,7 @@ void MainWindow::updateTool() {
     tool.setFillEnabled(fillEnabled);
     tool.setThickness(thickness);
     tool.setOpacity(opacity);
+    tool.setTolerance(tolerance);
     QFont font = currentFont;
     font.setPointSize(fontSize);
     font.setBold(boldEnabled);
@@ -387,18 +612,46 @@ void MainWindow::newFile() {
 }
 
 void MainWindow::openFile() {
-    QString path = QFileDialog::getOpenFileName(this, "Open Image", "", "Images (*.png *.jpg *.bmp)");
+    QString path = QFileDialog::getOpenFileName(this, "Open Image", "", "Images (*.png *.jpg *.bmp *.lpaint);;LittlePaint Project (*.lpaint)");
     if (!path.isEmpty()) canvas->openImage(path);
 }
 
-void MainWindow::saveFile() {
-    QString path = QFileDialog::getSaveFileName(this, "Save Image", "", "PNG (*.png);;JPEG (*.jpg *.jpeg);;BMP (*.bmp)");
-    if (!path.isEmpty()) {
-        if (!path.endsWith(".png") && !path.endsWith(".jpg") && !path.endsWith(".jpeg") && !path.endsWith(".bmp")) {
-            path += ".png";
-        }
-        canvas->saveImage(path);
+void MainWindow::imageOpenFailed(const QString &path, const QString &error) {
+    QMessageBox::warning(this, "Open Image", QString("Could not open %1:\n%2").arg(path, error));
+}
+
+void MainWindow::exportProgress(int percent) {
+    exportBar->show();
+    exportBar->setValue(percent);
+}
+
+void MainWindow::exportFinished(const QString &path, bool ok) {
+    exportBar->hide();
+    // Saindo: o diário de recuperação só vai embora se o arquivo foi gravado
+    if (savingBeforeClose) {
+        saveSucceeded = ok;
+        if (ok)
+            canvas->discardRecovery();
+    }
+    if (ok)
+        statusBar()->showMessage(QString("Saved %1").arg(path), 5000);
+    else
+        QMessageBox::warning(this, "Save Image", QString("Could not save %1").arg(path));
+}
+
+bool MainWindow::saveFile() {
+    QString path = QFileDialog::getSaveFileName(this, "Save Image", "", "PNG (*.png);;JPEG (*.jpg *.jpeg);;BMP (*.bmp);;LittlePaint Project (*.lpaint)");
+    if (path.isEmpty())
+        return false;
+    if (path.endsWith(".lpaint")) {
+        canvas->saveProject(path);  // camadas e histórico
+        return true;
+    }
+    if (!path.endsWith(".png") && !path.endsWith(".jpg") && !path.endsWith(".jpeg") && !path.endsWith(".bmp")) {
+        path += ".png";
     }
+    canvas->saveImage(path);
+    return true;
 }
 
 void MainWindow::resizeCanvas() {
@@ -431,12 +684,32 @@ void MainWindow::openPreferences() {
     layout->addWidget(thicknessBox);
     layout->addWidget(new QLabel("Default Color:"));
 
+    QSpinBox *historyBox = new QSpinBox;
+    historyBox->setRange(64, 65536);
+    historyBox->setSuffix(" MB");
+    historyBox->setValue(historyBudgetMB);
+
+    layout->addWidget(new QLabel("History Memory:"));
+    layout->addWidget(historyBox);
+
+    QSpinBox *gridBox = new QSpinBox;
+    gridBox->setRange(1, 1000);
+    gridBox->setSuffix(" px");
+    gridBox->setValue(gridSpacing);
+
+    layout->addWidget(new QLabel("Grid Spacing:"));
+    layout->addWidget(gridBox);
+
     QPushButton *okButton = new QPushButton("OK");
     layout->addWidget(okButton);
 
     connect(okButton, &QPushButton::clicked, [&]() {
         thickness = thicknessBox->value();
         canvas->setThickness(thickness);
+        historyBudgetMB = historyBox->value();
+        canvas->setHistoryMemoryBudget(historyBudgetMB);
+        gridSpacing = gridBox->value();
+        canvas->setGridSpacing(gridSpacing);
         updateTool();
         dialog.accept();
     });
@@ -481,6 +754,11 @@ void MainWindow::changeOpacity(int value) {
     updateTool();
 }
 
+void MainWindow::changeTolerance(int value) {
+    tolerance = value;
+    updateTool();
+}
+
 void MainWindow::changeFont(const QFont &font) {
     currentFont.setFamily(font.family());
     updateTool();
@@ -501,6 +779,10 @@ void MainWindow::toggleItalic(bool checked) {
     updateTool();
 }
 
+bool MainWindow::recoverFrom(const QString &journalPath) {
+    return canvas->recover(journalPath);
+}
+
 void MainWindow::closeEvent(QCloseEvent *event) {
     QMessageBox::StandardButton reply;
     reply = QMessageBox::question(this, "Exit",
@@ -508,9 +790,21 @@ void MainWindow::closeEvent(QCloseEvent *event) {
                                   QMessageBox::Save | QMessageBox::Discard | QMessageBox::Cancel);
 
     if (reply == QMessageBox::Save) {
-        saveFile();
-        event->accept();
+        if (!saveFile()) {
+            event->ignore();
+            return;
+        }
+        // Espera a gravação em segundo plano; exportFinished decide o diário
+        savingBeforeClose = true;
+        saveSucceeded = false;
+        canvas->waitForExports();
+        savingBeforeClose = false;
+        if (saveSucceeded)
+            event->accept();
+        else
+            event->ignore();
     } else if (reply == QMessageBox::Discard) {
+        canvas->discardRecovery();
         event->accept();
     } else {
         event->ignore();
@@ -532,3 +826,82 @@ void MainWindow::setFillColorFromEyedropper(const QColor &color) {
 void MainWindow::updateColorPreview() {
     // Se você tiver um widget de preview de cor, atualize aqui.
 }
+
+void MainWindow::toggleRecording(bool checked) {
+    if (!checked) {
+        canvas->stopRecording();
+        statusBar()->showMessage("Input recording stopped", 5000);
+        return;
+    }
+
+    const QString path = QFileDialog::getSaveFileName(this, "Record Input", "", "Input Log (*.lpinput)");
+    if (path.isEmpty()) {
+        recordAct->setChecked(false);
+        return;
+    }
+    // O estado inicial vai junto, para o replay partir do mesmo desenho
+    canvas->saveProject(path + ".lpaint", false);
+    if (!canvas->startRecording(path)) {
+        QMessageBox::warning(this, "Record Input", QString("Could not write %1").arg(path));
+        recordAct->setChecked(false);
+        return;
+    }
+    statusBar()->showMessage(QString("Recording input to %1").arg(path));
+}
+
+void MainWindow::chooseReplay(bool maximumSpeed) {
+    const QString path = QFileDialog::getOpenFileName(this, "Replay Input", "", "Input Log (*.lpinput)");
+    if (!path.isEmpty())
+        replayInput(path, maximumSpeed);
+}
+
+bool MainWindow::replayInput(const QString &path, bool maximumSpeed, bool quitWhenDone) {
+    if (canvas->isRecording())
+        recordAct->setChecked(false);
+    if (QFileInfo::exists(path + ".lpaint"))
+        canvas->openProject(path + ".lpaint");
+
+    disconnect(replayer, &InputReplayer::finished, this, nullptr);
+    connect(replayer, &InputReplayer::finished, this, [=](const InputReplayer::Stats &stats) {
+        if (quitWhenDone) {
+            QTextStream out(stdout);
+            out << stats.toString() << "\n";
+            out.flush();
+            qApp->quit();
+            return;
+        }
+        statusBar()->clearMessage();
+        QMessageBox::information(this, "Replay Input", stats.toString());
+    });
+
+    QString error;
+    const InputReplayer::Speed speed = maximumSpeed ? InputReplayer::Speed::Maximum
+                                                    : InputReplayer::Speed::Original;
+    if (!replayer->start(path, speed, &error)) {
+        if (quitWhenDone)
+            qCritical() << "❌ Replay falhou:" << error;
+        else
+            QMessageBox::warning(this, "Replay Input", QString("Could not replay %1: %2").arg(path, error));
+        return false;
+    }
+    statusBar()->showMessage(QString("Replaying %1...").arg(path));
+    return true;
+}
+
+void MainWindow::toggleProfiling(bool checked) {
+    Profiler::setEnabled(checked);
+    if (!checked)
+        hudAct->setChecked(false);
+}
+
+void MainWindow::exportTrace() {
+    const QString path = QFileDialog::getSaveFileName(this, "Export Chrome Trace", "littlepaint-trace.json", "Chrome Trace (*.json)");
+    if (path.isEmpty())
+        return;
+
+    QString error;
+    if (!Profiler::writeChromeTrace(path, &error))
+        QMessageBox::warning(this, "Export Chrome Trace", QString("Could not write %1: %2").arg(path, error));
+    else
+        statusBar()->showMessage(QString("Trace saved to %1 (open in chrome://tracing)").arg(path), 5000);
+}
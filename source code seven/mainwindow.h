@@ -10,9 +10,16 @@
 #include <QAction>
 #include <QColor>
 #include <QPushButton>
+#include <QProgressBar>
 
 
 class CanvasWidget;
+class InputReplayer;
+class QComboBox;
+class QDockWidget;
+class QListWidget;
+class QListWidgetItem;
+class QSlider;
 
 class MainWindow : public QMainWindow {
     Q_OBJECT
@@ -21,6 +28,12 @@ public:
     explicit MainWindow(QWidget *parent = nullptr);
     ~MainWindow();
 
+    // Restaura o desenho de um diário de recuperação
+    bool recoverFrom(const QString &journalPath);
+
+    // Reproduz um log de entrada; com quitWhenDone imprime as medidas e sai
+    bool replayInput(const QString &path, bool maximumSpeed, bool quitWhenDone = false);
+
 protected:
     void closeEvent(QCloseEvent *event) override;
 
@@ -29,12 +42,14 @@ private:
     void createActions();
     void createMenus();
     void createToolbars();
+    void createLayersDock();
+    void createHistoryDock();
     void updateTool();
 
     // Ações principais
     void newFile();
     void openFile();
-    void saveFile();
+    bool saveFile();  // false se o usuário cancelou o diálogo
     void resizeCanvas();
     void toggleTheme();
 
@@ -44,6 +59,7 @@ private:
     void toggleFill(bool enabled);
     void changeThickness(int value);
     void changeOpacity(int value);
+    void changeTolerance(int value);
     void changeFont(const QFont &font);
     void changeFontSize(int size);
     void toggleBold(bool checked);
@@ -77,6 +93,9 @@ private:
     void setColorFromEyedropper(const QColor &color);
     void setOutlineColorFromEyedropper(const QColor &color);
     void setFillColorFromEyedropper(const QColor &color);
+    void imageOpenFailed(const QString &path, const QString &error);
+    void exportProgress(int percent);
+    void exportFinished(const QString &path, bool ok);
 
     // Seleção
     void copySelection();
@@ -88,13 +107,43 @@ private:
     void rotateLeft();
     void rotateRight();
 
+    // Camadas (a lista mostra a de cima primeiro)
+    void updateLayersDock();
+    void layerRowChanged(int row);
+    void layerItemChanged(QListWidgetItem *item);
+    void addLayer();
+    void removeLayer();
+    void moveLayerUp();
+    void moveLayerDown();
+    void changeLayerOpacity(int percent);
+    void changeLayerMode(int index);
+
+    // Histórico (um item por nó; clicar pula para o nó)
+    void updateHistoryDock();
+    void setHistoryThumbnail(int node);
+    void dropHistoryThumbnail(int node);
+
     // Exportação e preferências
     void exportImage();
     void openPreferences();
 
+    // Depuração
+    void toggleRecording(bool checked);
+    void chooseReplay(bool maximumSpeed);
+    void toggleProfiling(bool checked);
+    void exportTrace();
+
     // Componentes
     CanvasWidget *canvas;
     QScrollArea *scrollArea;
+    QProgressBar *exportBar;
+    InputReplayer *replayer;
+    QDockWidget *layersDock;
+    QListWidget *layerList;
+    QSlider *layerOpacitySlider;
+    QComboBox *layerModeCombo;
+    QDockWidget *historyDock;
+    QListWidget *historyList;
 
     // Ações
     QAction *newAct;
@@ -111,6 +160,12 @@ private:
     QAction *gridAct;
     QAction *exportAct;
     QAction *prefsAct;
+    QAction *recordAct;
+    QAction *replayAct;
+    QAction *replayMaxAct;
+    QAction *profilingAct;
+    QAction *hudAct;
+    QAction *traceAct;
 
     QAction *pencilAct;
     QAction *brushAct;
@@ -149,6 +204,13 @@ private:
     bool fillEnabled;
     int thickness;
     float opacity;
+    int tolerance;
+    int historyBudgetMB;
+    int gridSpacing;
+
+    // Salvar ao fechar: resultado da gravação esperada no closeEvent
+    bool savingBeforeClose = false;
+    bool saveSucceeded = false;
     QFont currentFont;
     int fontSize;
     bool boldEnabled;
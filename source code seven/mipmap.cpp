@@ -0,0 +1,148 @@
+#include "mipmap.h"
+#include "profiler.h"
+#include <QtMath>
+
+void MipmapPyramid::invalidate(const QRect &baseRect) {
+    for (int i = 0; i < levels.size(); ++i)
+        dirty[i] += scaleDown(baseRect, i + 1).intersected(levels[i].rect());
+}
+
+void MipmapPyramid::clear() {
+    levels.clear();
+    dirty.clear();
+    baseSize = QSize();
+}
+
+int MipmapPyramid::levelForZoom(const QSize &size, double zoom) const {
+    if (zoom <= 0.0 || zoom > 0.5)
+        return 0;
+
+    // O nível n tem escala 1/2^n: usa o mais reduzido que ainda é >= zoom
+    int n = qFloor(std::log2(1.0 / zoom));
+    while (n > 0 && qMin(size.width(), size.height()) >> n < MinLevelSize)
+        --n;
+    return n;
+}
+
+QRect MipmapPyramid::baseArea(int n, const QRect &area) {
+    if (area.isEmpty())
+        return QRect();
+
+    // Os tiles são refeitos inteiros, então a área é alinhada à grade
+    const int ts = TiledImage::TileSize;
+    const QPoint topLeft(area.left() / ts * ts, area.top() / ts * ts);
+    const QPoint bottomRight((area.right() / ts + 1) * ts, (area.bottom() / ts + 1) * ts);
+    return QRect(topLeft * (1 << n), bottomRight * (1 << n) - QPoint(1, 1));
+}
+
+const TiledImage &MipmapPyramid::level(int n, const QRect &area, const TiledImage &base) {
+    ensureLevels(base, n);
+
+    TiledImage &img = levels[n - 1];
+    const QRegion pending = dirty[n - 1].intersected(area);
+    if (pending.isEmpty())
+        return img;
+
+    PROFILE_SCOPE("mipmap");
+
+    const QVector<int> indices = img.tilesIn(pending);
+
+    // O nível anterior precisa estar em dia sob os tiles que serão refeitos
+    QRect covered;
+    for (int index : indices)
+        covered |= img.tileRect(index);
+    const TiledImage &src = n > 1 ? level(n - 1, QRect(covered.topLeft() * 2, covered.size() * 2), base) : base;
+
+    for (int index : indices)
+        reduceTile(src, img, index);
+    dirty[n - 1] -= img.tileBounds(pending);
+    return img;
+}
+
+QImage MipmapPyramid::thumbnail(const TiledImage &image, const QSize &size) {
+    if (image.isNull() || size.isEmpty())
+        return QImage();
+
+    MipmapPyramid pyramid;
+    const QSize target = image.size().scaled(size, Qt::KeepAspectRatio);
+    const int n = pyramid.levelForZoom(image.size(), double(target.width()) / image.width());
+    if (n == 0)
+        return image.scaled(target);
+
+    // Tiles uniformes são reduzidos sem ler pixel nenhum
+    const TiledImage &reduced = pyramid.level(n, QRect(QPoint(0, 0), image.size()), image);
+    return reduced.scaled(target);
+}
+
+void MipmapPyramid::ensureLevels(const TiledImage &base, int n) {
+    if (base.size() != baseSize) {
+        clear();
+        baseSize = base.size();
+    }
+
+    while (levels.size() < n) {
+        const int shift = levels.size() + 1;
+        QSize size((baseSize.width() + (1 << shift) - 1) >> shift,
+                   (baseSize.height() + (1 << shift) - 1) >> shift);
+        levels.append(TiledImage(size.expandedTo(QSize(1, 1)), base.format()));
+        dirty.append(QRegion(levels.last().rect()));
+    }
+}
+
+void MipmapPyramid::reduceTile(const TiledImage &src, TiledImage &dst, int index) {
+    const QRect tr = dst.tileRect(index);
+    const QRect srcRect = QRect(tr.topLeft() * 2, tr.size() * 2).intersected(src.rect());
+
+    // Quatro tiles uniformes da mesma cor: a média é a própria cor
+    const QVector<int> sources = src.tilesIn(srcRect);
+    const TiledImage::Tile &first = src.tileAt(sources.first());
+    bool uniform = first.isUniform();
+    for (int i = 1; i < sources.size() && uniform; ++i)
+        uniform = src.tileAt(sources[i]).sharesWith(first);
+    if (uniform) {
+        dst.setUniform(index, first.value);
+        return;
+    }
+
+    QImage reduced(tr.size(), dst.format());
+    downsample(src.copy(srcRect), reduced);
+    TiledImage::Tile tile;
+    tile.image = reduced;
+    dst.setTileAt(index, tile);
+    dst.compactTile(index);
+}
+
+// Média de 2x2 pixels de 32 bits; dois canais por vez em palavras de 16 bits.
+// src começa numa coordenada par, então repetir a última linha/coluna dela
+// equivale a repetir a borda da imagem.
+void MipmapPyramid::downsample(const QImage &src, QImage &dst) {
+    const int maxX = src.width() - 1;
+    const int maxY = src.height() - 1;
+
+    for (int y = 0; y < dst.height(); ++y) {
+        const quint32 *row0 = reinterpret_cast<const quint32 *>(src.constScanLine(qMin(2 * y, maxY)));
+        const quint32 *row1 = reinterpret_cast<const quint32 *>(src.constScanLine(qMin(2 * y + 1, maxY)));
+        quint32 *out = reinterpret_cast<quint32 *>(dst.scanLine(y));
+
+        for (int x = 0; x < dst.width(); ++x) {
+            const int x0 = qMin(2 * x, maxX);
+            const int x1 = qMin(2 * x + 1, maxX);
+            const quint32 a = row0[x0], b = row0[x1], c = row1[x0], d = row1[x1];
+
+            const quint32 rb = (a & 0x00ff00ff) + (b & 0x00ff00ff) + (c & 0x00ff00ff) + (d & 0x00ff00ff) + 0x00020002;
+            const quint32 ag = ((a >> 8) & 0x00ff00ff) + ((b >> 8) & 0x00ff00ff)
+                             + ((c >> 8) & 0x00ff00ff) + ((d >> 8) & 0x00ff00ff) + 0x00020002;
+            out[x] = ((rb >> 2) & 0x00ff00ff) | (((ag >> 2) & 0x00ff00ff) << 8);
+        }
+    }
+}
+
+QRect MipmapPyramid::scaleDown(const QRect &rect, int levels) {
+    if (rect.isEmpty())
+        return QRect();
+    const int left = rect.left() >> levels;
+    const int top = rect.top() >> levels;
+    const int right = rect.right() >> levels;
+    const int bottom = rect.bottom() >> levels;
+    return QRect(QPoint(left, top), QPoint(right, bottom));
+}
@@ -0,0 +1,48 @@
+#ifndef MIPMAP_H
+#define MIPMAP_H
+
+#include <QRect>
+#include <QRegion>
+#include <QVector>
+#include "tiledimage.h"
+
+// Pirâmide de imagens em meia resolução (filtro de caixa 2x2) usada para
+// desenhar com zoom menor que 50%. Os níveis são criados sob demanda e,
+// depois de um traço, só os tiles sujos de cada nível são refeitos. Cada
+// tile do nível n sai de 2x2 tiles do nível n - 1; se os quatro forem
+// uniformes e iguais, o tile reduzido também é, sem tocar em pixels.
+class MipmapPyramid {
+public:
+    static const int MinLevelSize = 32;  // não reduz abaixo disso
+
+    // Marca uma área da imagem base (nível 0) como alterada
+    void invalidate(const QRect &baseRect);
+    void clear();
+
+    // Maior nível útil para a imagem base e o zoom pedido
+    int levelForZoom(const QSize &baseSize, double zoom) const;
+
+    // Área da base que precisa estar válida para atualizar area no nível n
+    static QRect baseArea(int n, const QRect &area);
+
+    // Devolve o nível n (n >= 1), atualizando os tiles sujos dentro de area
+    // (em coordenadas do nível). A base precisa estar válida em baseArea().
+    const TiledImage &level(int n, const QRect &area, const TiledImage &base);
+
+    // Miniatura de image cabendo em size: reduz pela pirâmide até perto do
+    // tamanho e só o último passo usa o QPainter. Não mexe em estado
+    // compartilhado, então pode rodar num worker.
+    static QImage thumbnail(const TiledImage &image, const QSize &size);
+
+private:
+    void ensureLevels(const TiledImage &base, int n);
+    static void reduceTile(const TiledImage &src, TiledImage &dst, int index);
+    static void downsample(const QImage &src, QImage &dst);
+    static QRect scaleDown(const QRect &rect, int levels);
+
+    QSize baseSize;
+    QVector<TiledImage> levels;  // levels[i] é o nível i + 1
+    QVector<QRegion> dirty;      // áreas desatualizadas, em coordenadas do nível
+};
+
+#endif // MIPMAP_H
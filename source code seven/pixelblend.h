@@ -0,0 +1,31 @@
+#ifndef PIXELBLEND_H
+#define PIXELBLEND_H
+
+#include <QRgb>
+
+// SourceOver de uma cor sólida (alpha 0-255) sobre um pixel ARGB32 sem
+// pré-multiplicação; o alpha próprio de color é ignorado
+inline quint32 blendOver(quint32 under, quint32 color, int alpha) {
+    const int da = qAlpha(under) * (255 - alpha);  // alpha do fundo x 255
+    const int outA255 = alpha * 255 + da;           // alpha final x 255
+    if (outA255 == 0)
+        return 0;
+    const int r = (qRed(color) * alpha * 255 + qRed(under) * da + outA255 / 2) / outA255;
+    const int g = (qGreen(color) * alpha * 255 + qGreen(under) * da + outA255 / 2) / outA255;
+    const int b = (qBlue(color) * alpha * 255 + qBlue(under) * da + outA255 / 2) / outA255;
+    return qRgba(r, g, b, (outA255 + 127) / 255);
+}
+
+// O mesmo sobre um pixel pré-multiplicado: vira uma interpolação linear dos
+// quatro canais, feita dois de cada vez (pares 0x00ff00ff), sem divisão
+inline quint32 blendOverPremultiplied(quint32 under, quint32 color, int alpha) {
+    const quint32 src = color | 0xff000000u;
+    const quint32 ia = quint32(255 - alpha);
+    quint32 rb = (src & 0x00ff00ff) * quint32(alpha) + (under & 0x00ff00ff) * ia;
+    rb = ((rb + ((rb >> 8) & 0x00ff00ff) + 0x00800080) >> 8) & 0x00ff00ff;
+    quint32 ag = ((src >> 8) & 0x00ff00ff) * quint32(alpha) + ((under >> 8) & 0x00ff00ff) * ia;
+    ag = (ag + ((ag >> 8) & 0x00ff00ff) + 0x00800080) & 0xff00ff00;
+    return ag | rb;
+}
+
+#endif // PIXELBLEND_H
@@ -0,0 +1,213 @@
+#include "pngwriter.h"
+#include "profiler.h"
+#include <QSaveFile>
+#include <QMutex>
+#include <QSemaphore>
+#include <QThreadPool>
+#include <QtEndian>
+#include <cstdlib>
+#include <vector>
+#include <zlib.h>
+#include <cstring>
+
+namespace {
+
+struct Strip {
+    QByteArray deflated;
+    uLong adler = 1;
+    qint64 rawSize = 0;
+    bool ok = false;
+};
+
+// Converte uma linha da imagem para RGBA/RGB de 8 bits, lendo dos tiles
+void readRow(const TiledImage &image, int y, uchar *out, bool alpha) {
+    const int ty = y / TiledImage::TileSize;
+    for (int tx = 0; tx < image.tilesX(); ++tx) {
+        const int index = image.tileIndex(tx, ty);
+        const QRect tr = image.tileRect(index);
+        const TiledImage::Tile &tile = image.tileAt(index);
+        const quint32 *src = tile.isUniform() ? nullptr
+                           : reinterpret_cast<const quint32 *>(tile.image.constScanLine(y - tr.top()));
+
+        for (int x = 0; x < tr.width(); ++x) {
+            QRgb pixel = src ? src[x] : tile.value;
+            if (image.format() == QImage::Format_ARGB32_Premultiplied)
+                pixel = qUnpremultiply(pixel);
+            *out++ = uchar(qRed(pixel));
+            *out++ = uchar(qGreen(pixel));
+            *out++ = uchar(qBlue(pixel));
+            if (alpha)
+                *out++ = uchar(qAlpha(pixel));
+        }
+    }
+}
+
+inline int paeth(int a, int b, int c) {
+    const int p = a + b - c;
+    const int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+    if (pa <= pb && pa <= pc)
+        return a;
+    return pb <= pc ? b : c;
+}
+
+const int Filters = 5;
+
+// Escolhe por linha o filtro de menor soma absoluta (a heurística da libpng).
+// candidates tem Filters * bytes e é reaproveitado entre as linhas da faixa
+void filterRow(const uchar *row, const uchar *prev, int bytes, int bpp, uchar *candidates, uchar *out) {
+    long best = -1;
+    int bestFilter = 0;
+
+    for (int f = 0; f < Filters; ++f) {
+        uchar *dst = candidates + size_t(f) * bytes;
+        long sum = 0;
+        for (int i = 0; i < bytes; ++i) {
+            const int a = i >= bpp ? row[i - bpp] : 0;
+            const int b = prev ? prev[i] : 0;
+            const int c = (prev && i >= bpp) ? prev[i - bpp] : 0;
+            int predicted = 0;
+            switch (f) {
+                case 1: predicted = a; break;
+                case 2: predicted = b; break;
+                case 3: predicted = (a + b) / 2; break;
+                case 4: predicted = paeth(a, b, c); break;
+                default: break;
+            }
+            dst[i] = uchar(row[i] - predicted);
+            sum += std::abs(int(qint8(dst[i])));
+        }
+        if (best < 0 || sum < best) {
+            best = sum;
+            bestFilter = f;
+        }
+    }
+
+    out[0] = uchar(bestFilter);
+    memcpy(out + 1, candidates + size_t(bestFilter) * bytes, size_t(bytes));
+}
+
+void compressStrip(const TiledImage &image, int first, int last, bool alpha, bool final, Strip &strip) {
+    PROFILE_SCOPE("png-strip");
+    const int bpp = alpha ? 4 : 3;
+    const int bytes = image.width() * bpp;
+    std::vector<uchar> prev(bytes), row(bytes), candidates(size_t(Filters) * bytes);
+    QByteArray raw(int((last - first) * (bytes + 1)), Qt::Uninitialized);
+
+    // O filtro da primeira linha depende da última linha da faixa anterior
+    if (first > 0)
+        readRow(image, first - 1, prev.data(), alpha);
+    for (int y = first; y < last; ++y) {
+        readRow(image, y, row.data(), alpha);
+        filterRow(row.data(), y > 0 ? prev.data() : nullptr, bytes, bpp, candidates.data(),
+                  reinterpret_cast<uchar *>(raw.data()) + size_t(y - first) * (bytes + 1));
+        prev.swap(row);
+    }
+
+    z_stream zs = {};
+    if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        return;
+
+    strip.deflated.resize(int(deflateBound(&zs, uLong(raw.size())) + 16));
+    zs.next_in = reinterpret_cast<Bytef *>(raw.data());
+    zs.avail_in = uInt(raw.size());
+    zs.next_out = reinterpret_cast<Bytef *>(strip.deflated.data());
+    zs.avail_out = uInt(strip.deflated.size());
+
+    // Z_SYNC_FLUSH termina a faixa alinhada em byte, então dá para emendar
+    const int result = deflate(&zs, final ? Z_FINISH : Z_SYNC_FLUSH);
+    strip.ok = final ? result == Z_STREAM_END : result == Z_OK;
+    strip.deflated.resize(int(zs.total_out));
+    deflateEnd(&zs);
+
+    strip.adler = adler32(1, reinterpret_cast<const Bytef *>(raw.constData()), uInt(raw.size()));
+    strip.rawSize = raw.size();
+}
+
+bool writeChunk(QSaveFile &file, const char *type, const QByteArray &data) {
+    uchar length[4];
+    qToBigEndian(quint32(data.size()), length);
+    uLong crc = crc32(0, reinterpret_cast<const Bytef *>(type), 4);
+    crc = crc32(crc, reinterpret_cast<const Bytef *>(data.constData()), uInt(data.size()));
+    uchar crcBytes[4];
+    qToBigEndian(quint32(crc), crcBytes);
+
+    return file.write(reinterpret_cast<const char *>(length), 4) == 4
+        && file.write(type, 4) == 4
+        && file.write(data) == data.size()
+        && file.write(reinterpret_cast<const char *>(crcBytes), 4) == 4;
+}
+
+} // namespace
+
+bool PngWriter::write(const TiledImage &image, const QString &path, const std::function<void(int)> &progress) {
+    if (image.isNull())
+        return false;
+
+    PROFILE_SCOPE("png-write");
+    const bool alpha = image.format() != QImage::Format_RGB32;
+    const int rows = TiledImage::TileSize;
+    const int count = (image.height() + rows - 1) / rows;
+    std::vector<Strip> strips(count);
+
+    // As faixas leem tiles vizinhos em paralelo: nada pode ficar para decodificar
+    image.decodeAll();
+
+    // Uma tarefa por faixa; o semáforo conta as prontas para o progresso
+    QSemaphore done;
+    for (int i = 0; i < count; ++i) {
+        QThreadPool::globalInstance()->start([&, i] {
+            const int first = i * rows;
+            const int last = qMin(image.height(), first + rows);
+            compressStrip(image, first, last, alpha, i == count - 1, strips[size_t(i)]);
+            done.release();
+        });
+    }
+    for (int i = 0; i < count; ++i) {
+        done.acquire();
+        if (progress)
+            progress((i + 1) * 100 / (count + 1));
+    }
+
+    // Grava num temporário ao lado: uma falha não estraga o arquivo que já existia
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+
+    static const char signature[] = "\x89PNG\r\n\x1a\n";
+    bool ok = file.write(signature, 8) == 8;
+
+    QByteArray header(13, '\0');
+    uchar *h = reinterpret_cast<uchar *>(header.data());
+    qToBigEndian(quint32(image.width()), h);
+    qToBigEndian(quint32(image.height()), h + 4);
+    h[8] = 8;                 // bits por canal
+    h[9] = alpha ? 6 : 2;     // RGBA ou RGB
+    ok = ok && writeChunk(file, "IHDR", header);
+
+    // Cada faixa vira um IDAT; o fluxo zlib começa com o cabeçalho e termina no adler32
+    uLong adler = 1;
+    for (int i = 0; i < count && ok; ++i) {
+        const Strip &strip = strips[size_t(i)];
+        ok = strip.ok;
+        QByteArray data;
+        if (i == 0)
+            data.append("\x78\x9c", 2);
+        data.append(strip.deflated);
+        adler = adler32_combine(adler, strip.adler, z_off_t(strip.rawSize));
+        if (i == count - 1) {
+            uchar checksum[4];
+            qToBigEndian(quint32(adler), checksum);
+            data.append(reinterpret_cast<const char *>(checksum), 4);
+        }
+        ok = ok && writeChunk(file, "IDAT", data);
+    }
+
+    ok = ok && writeChunk(file, "IEND", QByteArray());
+    if (ok)
+        ok = file.commit();
+    else
+        file.cancelWriting();
+    if (progress)
+        progress(100);
+    return ok;
+}
@@ -0,0 +1,20 @@
+#ifndef PNGWRITER_H
+#define PNGWRITER_H
+
+#include <QString>
+#include <functional>
+#include "tiledimage.h"
+
+// Gravador de PNG com compressão paralela: a imagem é dividida em faixas
+// de TileSize linhas, cada faixa é filtrada e comprimida com deflate
+// independente em um thread do pool global (terminando em Z_SYNC_FLUSH) e
+// as faixas são emendadas num único fluxo zlib, com o adler32 combinado.
+// Lê direto dos tiles, sem achatar a imagem inteira.
+class PngWriter {
+public:
+    // progress recebe 0-100 na thread que chamou write()
+    static bool write(const TiledImage &image, const QString &path,
+                      const std::function<void(int)> &progress = nullptr);
+};
+
+#endif // PNGWRITER_H
@@ -0,0 +1,200 @@
+#include "profiler.h"
+#include <QAtomicInt>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QTextStream>
+#include <QThread>
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+namespace {
+
+QAtomicInt enabledFlag;
+
+// Um anel por thread. Só a dona escreve; o mutex nunca é disputado a não
+// ser quando o HUD ou a exportação leem as amostras.
+struct Ring {
+    QMutex mutex;
+    std::vector<Profiler::Sample> samples = std::vector<Profiler::Sample>(Profiler::RingSize);
+    quint64 written = 0;
+    int tid = 0;
+    QString threadName;
+
+    // Amostras em ordem de gravação (as mais antigas já sobrescritas somem)
+    std::vector<Profiler::Sample> snapshot() {
+        QMutexLocker lock(&mutex);
+        const quint64 count = qMin<quint64>(written, samples.size());
+        std::vector<Profiler::Sample> out;
+        out.reserve(size_t(count));
+        for (quint64 i = written - count; i < written; ++i)
+            out.push_back(samples[size_t(i % samples.size())]);
+        return out;
+    }
+};
+
+struct Registry {
+    QMutex mutex;
+    std::vector<std::unique_ptr<Ring>> rings;  // nunca liberados: o trace mostra threads que já saíram
+};
+
+Registry &registry() {
+    static Registry instance;
+    return instance;
+}
+
+Ring *currentRing() {
+    thread_local Ring *ring = nullptr;
+    if (ring)
+        return ring;
+
+    Registry &reg = registry();
+    QMutexLocker lock(&reg.mutex);
+    reg.rings.emplace_back(new Ring);
+    ring = reg.rings.back().get();
+    ring->tid = int(reg.rings.size());
+
+    QThread *thread = QThread::currentThread();
+    const QCoreApplication *app = QCoreApplication::instance();
+    if (app && thread == app->thread())
+        ring->threadName = "main";
+    else if (!thread->objectName().isEmpty())
+        ring->threadName = thread->objectName();
+    else
+        ring->threadName = QString("worker %1").arg(ring->tid);
+    return ring;
+}
+
+std::vector<Ring *> allRings() {
+    Registry &reg = registry();
+    QMutexLocker lock(&reg.mutex);
+    std::vector<Ring *> out;
+    for (const auto &ring : reg.rings)
+        out.push_back(ring.get());
+    return out;
+}
+
+double percentile(const std::vector<qint64> &sorted, double p) {
+    return sorted[std::min(sorted.size() - 1, size_t(p * sorted.size()))] / 1e6;
+}
+
+} // namespace
+
+void Profiler::setEnabled(bool enabled) {
+    enabledFlag.storeRelease(enabled ? 1 : 0);
+}
+
+bool Profiler::isEnabled() {
+    return enabledFlag.loadAcquire() != 0;
+}
+
+qint64 Profiler::now() {
+    static const QElapsedTimer clock = [] {
+        QElapsedTimer timer;
+        timer.start();
+        return timer;
+    }();
+    return clock.nsecsElapsed();
+}
+
+void Profiler::record(const char *name, qint64 start, qint64 duration) {
+    Ring *ring = currentRing();
+    QMutexLocker lock(&ring->mutex);
+    Sample &sample = ring->samples[size_t(ring->written % ring->samples.size())];
+    sample.name = name;
+    sample.start = start;
+    sample.duration = duration;
+    ++ring->written;
+}
+
+void Profiler::clear() {
+    for (Ring *ring : allRings()) {
+        QMutexLocker lock(&ring->mutex);
+        ring->written = 0;
+    }
+}
+
+QVector<Profiler::Summary> Profiler::summaries(const QVector<const char *> &names, int count) {
+    std::vector<std::vector<Sample>> matching(size_t(names.size()));
+    for (Ring *ring : allRings()) {
+        QMutexLocker lock(&ring->mutex);
+        const quint64 available = qMin<quint64>(ring->written, ring->samples.size());
+        for (quint64 i = ring->written - available; i < ring->written; ++i) {
+            const Sample &sample = ring->samples[size_t(i % ring->samples.size())];
+            for (int n = 0; n < names.size(); ++n) {
+                if (sample.name == names[n] || std::strcmp(sample.name, names[n]) == 0) {
+                    matching[size_t(n)].push_back(sample);
+                    break;
+                }
+            }
+        }
+    }
+
+    QVector<Summary> result(names.size());
+    for (int n = 0; n < names.size(); ++n) {
+        std::vector<Sample> &samples = matching[size_t(n)];
+        if (samples.empty())
+            continue;
+
+        // Só as mais recentes: o HUD mostra o estado atual, não a sessão inteira
+        std::sort(samples.begin(), samples.end(),
+                  [](const Sample &a, const Sample &b) { return a.start < b.start; });
+        const size_t first = samples.size() > size_t(count) ? samples.size() - size_t(count) : 0;
+        std::vector<qint64> durations;
+        for (size_t i = first; i < samples.size(); ++i)
+            durations.push_back(samples[i].duration);
+        std::sort(durations.begin(), durations.end());
+
+        Summary &summary = result[n];
+        summary.count = int(durations.size());
+        summary.p50 = percentile(durations, 0.50);
+        summary.p95 = percentile(durations, 0.95);
+        summary.p99 = percentile(durations, 0.99);
+        summary.max = durations.back() / 1e6;
+    }
+    return result;
+}
+
+bool Profiler::writeChromeTrace(const QString &path, QString *error) {
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) {
+        if (error)
+            *error = file.errorString();
+        return false;
+    }
+
+    // Eventos "X" (início + duração) em microssegundos; "M" dá nome às threads
+    QTextStream out(&file);
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool firstEvent = true;
+    const auto separator = [&]() -> QTextStream & {
+        if (!firstEvent)
+            out << ",\n";
+        firstEvent = false;
+        return out;
+    };
+
+    for (Ring *ring : allRings()) {
+        const std::vector<Sample> samples = ring->snapshot();
+        separator() << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << ring->tid
+                    << ",\"args\":{\"name\":\"" << ring->threadName << "\"}}";
+        for (const Sample &sample : samples) {
+            separator() << "{\"name\":\"" << sample.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << ring->tid
+                        << ",\"ts\":" << QString::number(sample.start / 1000.0, 'f', 3)
+                        << ",\"dur\":" << QString::number(sample.duration / 1000.0, 'f', 3) << "}";
+        }
+    }
+    out << "\n]}\n";
+    out.flush();
+
+    if (file.error() != QFileDevice::NoError) {
+        if (error)
+            *error = file.errorString();
+        return false;
+    }
+    return true;
+}
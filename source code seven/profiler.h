@@ -0,0 +1,65 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <QString>
+#include <QVector>
+#include <QtGlobal>
+
+// Instrumentação leve: cada ProfileScope grava início e duração num anel
+// da própria thread (sem disputa entre threads). Desligado, o custo é uma
+// leitura atômica por escopo. As amostras alimentam o HUD da CanvasWidget
+// e podem ser exportadas no formato de trace do Chrome (chrome://tracing,
+// Perfetto).
+class Profiler {
+public:
+    static const int RingSize = 1 << 14;  // amostras guardadas por thread
+
+    struct Sample {
+        const char *name = nullptr;  // literal: só o ponteiro é guardado
+        qint64 start = 0;            // ns desde o início do processo
+        qint64 duration = 0;         // ns
+    };
+
+    struct Summary {
+        int count = 0;
+        double p50 = 0, p95 = 0, p99 = 0, max = 0;  // ms
+    };
+
+    static void setEnabled(bool enabled);
+    static bool isEnabled();
+
+    static qint64 now();
+    static void record(const char *name, qint64 start, qint64 duration);
+    static void clear();
+
+    // Percentis das últimas `count` amostras de cada nome, em todas as threads.
+    // Uma só passada pelos anéis para todos os nomes (o HUD pede vários).
+    static QVector<Summary> summaries(const QVector<const char *> &names, int count = 120);
+
+    static bool writeChromeTrace(const QString &path, QString *error = nullptr);
+};
+
+class ProfileScope {
+public:
+    explicit ProfileScope(const char *name)
+        : name(Profiler::isEnabled() ? name : nullptr),
+          start(this->name ? Profiler::now() : 0) {}
+
+    ~ProfileScope() {
+        if (name)
+            Profiler::record(name, start, Profiler::now() - start);
+    }
+
+    ProfileScope(const ProfileScope &) = delete;
+    ProfileScope &operator=(const ProfileScope &) = delete;
+
+private:
+    const char *name;
+    qint64 start;
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+
+#endif // PROFILER_H
@@ -0,0 +1,347 @@
+#include "projectfile.h"
+#include <QDataStream>
+#include <QFile>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QSemaphore>
+#include <QThreadPool>
+#include <climits>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+// Tags dos blocos
+const quint32 MetaTag = 0x4d455441;        // "META"
+const quint32 LayersTag = 0x4c415952;      // "LAYR"
+const quint32 CanvasTag = 0x434e5653;      // "CNVS" (versão 1; o "DRAW" dela é ignorado)
+const quint32 BackgroundTag = 0x424b4744;  // "BKGD"
+const quint32 TilesTag = 0x54494c45;       // "TILE"
+const quint32 HistoryTag = 0x48495354;     // "HIST"
+
+enum TileKind : quint8 { UniformTile = 0, PackedTile = 1 };
+
+struct ChunkEntry {
+    quint32 tag;
+    quint64 offset;
+    quint64 size;
+};
+
+// Arquivo aberto e mapeado; vive enquanto algum tile ainda apontar para ele
+struct MappedFile {
+    QFile file;
+    QByteArray fallback;  // conteúdo lido inteiro quando o mmap não é possível
+    const uchar *data = nullptr;
+    qint64 size = 0;
+
+    ~MappedFile() {
+        if (fallback.isEmpty() && data)
+            file.unmap(const_cast<uchar *>(data));
+    }
+};
+
+// Tile comprimido dentro do arquivo mapeado
+class MappedTile : public TileSource {
+public:
+    MappedTile(const QSharedPointer<MappedFile> &file, qint64 offset, int length,
+               const QSize &size, QImage::Format format)
+        : file(file), offset(offset), length(length), size(size), format(format) {}
+
+    QImage decode() override {
+        QMutexLocker locker(&mutex);
+        if (!cache.isNull())
+            return cache;
+
+        const QByteArray packed = QByteArray::fromRawData(
+            reinterpret_cast<const char *>(file->data + offset), length);
+        const QByteArray raw = qUncompress(packed);
+
+        cache = QImage(size, format);
+        const int rowBytes = size.width() * 4;
+        if (raw.size() == rowBytes * size.height()) {
+            for (int y = 0; y < size.height(); ++y)
+                std::memcpy(cache.scanLine(y), raw.constData() + y * rowBytes, size_t(rowBytes));
+        } else {
+            cache.fill(0);  // ✅ tile corrompido vira transparente em vez de derrubar o programa
+        }
+        return cache;
+    }
+
+private:
+    QSharedPointer<MappedFile> file;
+    qint64 offset;
+    int length;
+    QSize size;
+    QImage::Format format;
+    QMutex mutex;
+    QImage cache;
+};
+
+struct PackedTileData {
+    const TiledImage *layer;
+    int index;
+    QByteArray data;
+};
+
+QByteArray layerTable(const TiledImage &layer, std::vector<PackedTileData>::const_iterator &packed,
+                      quint64 &tileOffset) {
+    QByteArray table;
+    QDataStream out(&table, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_0);
+    out << layer.size() << qint32(layer.format()) << qint32(layer.tileCount());
+    for (int i = 0; i < layer.tileCount(); ++i) {
+        const TiledImage::Tile &tile = layer.tileAt(i);
+        if (tile.isUniform()) {
+            out << quint8(UniformTile) << tile.value;
+        } else {
+            out << quint8(PackedTile) << tileOffset << quint32(packed->data.size());
+            tileOffset += quint64(packed->data.size());
+            ++packed;
+        }
+    }
+    return table;
+}
+
+bool readLayer(const QByteArray &table, const QSharedPointer<MappedFile> &file,
+               const ChunkEntry &tiles, TiledImage &layer) {
+    QDataStream in(table);
+    in.setVersion(QDataStream::Qt_5_0);
+    QSize size;
+    qint32 format, count;
+    in >> size >> format >> count;
+    if (in.status() != QDataStream::Ok || size.isEmpty())
+        return false;
+
+    layer = TiledImage(size, static_cast<QImage::Format>(format));
+    if (count != layer.tileCount())
+        return false;
+
+    for (int i = 0; i < count; ++i) {
+        quint8 kind;
+        in >> kind;
+        if (kind == UniformTile) {
+            quint32 value;
+            in >> value;
+            layer.setUniform(i, value);
+            continue;
+        }
+
+        quint64 offset;
+        quint32 length;
+        in >> offset >> length;
+        if (in.status() != QDataStream::Ok || offset + length > tiles.size)
+            return false;
+
+        TiledImage::Tile tile;
+        tile.source.reset(new MappedTile(file, qint64(tiles.offset + offset), int(length),
+                                         layer.tileRect(i).size(), layer.format()));
+        layer.setTileAt(i, tile);
+    }
+    return in.status() == QDataStream::Ok;
+}
+
+} // namespace
+
+bool ProjectFile::save(const Contents &contents, const QString &path, const std::function<void(int)> &progress) {
+    // Mesma ordem em que as tabelas são escritas abaixo
+    QVector<const TiledImage *> layers;
+    for (const Layer &layer : contents.layers)
+        layers.append(&layer.image);
+    layers.append(&contents.background);
+
+    // Tiles com pixels de todas as camadas, comprimidos em paralelo
+    std::vector<PackedTileData> packed;
+    for (const TiledImage *layer : layers) {
+        layer->decodeAll();
+        for (int i = 0; i < layer->tileCount(); ++i) {
+            if (!layer->tileAt(i).isUniform())
+                packed.push_back({layer, i, QByteArray()});
+        }
+    }
+
+    QSemaphore done;
+    for (PackedTileData &tile : packed) {
+        QThreadPool::globalInstance()->start([&tile, &done] {
+            const QImage &img = tile.layer->tileAt(tile.index).image;
+            QByteArray raw;
+            raw.reserve(img.width() * img.height() * 4);
+            for (int y = 0; y < img.height(); ++y)
+                raw.append(reinterpret_cast<const char *>(img.constScanLine(y)), img.width() * 4);
+            tile.data = qCompress(raw, 1);
+            done.release();
+        });
+    }
+    for (size_t i = 0; i < packed.size(); ++i) {
+        done.acquire();
+        if (progress && i % 64 == 0)
+            progress(int(i * 100 / (packed.size() + 1)));
+    }
+
+    // Blocos
+    QVector<QPair<quint32, QByteArray>> chunks;
+
+    QByteArray meta;
+    {
+        QDataStream out(&meta, QIODevice::WriteOnly);
+        out.setVersion(QDataStream::Qt_5_0);
+        out << contents.backgroundColor << contents.exportTransparency << !contents.background.isNull();
+    }
+    chunks.append({MetaTag, meta});
+
+    auto next = packed.cbegin();
+    quint64 tileOffset = 0;
+    QByteArray layerChunk;
+    {
+        QDataStream out(&layerChunk, QIODevice::WriteOnly);
+        out.setVersion(QDataStream::Qt_5_0);
+        out << qint32(contents.activeLayer) << qint32(contents.layers.size());
+        for (const Layer &layer : contents.layers) {
+            out << layer.name << double(layer.opacity) << layer.visible << quint8(layer.mode)
+                << layerTable(layer.image, next, tileOffset);
+        }
+    }
+    chunks.append({LayersTag, layerChunk});
+    if (!contents.background.isNull())
+        chunks.append({BackgroundTag, layerTable(contents.background, next, tileOffset)});
+    const QByteArray history = contents.historyWriter ? contents.historyWriter() : contents.history;
+    if (!history.isEmpty())
+        chunks.append({HistoryTag, history});
+
+    // Diretório: magic, versão, quantidade e (tag, posição, tamanho) de cada bloco
+    const int tilesChunk = chunks.size();
+    const quint64 headerSize = 12 + quint64(tilesChunk + 1) * 20;
+    quint64 offset = headerSize;
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+    QDataStream out(&file);
+    out << Magic << Version << quint32(tilesChunk + 1);
+    for (const auto &chunk : chunks) {
+        out << chunk.first << offset << quint64(chunk.second.size());
+        offset += quint64(chunk.second.size());
+    }
+    out << TilesTag << offset << tileOffset;
+
+    for (const auto &chunk : chunks)
+        out.writeRawData(chunk.second.constData(), chunk.second.size());
+    for (const PackedTileData &tile : packed)
+        out.writeRawData(tile.data.constData(), tile.data.size());
+
+    const bool ok = out.status() == QDataStream::Ok && file.commit();
+    if (progress)
+        progress(100);
+    return ok;
+}
+
+bool ProjectFile::load(const QString &path, Contents &contents, QString *error) {
+    const auto fail = [error](const QString &message) {
+        if (error)
+            *error = message;
+        return false;
+    };
+
+    QSharedPointer<MappedFile> file(new MappedFile);
+    file->file.setFileName(path);
+    if (!file->file.open(QIODevice::ReadOnly))
+        return fail(file->file.errorString());
+
+    file->size = file->file.size();
+    file->data = file->file.map(0, file->size);
+    if (!file->data) {
+        file->fallback = file->file.readAll();
+        file->data = reinterpret_cast<const uchar *>(file->fallback.constData());
+    }
+
+    const QByteArray whole = QByteArray::fromRawData(reinterpret_cast<const char *>(file->data), int(qMin<qint64>(file->size, INT_MAX)));
+    QDataStream in(whole);
+    quint32 magic, version, count;
+    in >> magic >> version >> count;
+    if (in.status() != QDataStream::Ok || magic != Magic)
+        return fail("Not a LittlePaint project");
+    if (version > Version)
+        return fail("Project was saved by a newer version");
+
+    QVector<ChunkEntry> entries;
+    for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+        ChunkEntry entry;
+        in >> entry.tag >> entry.offset >> entry.size;
+        if (entry.offset + entry.size > quint64(file->size))
+            return fail("Truncated project file");
+        entries.append(entry);
+    }
+    if (in.status() != QDataStream::Ok)
+        return fail("Truncated project file");
+
+    const auto find = [&entries](quint32 tag) -> const ChunkEntry * {
+        for (const ChunkEntry &entry : entries) {
+            if (entry.tag == tag)
+                return &entry;
+        }
+        return nullptr;
+    };
+    const auto chunk = [&file](const ChunkEntry *entry) {
+        return QByteArray::fromRawData(reinterpret_cast<const char *>(file->data + entry->offset), int(entry->size));
+    };
+
+    const ChunkEntry *meta = find(MetaTag);
+    const ChunkEntry *layers = find(version >= 2 ? LayersTag : CanvasTag);
+    const ChunkEntry *tiles = find(TilesTag);
+    if (!meta || !layers || !tiles)
+        return fail("Project is missing required chunks");
+
+    Contents result;
+    bool hasBackground = false;
+    {
+        QDataStream metaIn(chunk(meta));
+        metaIn.setVersion(QDataStream::Qt_5_0);
+        metaIn >> result.backgroundColor >> result.exportTransparency >> hasBackground;
+    }
+
+    if (version >= 2) {
+        QDataStream layersIn(chunk(layers));
+        layersIn.setVersion(QDataStream::Qt_5_0);
+        qint32 active, layerCount;
+        layersIn >> active >> layerCount;
+        if (layersIn.status() != QDataStream::Ok || layerCount <= 0)
+            return fail("Corrupted layer table");
+
+        for (int i = 0; i < layerCount; ++i) {
+            Layer layer;
+            double opacity;
+            quint8 mode;
+            QByteArray table;
+            layersIn >> layer.name >> opacity >> layer.visible >> mode >> table;
+            if (layersIn.status() != QDataStream::Ok || mode > quint8(BlendMode::Overlay)
+                || !readLayer(table, file, *tiles, layer.image)
+                || (i > 0 && layer.image.size() != result.layers.first().image.size()))
+                return fail("Corrupted layer table");
+            layer.opacity = qBound(0.0, opacity, 1.0);
+            layer.mode = static_cast<BlendMode>(mode);
+            result.layers.append(layer);
+        }
+        result.activeLayer = qBound(0, int(active), result.layers.size() - 1);
+    } else {
+        // Versão 1: o canvas vira a única camada; a camada de desenho nunca
+        // recebia pixels e é ignorada
+        Layer layer;
+        layer.name = "Layer 1";
+        if (!readLayer(chunk(layers), file, *tiles, layer.image))
+            return fail("Corrupted layer table");
+        result.layers.append(layer);
+    }
+
+    const ChunkEntry *background = find(BackgroundTag);
+    if (hasBackground && (!background || !readLayer(chunk(background), file, *tiles, result.background)))
+        return fail("Corrupted background layer");
+
+    // O histórico é copiado: o UndoStack guarda os passos por conta própria.
+    // O da versão 1 guarda só o canvas e não serve para as camadas.
+    const ChunkEntry *history = find(HistoryTag);
+    if (history && version >= 2)
+        result.history = QByteArray(reinterpret_cast<const char *>(file->data + history->offset), int(history->size));
+
+    contents = result;
+    return true;
+}
@@ -0,0 +1,41 @@
+#ifndef PROJECTFILE_H
+#define PROJECTFILE_H
+
+#include <QByteArray>
+#include <QColor>
+#include <QString>
+#include <QVector>
+#include <functional>
+#include "layer.h"
+#include "tiledimage.h"
+
+// Formato nativo .lpaint: um diretório de blocos (tag, posição, tamanho)
+// seguido dos blocos. Cada camada guarda a grade de tiles; tiles uniformes
+// vão como um valor só e os demais comprimidos um a um no bloco TILE.
+// Na abertura o arquivo é mapeado em memória e cada tile só é descomprimido
+// quando alguém o lê pela primeira vez, então abrir é só ler as tabelas.
+// Versão 2: as camadas vão no bloco LAYR; arquivos da versão 1 (canvas e
+// camada de desenho) abrem como uma camada só, sem o histórico.
+class ProjectFile {
+public:
+    static const quint32 Magic = 0x4c504e54;  // "LPNT"
+    static const quint32 Version = 2;
+
+    struct Contents {
+        QVector<Layer> layers;  // de baixo para cima
+        int activeLayer = 0;
+        TiledImage background;  // nula quando não há imagem de fundo
+        QColor backgroundColor = Qt::white;
+        bool exportTransparency = false;
+        QByteArray history;     // UndoStack::save(); vazio se não for salvo
+        // Se existir, save() usa no lugar de history (UndoStack::saveSnapshot())
+        std::function<QByteArray()> historyWriter;
+    };
+
+    // progress recebe 0-100 na thread que chamou save()
+    static bool save(const Contents &contents, const QString &path,
+                     const std::function<void(int)> &progress = nullptr);
+    static bool load(const QString &path, Contents &contents, QString *error = nullptr);
+};
+
+#endif // PROJECTFILE_H
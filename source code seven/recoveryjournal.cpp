@@ -0,0 +1,269 @@
+#include "recoveryjournal.h"
+#include "document.h"
+#include "profiler.h"
+#include <QAtomicInt>
+#include <QCoreApplication>
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QStandardPaths>
+
+namespace {
+
+const quint32 JournalMagic = 0x4c504a52;  // "LPJR"
+const quint32 JournalVersion = 1;
+
+// Registros
+const quint32 SizeRecord = 0x53495a45;        // "SIZE": tamanho, formato e cor de fundo
+const quint32 TileRecord = 0x54494c45;        // "TILE": um tile
+const quint32 CheckpointRecord = 0x434b5054;  // "CKPT": fecha um checkpoint
+
+// Depois de tantos bytes acrescentados o diário é reescrito do zero
+const qint64 RewriteThreshold = 256ll * 1024 * 1024;
+
+} // namespace
+
+// Estado do arquivo, usado só pelo worker
+struct RecoveryJournal::Writer {
+    QMutex mutex;
+    QFile file;
+    qint64 appended = 0;
+    bool removed = false;
+    QAtomicInt rewrite;  // o worker pede que o próximo checkpoint grave tudo
+};
+
+RecoveryJournal::RecoveryJournal()
+    : writer(new Writer)
+{
+    workers.setMaxThreadCount(1);
+
+    QDir().mkpath(directory());
+    path = QString("%1/%2.lpjournal").arg(directory()).arg(QCoreApplication::applicationPid());
+    lock.reset(new QLockFile(path + ".lock"));
+    lock->setStaleLockTime(0);
+    lock->tryLock(0);
+    writer->file.setFileName(path);
+}
+
+RecoveryJournal::~RecoveryJournal() {
+    // Só uma queda pula o destrutor: qualquer outra saída (inclusive as que
+    // não passam pelo closeEvent, como o --replay) não deixa diário órfão
+    discard();
+}
+
+QString RecoveryJournal::directory() {
+    return QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation) + "/recovery";
+}
+
+// Mesmas camadas na mesma ordem, misturadas do mesmo jeito
+bool RecoveryJournal::sameBlending(const QVector<Layer> &a, const QVector<Layer> &b) {
+    if (a.size() != b.size())
+        return false;
+    for (int i = 0; i < a.size(); ++i) {
+        if (a[i].opacity255() != b[i].opacity255() || a[i].mode != b[i].mode)
+            return false;
+    }
+    return true;
+}
+
+void RecoveryJournal::checkpoint(const QVector<Layer> &layers, const QColor &background) {
+    if (layers.isEmpty() || layers.first().image.isNull())
+        return;
+
+    // Tamanho ou fundo mudaram: recomeça com a imagem inteira
+    const TiledImage &first = layers.first().image;
+    const bool reset = last.isEmpty() || last.first().image.size() != first.size()
+                    || lastBackground != background
+                    || writer->rewrite.testAndSetOrdered(1, 0);
+    // Opacidade, modo ou número de camadas mudaram: todos os tiles mudam
+    const bool everything = reset || !sameBlending(last, layers);
+
+    QVector<int> changes;
+    for (int i = 0; i < first.tileCount(); ++i) {
+        bool changed = everything;
+        for (int k = 0; k < layers.size() && !changed; ++k)
+            changed = !last[k].image.peekTile(i).sharesWith(layers[k].image.peekTile(i));
+        if (changed)
+            changes.append(i);
+    }
+    if (!reset && changes.isEmpty())
+        return;
+
+    last = layers;
+    lastBackground = background;
+
+    QSharedPointer<Writer> w = writer;
+    workers.start([w, layers, changes, reset, background] {
+        write(w, layers, changes, reset, background);
+    });
+}
+
+// Roda no worker
+void RecoveryJournal::write(QSharedPointer<Writer> writer, QVector<Layer> layers, QVector<int> changes,
+                            bool reset, QColor background) {
+    QMutexLocker locker(&writer->mutex);
+    if (writer->removed)
+        return;
+    // Diário fechado para reescrita: as mudanças esperam o checkpoint completo
+    if (!reset && !writer->file.isOpen())
+        return;
+
+    PROFILE_SCOPE("journal-write");
+
+    if (reset) {
+        writer->file.close();
+        if (!writer->file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+            return;
+        writer->appended = 0;
+
+        QDataStream header(&writer->file);
+        header << JournalMagic << JournalVersion;
+    }
+
+    // Cada registro: tag, tamanho do conteúdo e o conteúdo
+    const auto record = [&writer](quint32 tag, const QByteArray &payload) {
+        QDataStream out(&writer->file);
+        out << tag << quint32(payload.size());
+        out.writeRawData(payload.constData(), payload.size());
+        writer->appended += payload.size() + 8;
+    };
+
+    // Achatado aqui, tile a tile: tiles ainda no arquivo de projeto são
+    // decodificados no worker, fora da UI
+    TiledImage flat(layers.first().image.size(), TiledImage::LayerFormat);
+    if (reset) {
+        QByteArray payload;
+        QDataStream out(&payload, QIODevice::WriteOnly);
+        out.setVersion(QDataStream::Qt_5_0);
+        out << flat.size() << qint32(flat.format()) << background;
+        record(SizeRecord, payload);
+    }
+
+    for (int index : changes) {
+        QByteArray payload;
+        QDataStream out(&payload, QIODevice::WriteOnly);
+        out << qint32(index);
+
+        Document::flattenTile(flat, index, layers);
+        const TiledImage::Tile &tile = flat.tileAt(index);
+        if (tile.isUniform()) {
+            out << quint8(0) << tile.value;
+        } else {
+            const QImage img = tile.image;
+            QByteArray raw;
+            raw.reserve(img.width() * img.height() * 4);
+            for (int y = 0; y < img.height(); ++y)
+                raw.append(reinterpret_cast<const char *>(img.constScanLine(y)), img.width() * 4);
+            out << quint8(1) << qint32(img.width()) << qint32(img.height()) << qCompress(raw, 1);
+        }
+        record(TileRecord, payload);
+        flat.setUniform(index, 0);  // só um tile achatado por vez na memória
+    }
+
+    record(CheckpointRecord, QByteArray());
+    writer->file.flush();
+
+    // Diário grande demais: o próximo checkpoint grava a imagem inteira de novo
+    if (writer->appended > RewriteThreshold) {
+        writer->file.close();
+        writer->rewrite.storeRelease(1);
+    }
+}
+
+void RecoveryJournal::discard() {
+    workers.clear();
+    workers.waitForDone();
+
+    QMutexLocker locker(&writer->mutex);
+    writer->removed = true;
+    writer->file.close();
+    QFile::remove(path);
+    lock->unlock();
+}
+
+QStringList RecoveryJournal::orphanedJournals() {
+    QStringList result;
+    const QDir dir(directory());
+    for (const QString &name : dir.entryList(QStringList() << "*.lpjournal", QDir::Files, QDir::Time)) {
+        const QString journal = dir.filePath(name);
+        QLockFile lock(journal + ".lock");
+        if (lock.tryLock(0)) {
+            lock.unlock();
+            result.append(journal);
+        }
+    }
+    return result;
+}
+
+bool RecoveryJournal::recover(const QString &path, TiledImage &image, QColor &background) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    QDataStream in(&file);
+    quint32 magic, version;
+    in >> magic >> version;
+    if (in.status() != QDataStream::Ok || magic != JournalMagic || version > JournalVersion)
+        return false;
+
+    // Aplica os registros numa cópia e só aceita até o último CKPT completo
+    TiledImage working, committed;
+    QColor workingBackground, committedBackground;
+    while (!in.atEnd()) {
+        quint32 tag, length;
+        in >> tag >> length;
+        if (in.status() != QDataStream::Ok || length > quint32(file.size()))
+            break;
+        QByteArray payload(int(length), Qt::Uninitialized);
+        if (in.status() != QDataStream::Ok || in.readRawData(payload.data(), int(length)) != int(length))
+            break;  // registro cortado pela queda
+
+        QDataStream data(payload);
+        if (tag == SizeRecord) {
+            data.setVersion(QDataStream::Qt_5_0);
+            QSize size;
+            qint32 format;
+            data >> size >> format >> workingBackground;
+            working = TiledImage(size, static_cast<QImage::Format>(format));
+        } else if (tag == TileRecord && !working.isNull()) {
+            qint32 index;
+            quint8 kind;
+            data >> index >> kind;
+            if (index < 0 || index >= working.tileCount())
+                break;
+            if (kind == 0) {
+                quint32 value;
+                data >> value;
+                working.setUniform(index, value);
+            } else {
+                qint32 w, h;
+                QByteArray packed;
+                data >> w >> h >> packed;
+                const QByteArray raw = qUncompress(packed);
+                if (raw.size() != w * h * 4 || QSize(w, h) != working.tileRect(index).size())
+                    break;
+                TiledImage::Tile tile;
+                tile.image = QImage(w, h, working.format());
+                for (int y = 0; y < h; ++y)
+                    memcpy(tile.image.scanLine(y), raw.constData() + y * w * 4, size_t(w) * 4);
+                working.setTileAt(index, tile);
+            }
+        } else if (tag == CheckpointRecord) {
+            committed = working;
+            committedBackground = workingBackground;
+        }
+    }
+
+    if (committed.isNull())
+        return false;
+    image = committed;
+    background = committedBackground;
+    return true;
+}
+
+void RecoveryJournal::remove(const QString &path) {
+    QFile::remove(path);
+    QFile::remove(path + ".lock");
+}
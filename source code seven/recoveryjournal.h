@@ -0,0 +1,56 @@
+#ifndef RECOVERYJOURNAL_H
+#define RECOVERYJOURNAL_H
+
+#include <QColor>
+#include <QLockFile>
+#include <QScopedPointer>
+#include <QSharedPointer>
+#include <QString>
+#include <QStringList>
+#include <QThreadPool>
+#include "tiledimage.h"
+#include "layer.h"
+
+// Diário de recuperação do autosave. Cada checkpoint acrescenta ao arquivo
+// só os tiles em que alguma camada mudou de referência desde o checkpoint
+// anterior (a mesma comparação que o UndoStack faz ao empilhar um passo).
+// A thread de fundo achata esses tiles, comprime e grava; a UI só compara
+// ponteiros. Um registro CKPT fecha cada checkpoint:
+// na recuperação, tudo depois do último CKPT completo é ignorado.
+//
+// Cada instância usa seu próprio arquivo com um QLockFile; diários cujo
+// lock ficou órfão são de uma execução que não terminou direito.
+class RecoveryJournal {
+public:
+    RecoveryJournal();
+    ~RecoveryJournal();  // descarta a gravação pendente e apaga o diário, como discard()
+
+    // Grava as mudanças desde o último checkpoint; não bloqueia. O diário
+    // guarda as camadas já achatadas (sem o fundo)
+    void checkpoint(const QVector<Layer> &layers, const QColor &background);
+
+    // Saída limpa: apaga o diário desta instância
+    void discard();
+
+    // Diários deixados por execuções que caíram
+    static QStringList orphanedJournals();
+    static bool recover(const QString &path, TiledImage &image, QColor &background);
+    static void remove(const QString &path);
+
+private:
+    struct Writer;
+
+    static QString directory();
+    static bool sameBlending(const QVector<Layer> &a, const QVector<Layer> &b);
+    static void write(QSharedPointer<Writer> writer, QVector<Layer> layers, QVector<int> changes,
+                      bool reset, QColor background);
+
+    QString path;
+    QScopedPointer<QLockFile> lock;
+    QSharedPointer<Writer> writer;
+    QVector<Layer> last;         // camadas do último checkpoint (tiles compartilhados)
+    QColor lastBackground;
+    QThreadPool workers;         // último membro: é destruído primeiro e espera os jobs
+};
+
+#endif // RECOVERYJOURNAL_H
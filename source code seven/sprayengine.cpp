@@ -0,0 +1,132 @@
+#include "sprayengine.h"
+#include "pixelblend.h"
+#include <QRandomGenerator>
+#include <QtMath>
+
+namespace {
+
+// Seno e cosseno tabelados; 1024 ângulos bastam para pontos de spray
+const int AngleSteps = 1024;
+
+struct AngleTable {
+    float cosines[AngleSteps];
+    float sines[AngleSteps];
+
+    AngleTable() {
+        for (int i = 0; i < AngleSteps; ++i) {
+            cosines[i] = float(std::cos(2.0 * M_PI * i / AngleSteps));
+            sines[i] = float(std::sin(2.0 * M_PI * i / AngleSteps));
+        }
+    }
+};
+
+const AngleTable &angles() {
+    static const AngleTable table;
+    return table;
+}
+
+} // namespace
+
+quint32 SprayEngine::randomSeed() {
+    return QRandomGenerator::global()->generate() | 1u;  // xorshift nunca pode partir do zero
+}
+
+quint32 SprayEngine::nextRandom(quint32 &state) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+const SprayEngine::Dot &SprayEngine::dot(int diameter) {
+    // Mesmo formato do ponto que o QPen redondo desenhava (diâmetro = espessura)
+    thread_local Dot cached;
+    const int size = diameter + 2;
+    if (cached.size == size)
+        return cached;
+
+    cached.size = size;
+    cached.alpha.resize(size * size);
+    const qreal center = size / 2.0;
+    const qreal radius = diameter / 2.0;
+    for (int y = 0; y < size; ++y) {
+        for (int x = 0; x < size; ++x) {
+            const qreal d = std::hypot(x + 0.5 - center, y + 0.5 - center);
+            const qreal coverage = qBound<qreal>(0.0, radius + 0.5 - d, 1.0);
+            cached.alpha[y * size + x] = uchar(qRound(coverage * 255));
+        }
+    }
+    return cached;
+}
+
+QRect SprayEngine::spray(TiledImage &canvas, const QPoint &center, const Tool &tool) {
+    // xorshift32 por thread: sem trava e sem chamada ao gerador global por ponto
+    thread_local quint32 state = randomSeed();
+    return spray(canvas, center, tool, state);
+}
+
+QRect SprayEngine::spray(TiledImage &canvas, const QPoint &center, const Tool &tool, quint32 &random) {
+    const QRect area = tool.bounds(center, center).intersected(canvas.rect());
+    if (area.isEmpty())
+        return QRect();
+
+    const int radius = tool.thickness() * 2;
+    const int count = tool.thickness() * 5;
+    const QColor outline = tool.outlineColor();
+    const int strength = qBound(0, qRound(outline.alphaF() * tool.opacity() * 255), 255);
+    const quint32 color = outline.rgba();
+    const Dot &d = dot(qMax(1, tool.thickness()));
+    const int half = d.size / 2;
+
+    // Transmitância por pixel em ponto fixo de 16 bits (65535 = nada pintado)
+    QVector<quint16> transmit(area.width() * area.height(), 65535);
+
+    const AngleTable &table = angles();
+    for (int i = 0; i < count; ++i) {
+        const quint32 bits = nextRandom(random);
+        const float u = (bits >> 10) * (1.0f / 4194304.0f);  // 22 bits para o raio
+        const int a = bits & (AngleSteps - 1);               // 10 bits para o ângulo
+        const float r = radius * std::sqrt(u);
+        const int px = center.x() + qRound(r * table.cosines[a]);
+        const int py = center.y() + qRound(r * table.sines[a]);
+
+        const QRect rect = QRect(px - half, py - half, d.size, d.size).intersected(area);
+        for (int y = rect.top(); y <= rect.bottom(); ++y) {
+            const uchar *coverage = d.alpha.constData() + (y - (py - half)) * d.size + (rect.left() - (px - half));
+            quint16 *t = transmit.data() + (y - area.top()) * area.width() + (rect.left() - area.left());
+            for (int x = 0; x < rect.width(); ++x) {
+                const int alpha = (coverage[x] * strength + 127) / 255;
+                t[x] = quint16((t[x] * (255 - alpha) + 127) / 255);
+            }
+        }
+    }
+
+    // Passada única: mistura a cor só onde algum ponto caiu
+    const bool premultiplied = canvas.format() == QImage::Format_ARGB32_Premultiplied;
+    for (int index : canvas.tilesIn(area)) {
+        const QRect tr = canvas.tileRect(index);
+        const QRect part = tr.intersected(area);
+        QImage *img = nullptr;
+
+        for (int y = part.top(); y <= part.bottom(); ++y) {
+            const quint16 *t = transmit.constData() + (y - area.top()) * area.width() + (part.left() - area.left());
+            quint32 *dst = nullptr;
+            for (int x = 0; x < part.width(); ++x) {
+                if (t[x] == 65535)
+                    continue;
+                if (!dst) {
+                    // Tile uniforme ou compartilhado só é materializado se algo cair nele
+                    if (!img)
+                        img = &canvas.writableTile(index);
+                    dst = reinterpret_cast<quint32 *>(img->scanLine(y - tr.top())) + (part.left() - tr.left());
+                }
+                const int alpha = (65535 - t[x] + 128) / 257;
+                dst[x] = premultiplied ? blendOverPremultiplied(dst[x], color, alpha)
+                                       : blendOver(dst[x], color, alpha);
+            }
+        }
+        if (img)
+            canvas.compactTile(index);
+    }
+    return area;
+}
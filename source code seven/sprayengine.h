@@ -0,0 +1,35 @@
+#ifndef SPRAYENGINE_H
+#define SPRAYENGINE_H
+
+#include <QPoint>
+#include <QRect>
+#include <QVector>
+#include "tiledimage.h"
+#include "tool.h"
+
+// Spray em lote: os pontos saem de um xorshift por thread já dentro do
+// disco (raio = R * sqrt(u), sem rejeição), cada ponto carimba um disco
+// pré-calculado num buffer de transmitância, e no fim uma única passada
+// mistura a cor nos tiles. n pontos sobrepostos com alpha a dão
+// 1 - (1 - a)^n, igual a desenhar um por um com SourceOver.
+class SprayEngine {
+public:
+    // Uma rajada centrada em center; devolve a área alterada.
+    // canvas precisa ser ARGB32.
+    static QRect spray(TiledImage &canvas, const QPoint &center, const Tool &tool);
+    // Mesma rajada com o gerador de quem chama: a mesma semente repete os
+    // mesmos pontos (o histórico refaz o spray a partir dela)
+    static QRect spray(TiledImage &canvas, const QPoint &center, const Tool &tool, quint32 &random);
+    static quint32 randomSeed();
+
+private:
+    struct Dot {
+        int size = 0;           // lado do disco, em pixels
+        QVector<uchar> alpha;   // cobertura 0-255, size x size
+    };
+
+    static const Dot &dot(int diameter);
+    static quint32 nextRandom(quint32 &state);
+};
+
+#endif // SPRAYENGINE_H
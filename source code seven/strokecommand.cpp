@@ -0,0 +1,118 @@
+#include "strokecommand.h"
+#include "strokeengine.h"
+#include "sprayengine.h"
+#include <QDataStream>
+#include <QPainter>
+
+namespace {
+
+const int Subpixels = 16;
+
+} // namespace
+
+QPointF StrokeCommand::quantize(const QPointF &pos) {
+    return QPointF(qRound(pos.x() * Subpixels) / double(Subpixels), qRound(pos.y() * Subpixels) / double(Subpixels));
+}
+
+bool StrokeCommand::isEmpty() const {
+    return points.isEmpty();
+}
+
+void StrokeCommand::clear() {
+    points.clear();
+    cost = 0;
+}
+
+QRect StrokeCommand::apply(TiledImage &image) const {
+    if (points.isEmpty())
+        return QRect();
+
+    // Os mesmos passos que o Document faz ao vivo
+    QRect dirty;
+    switch (kind) {
+    case Kind::Stroke: {
+        StrokeEngine engine;
+        dirty = engine.begin(tool, image, points.first());
+        for (int i = 1; i < points.size(); ++i)
+            engine.addPoint(points[i]);
+        dirty |= engine.flush(image);
+        image.compact(engine.end());
+        break;
+    }
+    case Kind::Spray: {
+        quint32 random = seed;
+        for (const QPointF &pos : points)
+            dirty |= SprayEngine::spray(image, pos.toPoint(), tool, random);
+        break;
+    }
+    case Kind::Erase:
+        for (int i = 1; i < points.size(); ++i) {
+            const QPoint from = points[i - 1].toPoint();
+            const QPoint to = points[i].toPoint();
+            image.paint(tool.bounds(from, to), [&](QPainter &painter) {
+                painter.setRenderHint(QPainter::Antialiasing);
+                dirty |= tool.apply(painter, from, to);
+            });
+        }
+        break;
+    }
+    return dirty;
+}
+
+QByteArray StrokeCommand::save() const {
+    QByteArray raw;
+    QDataStream out(&raw, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_0);
+    out << quint8(kind) << qint32(layer) << layerSize << seed
+        << qint32(tool.type()) << tool.outlineColor() << tool.fillColor() << tool.fillEnabled()
+        << qint32(tool.thickness()) << tool.opacity() << qint32(tool.tolerance());
+
+    // Pontos como diferença do anterior em 1/16 de pixel: quase todos cabem
+    // em poucos bits e a compressão acaba de encolher
+    out << qint32(points.size());
+    QPoint last;
+    for (const QPointF &pos : points) {
+        const QPoint p(qRound(pos.x() * Subpixels), qRound(pos.y() * Subpixels));
+        out << qint32(p.x() - last.x()) << qint32(p.y() - last.y());
+        last = p;
+    }
+    return qCompress(raw, 1);
+}
+
+bool StrokeCommand::load(const QByteArray &data, StrokeCommand &command) {
+    const QByteArray raw = qUncompress(data);
+    QDataStream in(raw);
+    in.setVersion(QDataStream::Qt_5_0);
+
+    quint8 kind;
+    qint32 layer, type, thickness, tolerance, count;
+    QColor outline, fill;
+    bool filled;
+    float opacity;
+    in >> kind >> layer >> command.layerSize >> command.seed
+       >> type >> outline >> fill >> filled >> thickness >> opacity >> tolerance >> count;
+    if (in.status() != QDataStream::Ok || kind > quint8(Kind::Erase) || count < 0)
+        return false;
+
+    command.kind = Kind(kind);
+    command.layer = layer;
+    command.tool = Tool();
+    command.tool.setType(ToolType(type));
+    command.tool.setOutlineColor(outline);
+    command.tool.setFillColor(fill);
+    command.tool.setFillEnabled(filled);
+    command.tool.setThickness(thickness);
+    command.tool.setOpacity(opacity);
+    command.tool.setTolerance(tolerance);
+
+    command.points.clear();
+    command.points.reserve(count);
+    QPoint last;
+    for (int i = 0; i < count; ++i) {
+        qint32 dx, dy;
+        in >> dx >> dy;
+        last += QPoint(dx, dy);
+        command.points.append(QPointF(last) / Subpixels);
+    }
+    return in.status() == QDataStream::Ok;
+}
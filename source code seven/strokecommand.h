@@ -0,0 +1,42 @@
+#ifndef STROKECOMMAND_H
+#define STROKECOMMAND_H
+
+#include <QByteArray>
+#include <QPointF>
+#include <QRect>
+#include <QSize>
+#include <QVector>
+#include "tiledimage.h"
+#include "tool.h"
+
+// Traço à mão livre guardado como receita: ferramenta, camada, pontos e a
+// semente do spray. Reaplicado sobre a mesma camada dá exatamente os mesmos
+// pixels, então o histórico guarda alguns bytes por ponto em vez dos tiles
+// que o traço tocou.
+class StrokeCommand {
+public:
+    enum class Kind : quint8 { Stroke, Spray, Erase };
+
+    // Pontos do lápis e do pincel em 1/16 de pixel: é assim que são gravados,
+    // então o traço ao vivo já passa por aqui para o replay bater
+    static QPointF quantize(const QPointF &pos);
+
+    bool isEmpty() const;
+    void clear();
+
+    // Refaz o traço na camada (do tamanho layerSize)
+    QRect apply(TiledImage &layer) const;
+
+    QByteArray save() const;
+    static bool load(const QByteArray &data, StrokeCommand &command);
+
+    Kind kind = Kind::Stroke;
+    Tool tool;
+    int layer = 0;           // índice da camada no momento do traço
+    QSize layerSize;
+    quint32 seed = 0;        // estado inicial do gerador do spray
+    QVector<QPointF> points;
+    qint64 cost = 0;         // ns gastos ao vivo: estimativa do custo de refazer
+};
+
+#endif // STROKECOMMAND_H
@@ -0,0 +1,197 @@
+#include "strokeengine.h"
+#include "pixelblend.h"
+#include "profiler.h"
+#include <QLineF>
+#include <QtMath>
+#include <algorithm>
+
+bool StrokeEngine::handles(ToolType type) {
+    return type == ToolType::Pencil || type == ToolType::Brush;
+}
+
+QRect StrokeEngine::begin(const Tool &tool, const TiledImage &canvas, const QPointF &pos) {
+    active = true;
+    before = canvas;
+    masks.clear();
+    pending.clear();
+    strokeArea = QRect();
+
+    const QColor outline = tool.outlineColor();
+    color = outline.rgba();
+    strength = qBound(0, qRound(outline.alphaF() * tool.opacity() * 255), 255);
+
+    // Lápis tem borda dura; pincel tem borda com antialiasing
+    const qreal newRadius = qMax<qreal>(0.5, tool.thickness() / 2.0);
+    const bool newAntialiased = tool.type() == ToolType::Brush;
+    if (newRadius != radius || newAntialiased != antialiased)
+        tips.clear();
+    radius = newRadius;
+    antialiased = newAntialiased;
+    spacing = qMax<qreal>(0.5, radius * 0.25);
+
+    // O primeiro flush carimba exatamente em pos
+    last = pos;
+    lastQueued = pos;
+    carry = 0;
+    pending.append(pos);
+    return dabRect(pos);
+}
+
+QRect StrokeEngine::addPoint(const QPointF &pos) {
+    if (!active)
+        return QRect();
+
+    // Eventos quase no mesmo lugar não acrescentam nada ao traço
+    if (QLineF(lastQueued, pos).length() < 0.25)
+        return QRect();
+
+    const QRect area = dabRect(lastQueued) | dabRect(pos);
+    pending.append(pos);
+    lastQueued = pos;
+    return area;
+}
+
+bool StrokeEngine::isActive() const {
+    return active;
+}
+
+bool StrokeEngine::hasPending() const {
+    return active && !pending.isEmpty();
+}
+
+QRect StrokeEngine::flush(TiledImage &canvas) {
+    QRect dirty;
+    if (!hasPending())
+        return dirty;
+
+    PROFILE_SCOPE("stroke-flush");
+
+    // Interpola todos os pontos acumulados desde o último quadro
+    for (const QPointF &point : pending) {
+        const QLineF segment(last, point);
+        const qreal length = segment.length();
+        qreal distance = carry;
+        while (distance <= length) {
+            stamp(length > 0 ? segment.pointAt(distance / length) : point, dirty);
+            distance += spacing;
+        }
+        carry = distance - length;
+        last = point;
+    }
+    pending.clear();
+
+    compose(canvas, dirty);
+    strokeArea |= dirty;
+    return dirty;
+}
+
+QRect StrokeEngine::end() {
+    const QRect area = strokeArea;
+    active = false;
+    before = TiledImage();
+    masks.clear();
+    pending.clear();
+    strokeArea = QRect();
+    return area;
+}
+
+const StrokeEngine::Tip &StrokeEngine::tip(int phaseX, int phaseY) {
+    if (tips.isEmpty())
+        tips.resize(Phases * Phases);
+
+    Tip &t = tips[phaseY * Phases + phaseX];
+    if (t.size > 0)
+        return t;
+
+    // O centro fica no meio da fase subpixel, a half + (fase + 0.5) / Phases
+    t.size = 2 * qCeil(radius) + 3;
+    t.alpha.resize(t.size * t.size);
+    const int half = t.size / 2;
+    const qreal cx = half + (phaseX + 0.5) / Phases;
+    const qreal cy = half + (phaseY + 0.5) / Phases;
+
+    for (int y = 0; y < t.size; ++y) {
+        for (int x = 0; x < t.size; ++x) {
+            const qreal d = std::hypot(x + 0.5 - cx, y + 0.5 - cy);
+            qreal coverage;
+            if (antialiased)
+                coverage = qBound<qreal>(0.0, radius + 0.5 - d, 1.0);
+            else
+                coverage = d <= radius ? 1.0 : 0.0;
+            t.alpha[y * t.size + x] = uchar(qRound(coverage * 255));
+        }
+    }
+    return t;
+}
+
+QRect StrokeEngine::dabRect(const QPointF &center) const {
+    const int size = 2 * qCeil(radius) + 3;
+    const int half = size / 2;
+    return QRect(qFloor(center.x()) - half, qFloor(center.y()) - half, size, size);
+}
+
+void StrokeEngine::stamp(const QPointF &center, QRect &dirty) {
+    const int ix = qFloor(center.x());
+    const int iy = qFloor(center.y());
+    const int phaseX = qMin(Phases - 1, int((center.x() - ix) * Phases));
+    const int phaseY = qMin(Phases - 1, int((center.y() - iy) * Phases));
+    const Tip &t = tip(phaseX, phaseY);
+
+    const QRect rect = dabRect(center);
+    const QRect area = rect.intersected(before.rect());
+    if (area.isEmpty())
+        return;
+
+    for (int index : before.tilesIn(area)) {
+        const QRect tr = before.tileRect(index);
+        const QRect part = tr.intersected(area);
+
+        QImage &mask = masks[index];
+        if (mask.isNull()) {
+            mask = QImage(tr.size(), QImage::Format_Alpha8);
+            mask.fill(0);
+        }
+
+        for (int y = part.top(); y <= part.bottom(); ++y) {
+            const uchar *src = t.alpha.constData() + (y - rect.top()) * t.size + (part.left() - rect.left());
+            uchar *dst = mask.scanLine(y - tr.top()) + (part.left() - tr.left());
+            for (int x = 0; x < part.width(); ++x)
+                dst[x] = qMax(dst[x], src[x]);
+        }
+    }
+    dirty |= area;
+}
+
+// SourceOver da cor do traço, com alpha = cobertura x strength, sobre o
+// canvas do início do traço; ARGB32 com ou sem pré-multiplicação
+void StrokeEngine::compose(TiledImage &canvas, const QRect &area) {
+    const bool premultiplied = canvas.format() == QImage::Format_ARGB32_Premultiplied;
+    for (int index : canvas.tilesIn(area)) {
+        const auto found = masks.constFind(index);
+        if (found == masks.constEnd())
+            continue;
+
+        const QRect tr = canvas.tileRect(index);
+        const QRect part = tr.intersected(area);
+        const QImage &mask = found.value();
+        const TiledImage::Tile &base = before.tileAt(index);
+        QImage &img = canvas.writableTile(index);
+
+        for (int y = part.top() - tr.top(); y <= part.bottom() - tr.top(); ++y) {
+            const uchar *coverage = mask.constScanLine(y);
+            const quint32 *src = base.isUniform() ? nullptr
+                               : reinterpret_cast<const quint32 *>(base.image.constScanLine(y));
+            quint32 *dst = reinterpret_cast<quint32 *>(img.scanLine(y));
+
+            for (int x = part.left() - tr.left(); x <= part.right() - tr.left(); ++x) {
+                if (coverage[x] == 0)
+                    continue;
+
+                const quint32 under = src ? src[x] : base.value;
+                const int alpha = (coverage[x] * strength + 127) / 255;
+                dst[x] = premultiplied ? blendOverPremultiplied(under, color, alpha)
+                                       : blendOver(under, color, alpha);
+            }
+        }
+    }
+}
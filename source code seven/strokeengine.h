@@ -0,0 +1,70 @@
+#ifndef STROKEENGINE_H
+#define STROKEENGINE_H
+
+#include <QColor>
+#include <QHash>
+#include <QImage>
+#include <QPointF>
+#include <QRect>
+#include <QVector>
+#include "tiledimage.h"
+#include "tool.h"
+
+// Traço do lápis e do pincel por carimbos ("dabs"): os pontos do mouse só
+// entram numa fila, e uma vez por quadro a fila é interpolada com um dab a
+// cada spacing pixels. Cada dab sai de uma ponta pré-calculada e marca uma
+// máscara de cobertura por tile (o máximo, então dabs sobrepostos não
+// escurecem com opacidade < 1). Os tiles tocados são recompostos direto nos
+// pixels a partir da cópia do canvas feita no início do traço.
+class StrokeEngine {
+public:
+    static bool handles(ToolType type);
+
+    // Começa um traço em pos (coordenadas da imagem); canvas precisa ser ARGB32.
+    // Devolve a área que o primeiro dab vai alterar.
+    QRect begin(const Tool &tool, const TiledImage &canvas, const QPointF &pos);
+
+    // Enfileira um ponto e devolve a área que ele vai alterar no próximo flush
+    QRect addPoint(const QPointF &pos);
+
+    bool isActive() const;
+    bool hasPending() const;
+
+    // Carimba os pontos pendentes no canvas e devolve a área alterada
+    QRect flush(TiledImage &canvas);
+
+    // Encerra o traço e devolve toda a área que ele tocou
+    QRect end();
+
+private:
+    static const int Phases = 4;  // posições subpixel da ponta por eixo
+
+    struct Tip {
+        int size = 0;          // lado da ponta, em pixels
+        QVector<uchar> alpha;  // cobertura 0-255, size x size
+    };
+
+    const Tip &tip(int phaseX, int phaseY);
+    QRect dabRect(const QPointF &center) const;
+    void stamp(const QPointF &center, QRect &dirty);
+    void compose(TiledImage &canvas, const QRect &area);
+
+    bool active = false;
+    TiledImage before;          // canvas no início do traço (tiles compartilhados)
+    QHash<int, QImage> masks;   // cobertura acumulada por tile (Format_Alpha8)
+    QVector<QPointF> pending;
+    QPointF last;               // último ponto já carimbado
+    QPointF lastQueued;
+    qreal carry = 0;            // distância até o próximo dab
+    QRect strokeArea;
+
+    // Ponta atual
+    quint32 color = 0;          // ARGB sem pré-multiplicação
+    int strength = 255;         // alpha da cor x opacidade da ferramenta
+    qreal radius = 0.5;
+    qreal spacing = 1.0;
+    bool antialiased = true;
+    QVector<Tip> tips;          // Phases x Phases variantes, criadas sob demanda
+};
+
+#endif // STROKEENGINE_H
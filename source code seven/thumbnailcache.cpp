@@ -0,0 +1,66 @@
+#include "thumbnailcache.h"
+#include "document.h"
+#include "mipmap.h"
+#include "profiler.h"
+#include <QMetaObject>
+
+ThumbnailCache::ThumbnailCache(QObject *parent)
+    : QObject(parent)
+{
+    // Um worker só: miniatura não pode disputar CPU com o desenho
+    workers.setMaxThreadCount(1);
+}
+
+ThumbnailCache::~ThumbnailCache() {
+    workers.clear();
+    workers.waitForDone();
+}
+
+void ThumbnailCache::request(int key, const QVector<Layer> &layers) {
+    const int gen = generation;
+    workers.start([this, key, layers, gen] {
+        QImage thumb;
+        {
+            // Achatar aqui decodifica tiles de projeto recém-aberto fora da UI
+            PROFILE_SCOPE("thumbnail");
+            thumb = MipmapPyramid::thumbnail(Document::flatten(layers), QSize(Width, Height));
+        }
+        QMetaObject::invokeMethod(this, [this, key, thumb, gen] { store(key, thumb, gen); },
+                                  Qt::QueuedConnection);
+    });
+}
+
+bool ThumbnailCache::contains(int key) const {
+    return images.contains(key);
+}
+
+QImage ThumbnailCache::thumbnail(int key) {
+    const auto it = images.constFind(key);
+    if (it == images.constEnd())
+        return QImage();
+    order.removeOne(key);
+    order.append(key);
+    return it.value();
+}
+
+void ThumbnailCache::clear() {
+    workers.clear();
+    images.clear();
+    order.clear();
+    ++generation;
+}
+
+void ThumbnailCache::store(int key, const QImage &image, int gen) {
+    if (gen != generation || image.isNull())
+        return;
+
+    order.removeOne(key);
+    order.append(key);
+    images.insert(key, image);
+    while (order.size() > Capacity) {
+        const int oldest = order.takeFirst();
+        images.remove(oldest);
+        emit evicted(oldest);
+    }
+    emit ready(key);
+}
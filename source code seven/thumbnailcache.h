@@ -0,0 +1,49 @@
+#ifndef THUMBNAILCACHE_H
+#define THUMBNAILCACHE_H
+
+#include <QObject>
+#include <QHash>
+#include <QImage>
+#include <QSize>
+#include <QThreadPool>
+#include <QVector>
+#include "layer.h"
+
+// Miniaturas dos nós do histórico. request() recebe as camadas por valor
+// (os tiles ficam compartilhados, nada é copiado nem decodificado) e um
+// worker achata e reduz pela pirâmide de mipmaps. O resultado entra num LRU de tamanho fixo: a sessão
+// pode ter milhares de passos sem que a memória das miniaturas cresça.
+class ThumbnailCache : public QObject {
+    Q_OBJECT
+
+public:
+    static const int Capacity = 64;
+    static const int Width = 100;
+    static const int Height = 75;
+
+    explicit ThumbnailCache(QObject *parent = nullptr);
+    ~ThumbnailCache() override;  // espera o worker
+
+    // O estado de um nó não muda, então pedir de novo uma chave já na fila
+    // só repete o trabalho; quem chama evita isso com contains()
+    void request(int key, const QVector<Layer> &layers);
+    bool contains(int key) const;
+    // Nula se não estiver no cache; achar conta como uso recente
+    QImage thumbnail(int key);
+    // Descarta tudo, inclusive o que o worker ainda vai entregar
+    void clear();
+
+signals:
+    void ready(int key);
+    void evicted(int key);
+
+private:
+    void store(int key, const QImage &image, int generation);
+
+    QHash<int, QImage> images;
+    QVector<int> order;   // do menos para o mais recente
+    int generation = 0;   // muda no clear(): entregas antigas são ignoradas
+    QThreadPool workers;
+};
+
+#endif // THUMBNAILCACHE_H
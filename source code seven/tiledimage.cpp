@@ -0,0 +1,471 @@
+#include "tiledimage.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+inline const quint32 *constRow(const QImage &image, int y) {
+    return reinterpret_cast<const quint32 *>(image.constScanLine(y));
+}
+
+inline quint32 *row(QImage &image, int y) {
+    return reinterpret_cast<quint32 *>(image.scanLine(y));
+}
+
+// Todos os pixels de rect em image valem value?
+bool regionIsUniform(const QImage &image, const QRect &rect, quint32 value) {
+    for (int y = rect.top(); y <= rect.bottom(); ++y) {
+        const quint32 *line = constRow(image, y) + rect.left();
+        for (int x = 0; x < rect.width(); ++x) {
+            if (line[x] != value)
+                return false;
+        }
+    }
+    return true;
+}
+
+// Converte na decodificação, para não perder a leitura preguiçosa
+class ConvertedSource : public TileSource {
+public:
+    ConvertedSource(const QSharedPointer<TileSource> &inner, QImage::Format format)
+        : inner(inner), format(format) {}
+
+    QImage decode() override {
+        return inner->decode().convertToFormat(format);
+    }
+
+private:
+    QSharedPointer<TileSource> inner;
+    QImage::Format format;
+};
+
+} // namespace
+
+bool TiledImage::Tile::sharesWith(const Tile &other) const {
+    if (source || other.source)
+        return source == other.source;
+    if (isUniform() || other.isUniform())
+        return isUniform() && other.isUniform() && value == other.value;
+    return image.constBits() == other.image.constBits();
+}
+
+qint64 TiledImage::Tile::memoryUsage() const {
+    return image.isNull() ? 0 : image.sizeInBytes();
+}
+
+TiledImage::TiledImage() = default;
+
+TiledImage::TiledImage(const QSize &size, QImage::Format format, const QColor &fill)
+    : imageSize(size),
+      imageFormat(format)
+{
+    tiles.resize(tilesX() * tilesY());
+    this->fill(fill);
+}
+
+TiledImage TiledImage::fromImage(const QImage &image) {
+    const QImage src = image.depth() == 32 ? image : image.convertToFormat(LayerFormat);
+
+    TiledImage result;
+    result.imageSize = src.size();
+    result.imageFormat = src.format();
+    result.tiles.resize(result.tilesX() * result.tilesY());
+    for (int i = 0; i < result.tiles.size(); ++i) {
+        result.tiles[i].image = src.copy(result.tileRect(i));
+        result.compactTile(i);
+    }
+    return result;
+}
+
+TiledImage TiledImage::convertedTo(QImage::Format format) const {
+    if (format == imageFormat || isNull())
+        return *this;
+
+    TiledImage result;
+    result.imageSize = imageSize;
+    result.imageFormat = format;
+    result.tiles.resize(tiles.size());
+    for (int i = 0; i < tiles.size(); ++i) {
+        const Tile &tile = tiles.at(i);
+        Tile &out = result.tiles[i];
+        if (tile.source)
+            out.source.reset(new ConvertedSource(tile.source, format));
+        else if (tile.isUniform())
+            out.value = toPixel(toColor(tile.value, imageFormat), format);
+        else
+            out.image = tile.image.convertToFormat(format);
+    }
+    return result;
+}
+
+bool TiledImage::isNull() const { return imageSize.isEmpty(); }
+QSize TiledImage::size() const { return imageSize; }
+int TiledImage::width() const { return imageSize.width(); }
+int TiledImage::height() const { return imageSize.height(); }
+QRect TiledImage::rect() const { return QRect(QPoint(0, 0), imageSize); }
+QImage::Format TiledImage::format() const { return imageFormat; }
+
+int TiledImage::tilesX() const { return (imageSize.width() + TileSize - 1) / TileSize; }
+int TiledImage::tilesY() const { return (imageSize.height() + TileSize - 1) / TileSize; }
+int TiledImage::tileCount() const { return tiles.size(); }
+int TiledImage::tileIndex(int tx, int ty) const { return ty * tilesX() + tx; }
+
+QRect TiledImage::tileRect(int index) const {
+    const int tx = index % tilesX();
+    const int ty = index / tilesX();
+    return QRect(tx * TileSize, ty * TileSize, TileSize, TileSize).intersected(rect());
+}
+
+QVector<int> TiledImage::tilesIn(const QRect &area) const {
+    QVector<int> result;
+    const QRect clipped = area.intersected(rect());
+    if (clipped.isEmpty())
+        return result;
+
+    for (int ty = clipped.top() / TileSize; ty <= clipped.bottom() / TileSize; ++ty) {
+        for (int tx = clipped.left() / TileSize; tx <= clipped.right() / TileSize; ++tx)
+            result.append(tileIndex(tx, ty));
+    }
+    return result;
+}
+
+QVector<int> TiledImage::tilesIn(const QRegion &region) const {
+    QVector<int> result;
+    QVector<bool> seen(tiles.size(), false);
+    for (const QRect &area : region) {
+        for (int index : tilesIn(area)) {
+            if (!seen[index]) {
+                seen[index] = true;
+                result.append(index);
+            }
+        }
+    }
+    return result;
+}
+
+QRegion TiledImage::tileBounds(const QRegion &region) const {
+    QRegion bounds;
+    for (const QRect &area : region) {
+        const QRect clipped = area.intersected(rect());
+        if (clipped.isEmpty())
+            continue;
+        const int first = tileIndex(clipped.left() / TileSize, clipped.top() / TileSize);
+        const int last = tileIndex(clipped.right() / TileSize, clipped.bottom() / TileSize);
+        bounds += tileRect(first).united(tileRect(last));
+    }
+    return bounds;
+}
+
+const TiledImage::Tile &TiledImage::tileAt(int index) const {
+    // Leitura sem desanexar o vetor; só o caminho da decodificação escreve
+    const Tile &tile = tiles.at(index);
+    if (!tile.source)
+        return tile;
+
+    Tile &loaded = tiles[index];
+    loaded.image = loaded.source->decode();
+    loaded.source.reset();
+    return loaded;
+}
+
+const TiledImage::Tile &TiledImage::peekTile(int index) const {
+    return tiles.at(index);
+}
+
+void TiledImage::decodeAll() const {
+    for (int i = 0; i < tiles.size(); ++i)
+        tileAt(i);
+}
+
+void TiledImage::setTileAt(int index, const Tile &tile) {
+    tiles[index] = tile;
+}
+
+void TiledImage::setUniform(int index, quint32 value) {
+    Tile &tile = tiles[index];
+    tile.image = QImage();
+    tile.source.reset();
+    tile.value = value;
+}
+
+QImage TiledImage::tileImage(int index) const {
+    const Tile &tile = tileAt(index);
+    if (!tile.isUniform())
+        return tile.image;
+
+    QImage img(tileRect(index).size(), imageFormat);
+    img.fill(tile.value);
+    return img;
+}
+
+QImage &TiledImage::writableTile(int index) {
+    tileAt(index);
+    Tile &tile = tiles[index];
+    if (tile.isUniform())
+        tile.image = tileImage(index);
+    else
+        tile.image.bits();  // desanexa de cópias compartilhadas (histórico, composição)
+    return tile.image;
+}
+
+bool TiledImage::compactTile(int index) {
+    const Tile &tile = tileAt(index);
+    if (tile.isUniform())
+        return true;
+
+    const quint32 first = constRow(tile.image, 0)[0];
+    if (!regionIsUniform(tile.image, tile.image.rect(), first))
+        return false;
+
+    setUniform(index, first);
+    return true;
+}
+
+void TiledImage::compact(const QRect &area) {
+    for (int index : tilesIn(area))
+        compactTile(index);
+}
+
+void TiledImage::fill(const QColor &color) {
+    const quint32 value = toPixel(color, imageFormat);
+    for (int i = 0; i < tiles.size(); ++i)
+        setUniform(i, value);
+}
+
+quint32 TiledImage::pixel(const QPoint &pos) const {
+    const int index = tileIndex(pos.x() / TileSize, pos.y() / TileSize);
+    const Tile &tile = tileAt(index);
+    if (tile.isUniform())
+        return tile.value;
+    return constRow(tile.image, pos.y() % TileSize)[pos.x() % TileSize];
+}
+
+QColor TiledImage::pixelColor(const QPoint &pos) const {
+    if (!rect().contains(pos))
+        return QColor();
+    return toColor(pixel(pos), imageFormat);
+}
+
+QImage TiledImage::copy(const QRect &area) const {
+    QImage out(area.size(), imageFormat);
+    if (out.isNull())
+        return out;
+    if (!rect().contains(area))
+        out.fill(0);
+
+    for (int index : tilesIn(area)) {
+        const QRect tr = tileRect(index);
+        const QRect part = tr.intersected(area);
+        const Tile &tile = tileAt(index);
+
+        for (int y = part.top(); y <= part.bottom(); ++y) {
+            quint32 *dst = row(out, y - area.top()) + (part.left() - area.left());
+            if (tile.isUniform())
+                std::fill(dst, dst + part.width(), tile.value);
+            else
+                std::memcpy(dst, constRow(tile.image, y - tr.top()) + (part.left() - tr.left()),
+                            size_t(part.width()) * 4);
+        }
+    }
+    return out;
+}
+
+QImage TiledImage::toImage() const {
+    return copy(rect());
+}
+
+void TiledImage::render(QPainter &painter, const QRect &area) const {
+    for (int index : tilesIn(area)) {
+        const QRect tr = tileRect(index);
+        const QRect part = tr.intersected(area);
+        const Tile &tile = tileAt(index);
+        if (tile.isUniform())
+            painter.fillRect(part, toColor(tile.value, imageFormat));
+        else
+            painter.drawImage(part.topLeft(), tile.image, part.translated(-tr.topLeft()));
+    }
+}
+
+void TiledImage::renderScaled(QPainter &painter, const QRect &target, int factor) const {
+    if (factor <= 1) {
+        render(painter, target);
+        return;
+    }
+
+    const QRect area = QRect(QPoint(target.left() / factor, target.top() / factor),
+                             QPoint(target.right() / factor, target.bottom() / factor)).intersected(rect());
+    for (int index : tilesIn(area)) {
+        const QRect tr = tileRect(index);
+        const QRect dest = QRect(tr.topLeft() * factor, tr.size() * factor).intersected(target);
+        if (dest.isEmpty())
+            continue;
+        const Tile &tile = tileAt(index);
+        if (tile.isUniform()) {
+            painter.fillRect(dest, toColor(tile.value, imageFormat));
+            continue;
+        }
+
+        // Linhas que saem da mesma linha da fonte são cópias da anterior
+        QImage block(dest.size(), imageFormat);
+        for (int y = dest.top(); y <= dest.bottom(); ++y) {
+            quint32 *dst = row(block, y - dest.top());
+            if (y > dest.top() && y % factor != 0) {
+                std::memcpy(dst, constRow(block, y - dest.top() - 1), size_t(dest.width()) * 4);
+                continue;
+            }
+            const quint32 *src = constRow(tile.image, y / factor - tr.top());
+            for (int x = dest.left(); x <= dest.right();) {
+                const int end = std::min(dest.right() + 1, (x / factor + 1) * factor);
+                std::fill(dst, dst + (end - x), src[x / factor - tr.left()]);
+                dst += end - x;
+                x = end;
+            }
+        }
+        painter.drawImage(dest.topLeft(), block);
+    }
+}
+
+QImage TiledImage::scaled(const QSize &size, Qt::AspectRatioMode mode) const {
+    const QSize target = imageSize.scaled(size, mode);
+    QImage out(target, imageFormat);
+    if (out.isNull())
+        return out;
+    out.fill(0);
+
+    QPainter painter(&out);
+    painter.setRenderHint(QPainter::SmoothPixmapTransform);
+    painter.scale(double(target.width()) / width(), double(target.height()) / height());
+    render(painter, rect());
+    return out;
+}
+
+void TiledImage::write(const QPoint &pos, const QImage &image) {
+    const QImage src = image.format() == imageFormat ? image : image.convertToFormat(imageFormat);
+    const QRect target = QRect(pos, src.size()).intersected(rect());
+
+    for (int index : tilesIn(target)) {
+        const QRect tr = tileRect(index);
+        const QRect part = tr.intersected(target);
+        const QRect srcPart = part.translated(-pos);
+        tileAt(index);
+        Tile &tile = tiles[index];
+
+        // Nada mudou neste tile: não materializa nem desanexa
+        bool same = true;
+        for (int y = 0; y < part.height() && same; ++y) {
+            const quint32 *s = constRow(src, srcPart.top() + y) + srcPart.left();
+            if (tile.isUniform()) {
+                same = std::all_of(s, s + part.width(), [&](quint32 p) { return p == tile.value; });
+            } else {
+                const quint32 *d = constRow(tile.image, part.top() - tr.top() + y) + (part.left() - tr.left());
+                same = std::memcmp(s, d, size_t(part.width()) * 4) == 0;
+            }
+        }
+        if (same)
+            continue;
+
+        if (part == tr) {
+            // Cobre o tile inteiro: copia a região, e se tiver uma cor só guarda o valor
+            const quint32 first = constRow(src, srcPart.top())[srcPart.left()];
+            if (regionIsUniform(src, srcPart, first)) {
+                setUniform(index, first);
+            } else {
+                tile.image = src.copy(srcPart);
+            }
+            continue;
+        }
+
+        QImage &img = writableTile(index);
+        for (int y = 0; y < part.height(); ++y) {
+            std::memcpy(row(img, part.top() - tr.top() + y) + (part.left() - tr.left()),
+                        constRow(src, srcPart.top() + y) + srcPart.left(),
+                        size_t(part.width()) * 4);
+        }
+        compactTile(index);
+    }
+}
+
+void TiledImage::paint(const QRect &bounds, const std::function<void(QPainter &)> &draw) {
+    const QRect area = bounds.intersected(rect());
+    if (area.isEmpty())
+        return;
+
+    QImage window = copy(area);
+    {
+        QPainter painter(&window);
+        painter.translate(-area.topLeft());
+        draw(painter);
+    }
+    write(area.topLeft(), window);
+}
+
+void TiledImage::drawTile(int index, const Tile &src, const QSize &srcSize, QImage::Format srcFormat) {
+    const QRect tr = tileRect(index);
+    const QSize covered = srcSize.boundedTo(tr.size());
+    const bool full = covered == tr.size();
+
+    if (src.isUniform()) {
+        const QColor color = toColor(src.value, srcFormat);
+        if (color.alpha() == 0)
+            return;
+        if (full && color.alpha() == 255) {
+            setUniform(index, toPixel(color, imageFormat));
+            return;
+        }
+        if (full && tileAt(index).isUniform()) {
+            // Duas cores sólidas: mistura um pixel só
+            QImage pixel(1, 1, imageFormat);
+            pixel.fill(tileAt(index).value);
+            QPainter painter(&pixel);
+            painter.fillRect(0, 0, 1, 1, color);
+            painter.end();
+            setUniform(index, constRow(pixel, 0)[0]);
+            return;
+        }
+    }
+
+    QImage &img = writableTile(index);
+    QPainter painter(&img);
+    if (src.isUniform())
+        painter.fillRect(QRect(QPoint(0, 0), covered), toColor(src.value, srcFormat));
+    else
+        painter.drawImage(0, 0, src.image);
+}
+
+void TiledImage::draw(const TiledImage &src) {
+    for (int ty = 0; ty < qMin(tilesY(), src.tilesY()); ++ty) {
+        for (int tx = 0; tx < qMin(tilesX(), src.tilesX()); ++tx) {
+            const int srcIndex = src.tileIndex(tx, ty);
+            drawTile(tileIndex(tx, ty), src.tileAt(srcIndex), src.tileRect(srcIndex).size(), src.format());
+        }
+    }
+}
+
+qint64 TiledImage::memoryUsage() const {
+    qint64 total = 0;
+    for (const Tile &tile : tiles)
+        total += tile.memoryUsage();
+    return total;
+}
+
+quint32 TiledImage::toPixel(const QColor &color, QImage::Format format) {
+    switch (format) {
+        case QImage::Format_ARGB32_Premultiplied:
+            return qPremultiply(color.rgba());
+        case QImage::Format_RGB32:
+            return color.rgb();
+        default:
+            return color.rgba();
+    }
+}
+
+QColor TiledImage::toColor(quint32 pixel, QImage::Format format) {
+    switch (format) {
+        case QImage::Format_ARGB32_Premultiplied:
+            return QColor::fromRgba(qUnpremultiply(pixel));
+        case QImage::Format_RGB32:
+            return QColor::fromRgb(pixel);
+        default:
+            return QColor::fromRgba(pixel);
+    }
+}
@@ -0,0 +1,132 @@
+#ifndef TILEDIMAGE_H
+#define TILEDIMAGE_H
+
+#include <QColor>
+#include <QImage>
+#include <QPainter>
+#include <QPoint>
+#include <QRect>
+#include <QRegion>
+#include <QSharedPointer>
+#include <QSize>
+#include <QVector>
+#include <functional>
+
+// Imagem dividida em tiles de TileSize x TileSize. Um tile de uma cor só é
+// guardado como um único valor e só ganha pixels na primeira escrita. Os
+// demais são QImages compartilhadas implicitamente: copiar um TiledImage
+// (para o histórico, por exemplo) não duplica pixels, e só o tile alterado
+// depois é copiado.
+//
+// Um tile também pode vir de uma TileSource (um arquivo mapeado em memória,
+// por exemplo): ele só é decodificado na primeira leitura por tileAt().
+class TileSource {
+public:
+    virtual ~TileSource() = default;
+    virtual QImage decode() = 0;  // pode ser chamado de várias threads
+};
+
+class TiledImage {
+public:
+    static const int TileSize = 128;
+
+    // Formato das camadas com transparência. Pré-multiplicado é o formato
+    // nativo do raster do Qt: drawImage e QPainter não convertem nada no
+    // caminho. Só na abertura e na exportação se converte.
+    static const QImage::Format LayerFormat = QImage::Format_ARGB32_Premultiplied;
+
+    struct Tile {
+        QImage image;       // nulo quando o tile é uniforme
+        quint32 value = 0;  // valor cru do pixel de um tile uniforme
+        QSharedPointer<TileSource> source;  // pixels ainda não decodificados
+
+        bool isUniform() const { return image.isNull() && !source; }
+        bool sharesWith(const Tile &other) const;
+        qint64 memoryUsage() const;
+    };
+
+    TiledImage();
+    TiledImage(const QSize &size, QImage::Format format, const QColor &fill = Qt::transparent);
+    static TiledImage fromImage(const QImage &image);
+
+    // Cópia em outro formato de 32 bits; tiles uniformes só trocam o valor e
+    // tiles ainda na fonte são convertidos quando forem decodificados
+    TiledImage convertedTo(QImage::Format format) const;
+
+    bool isNull() const;
+    QSize size() const;
+    int width() const;
+    int height() const;
+    QRect rect() const;
+    QImage::Format format() const;
+
+    // Grade de tiles
+    int tilesX() const;
+    int tilesY() const;
+    int tileCount() const;
+    int tileIndex(int tx, int ty) const;
+    QRect tileRect(int index) const;
+    QVector<int> tilesIn(const QRect &area) const;
+    // Tiles que cruzam a região, cada um uma vez só (marcados num vetor de
+    // bool: linear no número de tiles, mesmo com milhares sujos)
+    QVector<int> tilesIn(const QRegion &region) const;
+    // A região aumentada até a borda dos tiles que ela cruza
+    QRegion tileBounds(const QRegion &region) const;
+
+    const Tile &tileAt(int index) const;  // decodifica o tile se ainda estiver na fonte
+    const Tile &peekTile(int index) const;  // sem decodificar (só para comparar referências)
+    void decodeAll() const;                // antes de ler a mesma imagem de várias threads
+    void setTileAt(int index, const Tile &tile);
+    void setUniform(int index, quint32 value);
+    QImage tileImage(int index) const;  // tile uniforme vira uma imagem preenchida
+    QImage &writableTile(int index);    // materializa e desanexa antes de escrever
+
+    // Volta a guardar como um valor só os tiles que ficaram de uma cor
+    bool compactTile(int index);
+    void compact(const QRect &area);
+
+    void fill(const QColor &color);
+    quint32 pixel(const QPoint &pos) const;
+    QColor pixelColor(const QPoint &pos) const;
+
+    // Achata uma região (ou a imagem toda) numa QImage comum
+    QImage copy(const QRect &area) const;
+    QImage toImage() const;
+
+    // Desenha os tiles que cruzam area sem achatar a imagem; tiles uniformes
+    // viram um fillRect
+    void render(QPainter &painter, const QRect &area) const;
+    // Zoom inteiro sem a transformação do QPainter: target está em
+    // coordenadas ampliadas (imagem * factor) e cada pixel vira um bloco
+    // factor x factor (vizinho mais próximo). Só o que cai em target é ampliado.
+    void renderScaled(QPainter &painter, const QRect &target, int factor) const;
+    QImage scaled(const QSize &size, Qt::AspectRatioMode mode = Qt::IgnoreAspectRatio) const;
+
+    // Substitui os pixels a partir de pos (como CompositionMode_Source)
+    void write(const QPoint &pos, const QImage &image);
+
+    // Desenha com um único QPainter numa janela densa do tamanho de bounds
+    // (em coordenadas da imagem); depois só os tiles que de fato mudaram
+    // são gravados de volta, e os que ficarem de uma cor voltam a ser uniformes.
+    void paint(const QRect &bounds, const std::function<void(QPainter &)> &draw);
+
+    // SourceOver de um tile de outra imagem sobre o tile index desta,
+    // alinhados pelo canto superior esquerdo
+    void drawTile(int index, const Tile &src, const QSize &srcSize, QImage::Format srcFormat);
+
+    // SourceOver de src inteira sobre esta imagem, tile a tile
+    void draw(const TiledImage &src);
+
+    qint64 memoryUsage() const;
+
+    // Conversão entre QColor e o valor cru do pixel de cada formato
+    static quint32 toPixel(const QColor &color, QImage::Format format);
+    static QColor toColor(quint32 pixel, QImage::Format format);
+
+private:
+    QSize imageSize;
+    QImage::Format imageFormat = QImage::Format_Invalid;
+    mutable QVector<Tile> tiles;  // mutable: tileAt() troca a fonte pelos pixels
+};
+
+#endif // TILEDIMAGE_H
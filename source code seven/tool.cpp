@@ -1,6 +1,7 @@
 #include <QPainterPath>
 #include <QRandomGenerator>
 #include "tool.h"
+#include "profiler.h"
 
 Tool::Tool()
     : toolType(ToolType::None),
@@ -9,6 +10,7 @@ Tool::Tool()
       filled(false),
       lineThickness(2),
       alpha(1.0f),
+      fillTolerance(0),
       textFont("Arial", 12)
 {}
 
@@ -33,19 +35,46 @@ void Tool::setThickness(int value) { lineThickness = value; }
 float Tool::opacity() const { return alpha; }
 void Tool::setOpacity(float value) { alpha = value; }
 
+// Tolerância do balde
+int Tool::tolerance() const { return fillTolerance; }
+void Tool::setTolerance(int value) { fillTolerance = value; }
+
 // Fonte
 QFont Tool::font() const { return textFont; }
 void Tool::setFont(const QFont &f) { textFont = f; }
 
+// Área que apply() pode alterar entre start e end
+QRect Tool::bounds(const QPoint &start, const QPoint &end) const {
+    // Meia espessura da caneta + margem do antialiasing
+    const int margin = lineThickness / 2 + 2;
+
+    QRect rect = QRect(start, end).normalized();
+    switch (toolType) {
+        case ToolType::Curve:
+            rect = rect.united(QRect((start + end) / 2 + QPoint(0, -40), QSize(1, 1)));
+            break;
+        case ToolType::Spray: {
+            const int radius = lineThickness * 2;
+            rect = QRect(end.x() - radius, end.y() - radius, 2 * radius + 1, 2 * radius + 1);
+            break;
+        }
+        default:
+            break;
+    }
+    return rect.adjusted(-margin, -margin, margin, margin);
+}
+
 // Aplicação no canvas
-void Tool::apply(QPainter &painter, const QPoint &start, const QPoint &end) const {
+QRect Tool::apply(QPainter &painter, const QPoint &start, const QPoint &end) const {
+    PROFILE_SCOPE("tool-apply");
+
     // Borracha: trata separadamente antes de configurar cor/opacidade
     if (type() == ToolType::Eraser) {
         QPen eraserPen(Qt::transparent, thickness(), Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin);
         painter.setCompositionMode(QPainter::CompositionMode_Clear);
         painter.setPen(eraserPen);
         painter.drawLine(start, end);
-        return;
+        return bounds(start, end);
     }
 
     // Configuração padrão para outras ferramentas
@@ -127,4 +156,5 @@ void Tool::apply(QPainter &painter, const QPoint &start, const QPoint &end) cons
         default:
             break;
     }
+    return bounds(start, end);
 }
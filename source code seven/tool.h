@@ -4,6 +4,7 @@
 #include <QColor>
 #include <QFont>
 #include <QPoint>
+#include <QRect>
 #include <QPainter>
 
 enum class ToolType {
@@ -47,11 +48,16 @@ public:
     float opacity() const;
     void setOpacity(float value);
 
+    // Balde: diferença máxima por canal aceita no preenchimento (0-255)
+    int tolerance() const;
+    void setTolerance(int value);
+
     QFont font() const;
     void setFont(const QFont &f);
 
-    // Aplicação
-    void apply(QPainter &painter, const QPoint &start, const QPoint &end) const;
+    // Aplicação: devolve o retângulo tocado (com a espessura e a margem do antialiasing)
+    QRect apply(QPainter &painter, const QPoint &start, const QPoint &end) const;
+    QRect bounds(const QPoint &start, const QPoint &end) const;
 
 private:
     ToolType toolType;
@@ -60,6 +66,7 @@ private:
     bool filled;
     int lineThickness;
     float alpha;
+    int fillTolerance;
     QFont textFont;
 };
 
@@ -1,5 +1,963 @@
 // src/UndoStack.cpp
 #include "UndoStack.h"
+#include "profiler.h"
+#include <QDataStream>
+#include <QDebug>
+#include <QDir>
+#include <QMutexLocker>
+#include <QTemporaryFile>
+#include <algorithm>
+#include <cstring>
 
-// Todas as implementações estão inline no header.
-// Este arquivo está presente apenas para manter a estrutura modular.
+UndoStack::UndoStack()
+    : spill(new SpillFile)
+{
+    // Um único worker mantém os jobs em ordem e não disputa CPU com a UI
+    workers.setMaxThreadCount(1);
+}
+
+UndoStack::~UndoStack() {
+    workers.clear();
+    workers.waitForDone();
+}
+
+void UndoStack::clear() {
+    workers.clear();
+    steps.clear();
+    state = TiledImage();
+    stateExtra.clear();
+    redoChild.clear();
+    cursor = -1;
+
+    // Jobs ainda rodando ficam com o arquivo antigo; o próximo histórico usa outro
+    spill.reset(new SpillFile);
+}
+
+void UndoStack::push(const TiledImage& img, const QByteArray &extra) {
+    PROFILE_SCOPE("undo-push");
+
+    if (cursor < 0 || state.isNull()) {
+        state = img;
+        stateExtra = extra;
+        redoChild = QVector<int>(1, -1);
+        cursor = 0;
+        return;
+    }
+
+    // Depois de um undo o passo vira um ramo novo: o redo antigo continua na árvore
+    StepPtr step(new Step);
+    step->extra = stateExtra;
+    step->parent = cursor;
+    if (img.size() != state.size() || img.format() != state.format()) {
+        step->fullImage = state;
+    } else {
+        for (int i = 0; i < img.tileCount(); ++i) {
+            // Tiles ainda não decodificados e iguais não precisam ser lidos
+            if (state.peekTile(i).sharesWith(img.peekTile(i)))
+                continue;
+            if (tileDiffers(state.tileAt(i), img.tileAt(i)))
+                step->tiles.append({i, state.tileAt(i)});
+        }
+
+        // Nada mudou: não cria um passo vazio no histórico
+        if (step->tiles.isEmpty() && extra == stateExtra) {
+            setState(img);
+            return;
+        }
+    }
+    step->bytes = rawBytes(*step);
+
+    steps.append(step);
+    redoChild.append(-1);
+    redoChild[cursor] = steps.size();
+    cursor = steps.size();
+    setState(img);
+    stateExtra = extra;
+    scheduleMaintenance();
+}
+
+bool UndoStack::canUndo() const {
+    return cursor > 0;
+}
+
+bool UndoStack::canRedo() const {
+    return cursor >= 0 && redoChild[cursor] > 0;
+}
+
+void UndoStack::pushCommand(const TiledImage &img, const QByteArray &extra, const QByteArray &command,
+                            qint64 cost) {
+    if (!replay || cursor < 0 || state.isNull() || extra != stateExtra
+        || img.size() != state.size() || img.format() != state.format()) {
+        push(img, extra);
+        return;
+    }
+
+    PROFILE_SCOPE("undo-push");
+
+    // Traço que não mudou nada: nenhum passo
+    qint64 changed = 0;
+    bool differs = false;
+    for (int i = 0; i < img.tileCount(); ++i) {
+        if (!state.peekTile(i).sharesWith(img.peekTile(i))) {
+            differs = true;
+            changed += state.peekTile(i).memoryUsage();
+        }
+    }
+    if (!differs) {
+        setState(img);
+        return;
+    }
+
+    const TiledImage previous = state;
+    StepPtr step(new Step);
+    step->extra = stateExtra;
+    step->command = command;
+    step->cost = cost;
+    step->parent = cursor;
+
+    // Desfazer este passo refaz os comandos desde o último quadro-chave
+    // no caminho até a raiz
+    bool keyframe = true;
+    qint64 replayCost = 0;
+    int replayCount = 0;
+    for (int n = cursor; n > 0 && !stepInto(n).command.isEmpty(); n = stepInto(n).parent) {
+        const Step &previous = stepInto(n);
+        replayCost += previous.cost;
+        ++replayCount;
+        if (previous.hasKeyframe) {
+            keyframe = replayCount >= KeyframeInterval || replayCost >= KeyframeCost;
+            break;
+        }
+    }
+
+    // Os quadros-chave que já existem acompanham a troca de estado antes de
+    // o novo entrar na lista
+    setState(img);
+
+    // O quadro-chave divide os tiles com o estado atual; só segura sozinho o
+    // que o comando trocou. setState() atualiza a conta conforme o estado anda
+    if (keyframe) {
+        step->keyframe = previous;
+        step->hasKeyframe = true;
+        step->held = changed;
+        step->heldValid = true;
+    }
+    step->bytes = command.size() + (keyframe ? changed : 0);
+
+    steps.append(step);
+    redoChild.append(-1);
+    redoChild[cursor] = steps.size();
+    cursor = steps.size();
+    scheduleMaintenance();
+}
+
+void UndoStack::setReplay(const Replay &replayFunction) {
+    replay = replayFunction;
+}
+
+TiledImage UndoStack::undo() {
+    if (canUndo()) {
+        if (!stepUp())
+            qWarning() << "❌ Passo do histórico ilegível no arquivo de troca; undo recusado";
+        scheduleMaintenance();
+    }
+    return current();
+}
+
+TiledImage UndoStack::redo() {
+    if (canRedo()) {
+        if (!stepDown(redoChild[cursor]))
+            qWarning() << "❌ Passo do histórico ilegível no arquivo de troca; redo recusado";
+        scheduleMaintenance();
+    }
+    return current();
+}
+
+int UndoStack::currentNode() const {
+    return cursor;
+}
+
+int UndoStack::nodeCount() const {
+    return cursor >= 0 ? steps.size() + 1 : 0;
+}
+
+int UndoStack::parentNode(int node) const {
+    return node > 0 && node < nodeCount() ? stepInto(node).parent : -1;
+}
+
+QVector<int> UndoStack::childNodes(int node) const {
+    QVector<int> children;
+    for (int i = 0; i < steps.size(); ++i) {
+        if (steps[i]->parent == node)
+            children.append(i + 1);
+    }
+    return children;
+}
+
+TiledImage UndoStack::jumpTo(int node) {
+    if (cursor < 0 || node < 0 || node >= nodeCount() || node == cursor)
+        return current();
+    PROFILE_SCOPE("undo-jump");
+
+    QVector<bool> onPath(nodeCount(), false);
+    for (int n = node; n >= 0; n = parentNode(n))
+        onPath[n] = true;
+    int ancestor = cursor;
+    while (!onPath[ancestor])
+        ancestor = parentNode(ancestor);
+
+    // Confere antes de mexer no estado: se um passo do caminho não volta do
+    // disco, o salto inteiro é recusado
+    bool readable = true;
+    for (int n = cursor; readable && n != ancestor; n = parentNode(n))
+        readable = ensureResident(n);
+    for (int n = node; readable && n != ancestor; n = parentNode(n))
+        readable = !stepInto(n).command.isEmpty() || ensureResident(n);
+    if (!readable) {
+        qWarning() << "❌ Passo do histórico ilegível no arquivo de troca; salto recusado";
+        scheduleMaintenance();
+        return current();
+    }
+
+    // Sobe até o ancestral comum. Numa sequência de comandos os estados do
+    // meio não interessam: o estado só é refeito antes de um passo de tiles
+    // ou no fim da subida. Se um job devolver um passo ao disco no meio do
+    // caminho e a leitura falhar, para no último nó que state representa
+    int stale = -1;
+    int stateNode = cursor;
+    bool ok = true;
+    while (ok && cursor != ancestor) {
+        const int child = cursor;
+        Step &step = stepInto(child);
+        if (step.command.isEmpty()) {
+            ok = settle(stale, stateNode) && swapStep(step);
+            if (!ok)
+                break;
+            stateNode = step.parent;
+        } else {
+            stale = child;
+        }
+        cursor = step.parent;
+        redoChild[cursor] = child;
+    }
+    ok = ok && settle(stale, stateNode);
+
+    // Desce até o alvo pelo caminho dele
+    QVector<int> path;
+    for (int n = node; ok && n != cursor; n = parentNode(n))
+        path.append(n);
+    for (int i = path.size() - 1; ok && i >= 0; --i)
+        ok = stepDown(path[i]);
+    if (!ok)
+        qWarning() << "❌ Passo do histórico ilegível no arquivo de troca; salto interrompido";
+
+    scheduleMaintenance();
+    return current();
+}
+
+bool UndoStack::settle(int &stale, int stateNode) {
+    if (stale < 0)
+        return true;
+    TiledImage source = commandSource(stale);
+    stale = -1;
+    if (source.isNull()) {
+        cursor = stateNode;
+        return false;
+    }
+    setState(source);
+    return true;
+}
+
+bool UndoStack::ensureResident(int node) const {
+    const QVector<int> chain = commandChain(node);
+    Step &step = stepInto(chain.last());
+    QMutexLocker locker(&step.mutex);
+    return makeResident(step, *spill);
+}
+
+UndoStack::Step &UndoStack::stepInto(int node) const {
+    return *steps[node - 1];
+}
+
+bool UndoStack::stepUp() {
+    const int child = cursor;
+    Step &step = stepInto(child);
+    if (step.command.isEmpty()) {
+        if (!swapStep(step))
+            return false;
+    } else {
+        TiledImage source = commandSource(child);
+        if (source.isNull())
+            return false;
+        setState(source);
+    }
+    cursor = step.parent;
+    redoChild[cursor] = child;
+    return true;
+}
+
+bool UndoStack::stepDown(int child) {
+    Step &step = stepInto(child);
+    if (step.command.isEmpty()) {
+        if (!swapStep(step))
+            return false;
+    } else {
+        setState(replay(state, step.command));
+    }
+    redoChild[cursor] = child;
+    cursor = child;
+    return true;
+}
+
+QVector<int> UndoStack::commandChain(int node) const {
+    // Toda sequência de comandos começa num quadro-chave; passo de tiles é
+    // uma cadeia de um só
+    QVector<int> chain(1, node);
+    if (stepInto(node).command.isEmpty())
+        return chain;
+    while (!stepInto(chain.last()).hasKeyframe) {
+        const int parent = stepInto(chain.last()).parent;
+        if (parent <= 0 || stepInto(parent).command.isEmpty())
+            break;
+        chain.append(parent);
+    }
+    return chain;
+}
+
+TiledImage UndoStack::commandSource(int node) const {
+    PROFILE_SCOPE("undo-replay");
+
+    const QVector<int> chain = commandChain(node);
+    Step &source = stepInto(chain.last());
+    TiledImage image;
+    {
+        QMutexLocker locker(&source.mutex);
+        if (!makeResident(source, *spill))
+            return TiledImage();
+        image = source.keyframe;
+    }
+    for (int i = chain.size() - 1; i > 0; --i)
+        image = replay(image, stepInto(chain[i]).command);
+    return image;
+}
+
+TiledImage UndoStack::current() const {
+    return cursor >= 0 ? state : TiledImage();
+}
+
+QByteArray UndoStack::currentExtra() const {
+    return cursor >= 0 ? stateExtra : QByteArray();
+}
+
+QByteArray UndoStack::save() {
+    return saveSnapshot()();
+}
+
+std::function<QByteArray()> UndoStack::saveSnapshot() {
+    // Aqui só copia referências: tiles, blocos comprimidos e posições no
+    // arquivo de troca. Comprimir e ler o disco fica para quem chamar a função
+    QVector<StepPtr> copies;
+    copies.reserve(steps.size());
+    for (const StepPtr &step : steps) {
+        StepPtr copy(new Step);
+        QMutexLocker locker(&step->mutex);
+        copy->tiles = step->tiles;
+        copy->fullImage = step->fullImage;
+        copy->extra = step->extra;
+        copy->command = step->command;
+        copy->keyframe = step->keyframe;
+        copy->hasKeyframe = step->hasKeyframe;
+        copy->cost = step->cost;
+        copy->parent = step->parent;
+        copy->storage = step->storage;
+        copy->packed = step->packed;
+        copy->fileOffset = step->fileOffset;
+        copy->fileSize = step->fileSize;
+        copies.append(copy);
+    }
+
+    const TiledImage image = state;
+    const int node = cursor;
+    const QVector<int> children = redoChild;
+    const QSharedPointer<SpillFile> file = spill;
+    return [copies, image, node, children, file]() {
+        return write(copies, image, node, children, *file);
+    };
+}
+
+QByteArray UndoStack::write(const QVector<StepPtr> &steps, const TiledImage &state, int cursor,
+                            const QVector<int> &redoChild, SpillFile &spill) {
+    QByteArray data;
+    QDataStream out(&data, QIODevice::WriteOnly);
+    out << qint32(cursor) << qint32(steps.size());
+
+    // Cada passo vai no mesmo formato comprimido usado em memória
+    for (const StepPtr &step : steps) {
+        switch (step->storage) {
+            case Storage::Raw:
+                out << pack(*step);
+                break;
+            case Storage::Compressed:
+                out << step->packed;
+                break;
+            case Storage::Spilled: {
+                const QByteArray packed = spill.read(step->fileOffset, step->fileSize);
+                if (packed.size() != step->fileSize)
+                    return QByteArray();
+                out << packed;
+                break;
+            }
+        }
+    }
+
+    // Extras no fim: históricos antigos simplesmente não têm esta parte
+    for (const StepPtr &step : steps)
+        out << step->extra;
+
+    // Comandos depois dos extras; o quadro-chave vai como os tiles que
+    // diferem do estado atual, que é quem restore() recebe
+    for (const StepPtr &step : steps) {
+        out << step->command << step->cost << step->hasKeyframe;
+        if (!step->hasKeyframe)
+            continue;
+
+        // Quadro-chave ilegível: melhor salvar o projeto sem histórico
+        if (!makeResident(*step, spill))
+            return QByteArray();
+        Step diff;
+        if (step->keyframe.size() != state.size() || step->keyframe.format() != state.format()) {
+            diff.fullImage = step->keyframe;
+        } else {
+            for (int i = 0; i < state.tileCount(); ++i) {
+                if (!state.peekTile(i).sharesWith(step->keyframe.peekTile(i)))
+                    diff.tiles.append({i, step->keyframe.tileAt(i)});
+            }
+        }
+        out << pack(diff);
+    }
+
+    // Árvore por último: sem esta parte o histórico é linear
+    for (const StepPtr &step : steps)
+        out << qint32(step->parent);
+    for (int child : redoChild)
+        out << qint32(child);
+    return data;
+}
+
+bool UndoStack::restore(const QByteArray &data, const TiledImage &current, const QByteArray &currentExtra) {
+    clear();
+
+    QDataStream in(data);
+    qint32 savedIndex = -1, count = 0;
+    in >> savedIndex >> count;
+    if (in.status() != QDataStream::Ok || count < 0 || savedIndex < 0 || savedIndex > count) {
+        push(current, currentExtra);
+        return false;
+    }
+
+    for (int i = 0; i < count; ++i) {
+        StepPtr step(new Step);
+        in >> step->packed;
+        step->storage = Storage::Compressed;
+        step->bytes = step->packed.size();
+        steps.append(step);
+    }
+    if (in.status() != QDataStream::Ok) {
+        clear();
+        push(current, currentExtra);
+        return false;
+    }
+    for (const StepPtr &step : steps) {
+        if (in.atEnd())
+            break;
+        in >> step->extra;
+    }
+    for (const StepPtr &step : steps) {
+        if (in.atEnd())
+            break;
+        bool hasKeyframe = false;
+        in >> step->command >> step->cost >> hasKeyframe;
+        if (!step->command.isEmpty()) {
+            // Passo de comando: o bloco de tiles gravado está vazio
+            step->packed.clear();
+            step->storage = Storage::Raw;
+            step->bytes = step->command.size();
+        }
+        if (!hasKeyframe)
+            continue;
+
+        QByteArray packed;
+        in >> packed;
+        step->hasKeyframe = true;
+        Step diff;
+        if (!unpack(diff, packed)) {
+            clear();
+            push(current, currentExtra);
+            return false;
+        }
+        if (diff.fullImage.isNull()) {
+            step->keyframe = current;
+            for (const Change &change : diff.tiles)
+                step->keyframe.setTileAt(change.index, change.tile);
+        } else {
+            step->keyframe = diff.fullImage;
+        }
+        step->bytes = rawBytes(*step);
+    }
+
+    redoChild = QVector<int>(count + 1, -1);
+    for (int i = 0; i < count; ++i) {
+        steps[i]->parent = i;
+        redoChild[i] = i + 1;
+    }
+    bool validTree = true;
+    if (!in.atEnd()) {
+        for (int i = 0; i < count; ++i) {
+            qint32 parent = 0;
+            in >> parent;
+            // O pai sempre é criado antes do filho
+            validTree = validTree && parent >= 0 && parent <= i;
+            steps[i]->parent = parent;
+        }
+        for (int n = 0; n <= count; ++n) {
+            qint32 child = -1;
+            in >> child;
+            validTree = validTree && (child == -1 || (child > n && child <= count && steps[child - 1]->parent == n));
+            redoChild[n] = child;
+        }
+    }
+    if (in.status() != QDataStream::Ok || !validTree) {
+        clear();
+        push(current, currentExtra);
+        return false;
+    }
+
+    state = current;
+    stateExtra = currentExtra;
+    cursor = savedIndex;
+    scheduleMaintenance();
+    return true;
+}
+
+void UndoStack::setMemoryBudget(qint64 bytes) {
+    budget = qMax<qint64>(0, bytes);
+    scheduleMaintenance();
+}
+
+qint64 UndoStack::memoryBudget() const {
+    return budget;
+}
+
+qint64 UndoStack::memoryUsage() const {
+    qint64 total = 0;
+    for (const StepPtr &step : steps)
+        total += step->bytes;
+    return total;
+}
+
+bool UndoStack::tileDiffers(const TiledImage::Tile &a, const TiledImage::Tile &b) {
+    // Mesmo dado compartilhado: o tile não foi tocado
+    if (a.sharesWith(b))
+        return false;
+    if (a.isUniform() || b.isUniform() || a.image.size() != b.image.size())
+        return true;
+
+    // Tile reescrito com o mesmo conteúdo
+    const size_t rowBytes = size_t(a.image.width()) * 4;
+    for (int y = 0; y < a.image.height(); ++y) {
+        if (std::memcmp(a.image.constScanLine(y), b.image.constScanLine(y), rowBytes) != 0)
+            return true;
+    }
+    return false;
+}
+
+qint64 UndoStack::rawBytes(const Step &step) {
+    // Quadro-chave inteiro: scheduleMaintenance() desconta o que ele divide
+    qint64 total = step.command.size() + step.fullImage.memoryUsage() + step.keyframe.memoryUsage();
+    for (const Change &change : step.tiles)
+        total += change.tile.memoryUsage();
+    return total;
+}
+
+qint64 UndoStack::heldBytes(const TiledImage &keyframe) const {
+    if (keyframe.size() != state.size() || keyframe.format() != state.format())
+        return keyframe.memoryUsage();
+
+    // Só os tiles que o estado atual não divide são memória do quadro-chave
+    qint64 total = 0;
+    for (int i = 0; i < keyframe.tileCount(); ++i) {
+        const TiledImage::Tile &tile = keyframe.peekTile(i);
+        if (!tile.sharesWith(state.peekTile(i)))
+            total += tile.memoryUsage();
+    }
+    return total;
+}
+
+bool UndoStack::startsCommandRun(int node) const {
+    const int parent = stepInto(node).parent;
+    return parent <= 0 || stepInto(parent).command.isEmpty();
+}
+
+QVector<int> UndoStack::distancesFromCursor() const {
+    // Distância de cada nó até o atual andando pela árvore; o passo fica com
+    // a da ponta mais próxima, então undo e todos os redos têm distância 0
+    const int count = steps.size() + 1;
+    QVector<QVector<int>> neighbours(count);
+    for (int i = 0; i < steps.size(); ++i) {
+        neighbours[steps[i]->parent].append(i + 1);
+        neighbours[i + 1].append(steps[i]->parent);
+    }
+
+    QVector<int> nodeDistance(count, -1);
+    QVector<int> queue(1, qMax(cursor, 0));
+    nodeDistance[queue.first()] = 0;
+    for (int head = 0; head < queue.size(); ++head) {
+        const int n = queue[head];
+        for (int next : neighbours[n]) {
+            if (nodeDistance[next] < 0) {
+                nodeDistance[next] = nodeDistance[n] + 1;
+                queue.append(next);
+            }
+        }
+    }
+
+    QVector<int> distance(steps.size());
+    for (int i = 0; i < steps.size(); ++i)
+        distance[i] = qMin(nodeDistance[steps[i]->parent], nodeDistance[i + 1]);
+    return distance;
+}
+
+bool UndoStack::swapStep(Step &step) {
+    QMutexLocker locker(&step.mutex);
+    if (!makeResident(step, *spill))
+        return false;
+    ++step.generation;
+    std::swap(stateExtra, step.extra);
+
+    if (!step.fullImage.isNull()) {
+        std::swap(state, step.fullImage);
+        invalidateHeld();
+        step.bytes = rawBytes(step);
+        return true;
+    }
+
+    // Só troca referências: nenhum pixel é copiado
+    for (Change &change : step.tiles) {
+        TiledImage::Tile previous = state.tileAt(change.index);
+        state.setTileAt(change.index, change.tile);
+        change.tile = previous;
+    }
+    trackHeld(step.tiles);  // agora com os tiles que o estado tinha antes
+    return true;
+}
+
+void UndoStack::setState(const TiledImage &next) {
+    if (next.size() != state.size() || next.format() != state.format()) {
+        state = next;
+        invalidateHeld();
+        return;
+    }
+
+    // Uma passada comparando ponteiros; só os tiles trocados vão para os quadros-chave
+    QVector<Change> replaced;
+    for (int i = 0; i < next.tileCount(); ++i) {
+        if (!state.peekTile(i).sharesWith(next.peekTile(i)))
+            replaced.append({i, state.peekTile(i)});
+    }
+    state = next;
+    trackHeld(replaced);
+}
+
+void UndoStack::trackHeld(const QVector<Change> &replaced) {
+    if (replaced.isEmpty())
+        return;
+    for (const StepPtr &step : steps) {
+        if (!step->hasKeyframe || !step->heldValid)
+            continue;
+        // Um job está com o passo: a conta é refeita na próxima manutenção
+        if (!step->mutex.tryLock()) {
+            step->heldValid = false;
+            continue;
+        }
+        if (step->storage != Storage::Raw || step->keyframe.size() != state.size()
+            || step->keyframe.format() != state.format()) {
+            step->heldValid = false;
+        } else {
+            for (const Change &change : replaced) {
+                const TiledImage::Tile &tile = step->keyframe.peekTile(change.index);
+                if (tile.sharesWith(change.tile))
+                    step->held += tile.memoryUsage();
+                if (tile.sharesWith(state.peekTile(change.index)))
+                    step->held -= tile.memoryUsage();
+            }
+            step->bytes = step->command.size() + step->held;
+        }
+        step->mutex.unlock();
+    }
+}
+
+void UndoStack::invalidateHeld() {
+    for (const StepPtr &step : steps)
+        step->heldValid = false;
+}
+
+void UndoStack::scheduleMaintenance() {
+    // Do passo mais distante para o mais próximo do cursor
+    const QVector<int> distance = distancesFromCursor();
+    QVector<int> order(steps.size());
+    for (int i = 0; i < order.size(); ++i)
+        order[i] = i;
+    std::sort(order.begin(), order.end(), [&distance](int a, int b) {
+        return distance[a] > distance[b];
+    });
+
+    // A conta do quadro-chave só é refeita do zero quando se perdeu (tamanho
+    // mudou, voltou do disco, restore); no resto setState() a mantém em dia
+    for (const StepPtr &step : steps) {
+        if (!step->hasKeyframe || step->heldValid || !step->mutex.tryLock())
+            continue;
+        if (step->storage == Storage::Raw && !step->pending) {
+            step->held = heldBytes(step->keyframe);
+            step->heldValid = true;
+            step->bytes = step->command.size() + step->held;
+        }
+        step->mutex.unlock();
+    }
+
+    qint64 used = memoryUsage();
+    for (int i : order) {
+        StepPtr step = steps[i];
+
+        // Sem quadro-chave o passo de comando é só a receita
+        const bool command = !step->command.isEmpty();
+        if (command && !step->hasKeyframe)
+            continue;
+
+        // Um job está trabalhando neste passo: não espera por ele na UI
+        if (!step->mutex.tryLock()) continue;
+
+        if (step->pending) {
+            // já está na fila
+        } else if (distance[i] < ResidentSteps) {
+            // Vizinhos do cursor: traz de volta antes que o undo precise
+            if (step->storage != Storage::Raw) {
+                step->pending = true;
+                QSharedPointer<SpillFile> file = spill;
+                workers.start([step, file]() { prefetchJob(step, file); });
+            }
+        } else if (command) {
+            // O quadro-chave divide tiles com os estados vizinhos: comprimir
+            // duplicaria pixels, então só sai da RAM quando o orçamento estoura
+            if (used > budget && step->storage != Storage::Spilled) {
+                used -= step->bytes - step->command.size();
+                if (step->storage == Storage::Raw && !startsCommandRun(i + 1)) {
+                    // No meio da sequência: o undo refaz a partir do quadro-chave anterior
+                    step->keyframe = TiledImage();
+                    step->hasKeyframe = false;
+                    step->bytes = step->command.size();
+                } else {
+                    step->pending = true;
+                    QSharedPointer<SpillFile> file = spill;
+                    workers.start([step, file]() { compactJob(step, file, true); });
+                }
+            }
+        } else if (step->storage == Storage::Raw || (step->storage == Storage::Compressed && used > budget)) {
+            const bool toDisk = used > budget;
+            if (toDisk)
+                used -= step->bytes;
+            step->pending = true;
+            QSharedPointer<SpillFile> file = spill;
+            workers.start([step, file, toDisk]() { compactJob(step, file, toDisk); });
+        }
+        step->mutex.unlock();
+    }
+}
+
+// Formato: se o passo guarda a imagem inteira, tamanho e formato dela; depois
+// a lista de tiles com índice e, para cada um, o valor uniforme ou as linhas cruas.
+QByteArray UndoStack::pack(const Step &step) {
+    QByteArray raw;
+    QDataStream out(&raw, QIODevice::WriteOnly);
+
+    QVector<Change> tiles = step.tiles;
+    QImage::Format format = QImage::Format_ARGB32;
+    const bool full = !step.fullImage.isNull();
+    out << full;
+    if (full) {
+        tiles.clear();
+        for (int i = 0; i < step.fullImage.tileCount(); ++i)
+            tiles.append({i, step.fullImage.tileAt(i)});
+        format = step.fullImage.format();
+        out << step.fullImage.size() << qint32(format);
+    }
+
+    out << qint32(tiles.size());
+    for (const Change &change : tiles) {
+        const TiledImage::Tile &tile = change.tile;
+        out << qint32(change.index) << tile.isUniform();
+        if (tile.isUniform()) {
+            out << tile.value;
+            continue;
+        }
+        const QImage &img = tile.image;
+        out << qint32(img.width()) << qint32(img.height()) << qint32(img.format());
+        for (int y = 0; y < img.height(); ++y)
+            out.writeRawData(reinterpret_cast<const char *>(img.constScanLine(y)), img.width() * 4);
+    }
+
+    // zlib no nível mais rápido: a prioridade é liberar memória sem atrasar o worker
+    return qCompress(raw, 1);
+}
+
+bool UndoStack::unpack(Step &step, const QByteArray &data) {
+    const QByteArray raw = qUncompress(data);
+    if (raw.isEmpty())
+        return false;
+    QDataStream in(raw);
+
+    // Decodifica à parte: um bloco corrompido não mexe no passo
+    QVector<Change> tiles;
+    TiledImage fullImage;
+    bool full = false;
+    in >> full;
+    if (full) {
+        QSize size;
+        qint32 format;
+        in >> size >> format;
+        if (in.status() != QDataStream::Ok || size.isEmpty())
+            return false;
+        fullImage = TiledImage(size, static_cast<QImage::Format>(format));
+    }
+
+    qint32 count = 0;
+    in >> count;
+    for (int i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+        qint32 index;
+        bool uniform;
+        TiledImage::Tile tile;
+        in >> index >> uniform;
+        if (uniform) {
+            in >> tile.value;
+        } else {
+            qint32 w, h, format;
+            in >> w >> h >> format;
+            if (w <= 0 || h <= 0 || w > TiledImage::TileSize || h > TiledImage::TileSize)
+                return false;
+            tile.image = QImage(w, h, static_cast<QImage::Format>(format));
+            if (tile.image.isNull())
+                return false;
+            for (int y = 0; y < h; ++y) {
+                if (in.readRawData(reinterpret_cast<char *>(tile.image.scanLine(y)), w * 4) != w * 4)
+                    return false;
+            }
+        }
+
+        if (full) {
+            if (index < 0 || index >= fullImage.tileCount())
+                return false;
+            fullImage.setTileAt(index, tile);
+        } else {
+            tiles.append({index, tile});
+        }
+    }
+    if (in.status() != QDataStream::Ok)
+        return false;
+
+    step.tiles = tiles;
+    step.fullImage = fullImage;
+    return true;
+}
+
+// Chamado com o mutex do passo travado
+bool UndoStack::makeResident(Step &step, SpillFile &spill) {
+    if (step.storage != Storage::Raw) {
+        // Leitura curta ou bloco corrompido: o passo fica onde estava
+        QByteArray packed = step.packed;
+        if (step.storage == Storage::Spilled) {
+            packed = spill.read(step.fileOffset, step.fileSize);
+            if (packed.size() != step.fileSize)
+                return false;
+        }
+        if (!unpack(step, packed))
+            return false;
+        step.packed.clear();
+        step.storage = Storage::Raw;
+
+        // Passo de comando comprimido: o bloco é o quadro-chave inteiro
+        if (!step.command.isEmpty())
+            std::swap(step.keyframe, step.fullImage);
+        step.heldValid = false;  // a manutenção refaz a conta na UI
+    }
+    step.bytes = rawBytes(step);
+    return true;
+}
+
+void UndoStack::compactJob(StepPtr step, QSharedPointer<SpillFile> spill, bool toDisk) {
+    PROFILE_SCOPE("undo-compact");
+    QMutexLocker locker(&step->mutex);
+
+    if (step->storage == Storage::Raw) {
+        // Comprime fora do lock: o undo pode precisar deste passo enquanto isso
+        Step snapshot;
+        snapshot.tiles = step->tiles;
+        snapshot.fullImage = step->command.isEmpty() ? step->fullImage : step->keyframe;
+        const int generation = step->generation;
+        locker.unlock();
+
+        QByteArray packed = pack(snapshot);
+
+        locker.relock();
+        if (step->generation != generation || step->storage != Storage::Raw) {
+            step->pending = false;
+            return;
+        }
+        step->tiles.clear();
+        step->fullImage = TiledImage();
+        step->keyframe = TiledImage();
+        step->packed = packed;
+        step->storage = Storage::Compressed;
+        step->bytes = step->command.size() + packed.size();
+    }
+
+    if (toDisk && step->storage == Storage::Compressed) {
+        const qint64 offset = spill->write(step->packed);
+        if (offset >= 0) {
+            step->fileOffset = offset;
+            step->fileSize = step->packed.size();
+            step->packed.clear();
+            step->storage = Storage::Spilled;
+            step->bytes = step->command.size();
+        }
+    }
+    step->pending = false;
+}
+
+void UndoStack::prefetchJob(StepPtr step, QSharedPointer<SpillFile> spill) {
+    QMutexLocker locker(&step->mutex);
+    makeResident(*step, *spill);  // se falhar, o passo fica no disco e o undo avisa
+    step->pending = false;
+}
+
+qint64 UndoStack::SpillFile::write(const QByteArray &data) {
+    QMutexLocker locker(&mutex);
+    if (!file) {
+        file.reset(new QTemporaryFile(QDir::tempPath() + "/littlepaint-undo-XXXXXX"));
+        if (!file->open()) {
+            file.reset();
+            return -1;
+        }
+    }
+
+    // Só acrescenta: o espaço de passos descartados volta quando o histórico é limpo
+    const qint64 offset = file->size();
+    if (!file->seek(offset) || file->write(data) != data.size())
+        return -1;
+    return offset;
+}
+
+QByteArray UndoStack::SpillFile::read(qint64 offset, int size) {
+    QMutexLocker locker(&mutex);
+    if (!file || !file->seek(offset))
+        return QByteArray();
+    return file->read(size);
+}